@@ -0,0 +1,338 @@
+// bikemodel.c
+// Baked lightcycle model. See bikemodel.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "bikemodel.h"
+#include "glstate.h"
+
+// Some <math.h> files do not define M_PI...
+#ifndef M_PI
+#define M_PI 3.14159265
+#endif
+
+// Tessellations the bike has always been drawn with
+#define BODY_SLICES 5
+#define BODY_STACKS 20
+#define WHEEL_INNER 0.25f
+#define WHEEL_OUTER 0.25f
+#define WHEEL_SIDES 10
+#define WHEEL_RINGS 10
+
+static struct BikeModel_t bike;
+
+//-----------------------------------------------------------------------------
+// Geometry collected on the CPU before it's uploaded
+//-----------------------------------------------------------------------------
+struct Builder_t {
+    GLfloat *vertices;      // position and normal
+    int vertex_count, vertex_capacity;
+    GLushort *indices;
+    int index_count, index_capacity;
+};
+
+static void* builder_grow( void* p, int* capacity, int needed, size_t elem_size ) {
+    if( needed <= *capacity )
+        return p;
+    while( *capacity < needed )
+        *capacity = *capacity ? *capacity * 2 : 256;
+    p = realloc( p, elem_size * *capacity );
+    if( !p ) {
+        printf( "tron: Sorry, out of memory building the bike.\n" );
+        exit( 1 );
+    }
+    return p;
+}
+
+static void builder_vertex( struct Builder_t* b, float px, float py, float pz,
+                            float nx, float ny, float nz ) {
+    GLfloat* v;
+    float len = sqrt( nx*nx + ny*ny + nz*nz );
+
+    if( b->vertex_count >= 65535 ) {
+        printf( "tron: the bike has too many vertices\n" );
+        exit( 1 );
+    }
+    b->vertices = builder_grow( b->vertices, &b->vertex_capacity, b->vertex_count + 1,
+                                sizeof( GLfloat ) * 6 );
+    v = b->vertices + 6 * b->vertex_count++;
+    v[0] = px;
+    v[1] = py;
+    v[2] = pz;
+    v[3] = nx / len;
+    v[4] = ny / len;
+    v[5] = nz / len;
+}
+
+static void builder_index( struct Builder_t* b, int i ) {
+    b->indices = builder_grow( b->indices, &b->index_capacity, b->index_count + 1,
+                               sizeof( GLushort ) );
+    b->indices[b->index_count++] = (GLushort) i;
+}
+
+// Two counter-clockwise triangles for the quad a, b, b + 1, a + 1
+static void builder_quad( struct Builder_t* b, int a, int c ) {
+    builder_index( b, a );
+    builder_index( b, c );
+    builder_index( b, c + 1 );
+    builder_index( b, a );
+    builder_index( b, c + 1 );
+    builder_index( b, a + 1 );
+}
+
+static void part_begin( struct Builder_t* b, int part, GLenum mode ) {
+    bike.parts[part].mode = mode;
+    bike.parts[part].first = b->index_count;
+}
+
+static void part_end( struct Builder_t* b, int part ) {
+    bike.parts[part].count = b->index_count - bike.parts[part].first;
+}
+
+//-----------------------------------------------------------------------------
+// The body: a radius 0.5 sphere flipped over and stretched 3 times along z.
+// Normals go through the inverse transpose of that.
+//-----------------------------------------------------------------------------
+static void build_body( struct Builder_t* b ) {
+    int base = b->vertex_count;
+    int i, j;
+
+    part_begin( b, BIKE_BODY, GL_TRIANGLES );
+    for( i = 0; i <= BODY_STACKS; i++ ) {
+        float theta = M_PI * i / BODY_STACKS;
+        for( j = 0; j <= BODY_SLICES; j++ ) {
+            float phi = 2.0 * M_PI * j / BODY_SLICES;
+            float x = sin( theta ) * cos( phi );
+            float y = sin( theta ) * sin( phi );
+            float z = cos( theta );
+
+            builder_vertex( b, -0.5f * x, -0.5f * y, 1.5f * z, -x, -y, z / 3.0f );
+        }
+    }
+    for( i = 0; i < BODY_STACKS; i++ ) {
+        for( j = 0; j < BODY_SLICES; j++ ) {
+            int a = base + i * ( BODY_SLICES + 1 ) + j;
+            builder_quad( b, a, a + BODY_SLICES + 1 );
+        }
+    }
+    part_end( b, BIKE_BODY );
+}
+
+//-----------------------------------------------------------------------------
+// A wheel, tessellated the way glutSolidTorus does: around the z axis, with
+// a tube of radius WHEEL_INNER swept around a ring of radius WHEEL_OUTER.
+// The wireframe shares its vertices.
+//-----------------------------------------------------------------------------
+static void build_wheel( struct Builder_t* b ) {
+    int base = b->vertex_count;
+    int i, j;
+
+    for( j = 0; j <= WHEEL_RINGS; j++ ) {
+        float psi = 2.0 * M_PI * j / WHEEL_RINGS;
+        for( i = 0; i <= WHEEL_SIDES; i++ ) {
+            float phi = 2.0 * M_PI * i / WHEEL_SIDES;
+
+            builder_vertex( b, cos( psi ) * ( WHEEL_OUTER + cos( phi ) * WHEEL_INNER ),
+                            sin( psi ) * ( WHEEL_OUTER + cos( phi ) * WHEEL_INNER ),
+                            sin( phi ) * WHEEL_INNER,
+                            cos( psi ) * cos( phi ), sin( psi ) * cos( phi ), sin( phi ) );
+        }
+    }
+
+    part_begin( b, BIKE_WHEEL, GL_TRIANGLES );
+    for( j = 0; j < WHEEL_RINGS; j++ ) {
+        for( i = 0; i < WHEEL_SIDES; i++ ) {
+            int a = base + j * ( WHEEL_SIDES + 1 ) + i;
+            builder_quad( b, a, a + WHEEL_SIDES + 1 );
+        }
+    }
+    part_end( b, BIKE_WHEEL );
+
+    // The edges of every quad along the ring and along the tube
+    part_begin( b, BIKE_WHEEL_WIRE, GL_LINES );
+    for( j = 0; j < WHEEL_RINGS; j++ ) {
+        for( i = 0; i < WHEEL_SIDES; i++ ) {
+            int a = base + j * ( WHEEL_SIDES + 1 ) + i;
+
+            builder_index( b, a );
+            builder_index( b, a + 1 );
+            builder_index( b, a );
+            builder_index( b, a + WHEEL_SIDES + 1 );
+        }
+    }
+    part_end( b, BIKE_WHEEL_WIRE );
+}
+
+//-----------------------------------------------------------------------------
+// The handlebar: a unit cube squashed to 1.2 x 0.1 x 0.1. Each face gets its
+// own four corners so the normals stay flat; scaling along the axes leaves
+// them alone.
+//-----------------------------------------------------------------------------
+static void build_handlebar( struct Builder_t* b ) {
+    static const float normals[6][3] = {
+        { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+    };
+    static const float size[3] = { 1.2f, 0.1f, 0.1f };
+    int face, corner, i;
+
+    part_begin( b, BIKE_HANDLEBAR, GL_TRIANGLES );
+    for( face = 0; face < 6; face++ ) {
+        const float *n = normals[face];
+        int base = b->vertex_count;
+        float u[3], w[3], p[3];
+
+        // In-plane axes ordered so that u x w points along the normal
+        u[0] = n[1] + n[2] != 0 ? 1 : 0;
+        u[1] = n[0] != 0 ? 1 : 0;
+        u[2] = 0;
+        w[0] = n[1] * u[2] - n[2] * u[1];
+        w[1] = n[2] * u[0] - n[0] * u[2];
+        w[2] = n[0] * u[1] - n[1] * u[0];
+
+        for( corner = 0; corner < 4; corner++ ) {
+            float su = ( corner == 1 || corner == 2 ) ? 0.5f : -0.5f;
+            float sw = ( corner >= 2 ) ? 0.5f : -0.5f;
+
+            for( i = 0; i < 3; i++ )
+                p[i] = ( n[i] * 0.5f + u[i] * su + w[i] * sw ) * size[i];
+            builder_vertex( b, p[0], p[1], p[2], n[0], n[1], n[2] );
+        }
+
+        builder_index( b, base );
+        builder_index( b, base + 1 );
+        builder_index( b, base + 2 );
+        builder_index( b, base );
+        builder_index( b, base + 2 );
+        builder_index( b, base + 3 );
+    }
+    part_end( b, BIKE_HANDLEBAR );
+}
+
+//-----------------------------------------------------------------------------
+// Bakes the bike into its buffers. Needs a current GL context.
+//-----------------------------------------------------------------------------
+void bike_model_init( void ) {
+    struct Builder_t b = { NULL, 0, 0, NULL, 0, 0 };
+
+    build_body( &b );
+    build_wheel( &b );
+    build_handlebar( &b );
+
+    glGenBuffers( 1, &bike.vbo );
+    glBindBuffer( GL_ARRAY_BUFFER, bike.vbo );
+    glBufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * 6 * b.vertex_count, b.vertices, GL_STATIC_DRAW );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+    glGenBuffers( 1, &bike.ibo );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, bike.ibo );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( GLushort ) * b.index_count, b.indices, GL_STATIC_DRAW );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+
+    free( b.vertices );
+    free( b.indices );
+}
+
+//-----------------------------------------------------------------------------
+// Sets the bike's green material on the front faces
+//-----------------------------------------------------------------------------
+void bike_model_material( void ) {
+    static const GLfloat ambient[] = { 0.0, 0.0, 0.0, 1.0 };
+    static const GLfloat diffuse[] = { 0.0, 0.2, 0.0, 1.0 };
+    static const GLfloat specular[] = { 0.0, 0.8, 0.0, 1.0 };
+    static const GLfloat shininess[] = { 100.0 };
+    static const GLfloat emission[] = { 0.0, 0.02, 0.0, 1.0 };
+
+    glMaterialfv( GL_FRONT, GL_AMBIENT, ambient );
+    glMaterialfv( GL_FRONT, GL_DIFFUSE, diffuse );
+    glMaterialfv( GL_FRONT, GL_SPECULAR, specular );
+    glMaterialfv( GL_FRONT, GL_SHININESS, shininess );
+    glMaterialfv( GL_FRONT, GL_EMISSION, emission );
+}
+
+static void part_draw( int part ) {
+    const struct BikePart_t* p = &bike.parts[part];
+
+    glDrawElements( p->mode, p->count, GL_UNSIGNED_SHORT,
+                    (const GLvoid*) ( sizeof( GLushort ) * p->first ) );
+}
+
+//-----------------------------------------------------------------------------
+// Moves onto wheel w's hub, spun by tire_angle
+//-----------------------------------------------------------------------------
+static void wheel_transform( int w, float tire_angle ) {
+    glTranslatef( 0.0f, -0.3f, w == 0 ? 1.2f : -1.2f );
+    glScalef( 2.4f, 1.0f, 1.0f );
+    glRotatef( 90.0f, 0.0f, 1.0f, 0.0f );
+    glRotatef( tire_angle, 0.0f, 0.0f, 1.0f );
+}
+
+//-----------------------------------------------------------------------------
+// Draws a bike at the current transform, turned by angle degrees about y,
+// with its wheels spun by tire_angle and the handlebar turned towards the
+// sign of handle_angle
+//-----------------------------------------------------------------------------
+void bike_model_draw( float angle, float tire_angle, float handle_angle ) {
+    GLsizei stride = sizeof( GLfloat ) * 6;
+    int w;
+
+    glPushMatrix();
+    glScalef( 2.0f, 2.0f, 2.0f );
+    glTranslatef( 0.0f, 0.0f, -1.8f );
+    glRotatef( angle, 0.0f, 1.0f, 0.0f );
+
+    glBindBuffer( GL_ARRAY_BUFFER, bike.vbo );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, bike.ibo );
+    glEnableClientState( GL_VERTEX_ARRAY );
+    glEnableClientState( GL_NORMAL_ARRAY );
+    glVertexPointer( 3, GL_FLOAT, stride, (const GLvoid*) 0 );
+    glNormalPointer( GL_FLOAT, stride, (const GLvoid*) ( sizeof( GLfloat ) * 3 ) );
+
+    part_draw( BIKE_BODY );
+
+    glPushMatrix();
+    glTranslatef( 0.0f, 0.4f, -0.8f );
+    if( handle_angle < 0 )
+        glRotatef( 40.0f, 0.0f, 1.0f, 0.0f );
+    else if( handle_angle > 0 )
+        glRotatef( -40.0f, 0.0f, 1.0f, 0.0f );
+    part_draw( BIKE_HANDLEBAR );
+    glPopMatrix();
+
+    for( w = 0; w < 2; w++ ) {
+        glPushMatrix();
+        wheel_transform( w, tire_angle );
+        part_draw( BIKE_WHEEL );
+        glPopMatrix();
+    }
+
+    // Black wireframe over both wheels, so their spin shows
+    glstate_disable( GL_LIGHTING );
+    glColor3f( 0.0f, 0.0f, 0.0f );
+    for( w = 0; w < 2; w++ ) {
+        glPushMatrix();
+        wheel_transform( w, tire_angle );
+        part_draw( BIKE_WHEEL_WIRE );
+        glPopMatrix();
+    }
+    glstate_enable( GL_LIGHTING );
+
+    glDisableClientState( GL_NORMAL_ARRAY );
+    glDisableClientState( GL_VERTEX_ARRAY );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glPopMatrix();
+}
+
+//-----------------------------------------------------------------------------
+// Frees the buffers
+//-----------------------------------------------------------------------------
+void bike_model_shutdown( void ) {
+    if( bike.vbo )
+        glDeleteBuffers( 1, &bike.vbo );
+    if( bike.ibo )
+        glDeleteBuffers( 1, &bike.ibo );
+    bike.vbo = bike.ibo = 0;
+}
@@ -0,0 +1,42 @@
+// bikemodel.h
+// The player's lightcycle, baked once into a single vertex buffer and
+// index buffer. Each part of the bike is a range of the index buffer (a
+// submesh); parts that never move relative to the bike have their
+// transforms baked into the vertices, so drawing a bike only needs
+// transforms for the wheels spinning and the handlebar turning. Drawing
+// several bikes (ghosts, other players) costs a handful of draw calls each.
+//
+// The bike's material is shared with the spheres, which have always been
+// lit with whatever the bike left set; bike_model_material() sets it once.
+#ifndef BIKEMODEL_H
+#define BIKEMODEL_H
+
+#include <GL/gl.h>
+
+// Submeshes
+enum {
+    BIKE_BODY,              // the stretched sphere, baked in place
+    BIKE_WHEEL,             // a torus around z, drawn twice
+    BIKE_WHEEL_WIRE,        // the wheel's wireframe as lines
+    BIKE_HANDLEBAR,         // scaled cube, centred on its pivot
+    BIKE_PARTS
+};
+
+struct BikePart_t {
+    GLenum mode;            // GL_TRIANGLES or GL_LINES
+    GLsizei first;          // first index
+    GLsizei count;
+};
+
+struct BikeModel_t {
+    GLuint vbo;             // interleaved position and normal
+    GLuint ibo;
+    struct BikePart_t parts[BIKE_PARTS];
+};
+
+void bike_model_init( void );
+void bike_model_material( void );
+void bike_model_draw( float angle, float tire_angle, float handle_angle );
+void bike_model_shutdown( void );
+
+#endif
@@ -0,0 +1,323 @@
+// capture.c
+// Asynchronous frame capture. See capture.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "capture.h"
+#include "options.h"
+
+struct CaptureSlot_t {
+    int frame;                  // frame number, names the file
+    GLubyte *pixels;            // RGBA, bottom row first as GL reads it
+};
+
+// The file name pattern split around its frame number, with any %% turned
+// back into %. The number is formatted here rather than handing the user's
+// pattern to printf.
+static char pattern[OPTIONS_PATH_MAX];
+static char prefix[OPTIONS_PATH_MAX], suffix[OPTIONS_PATH_MAX];
+static int number_width, number_zeros;
+static int width, height;
+static int ppm;
+static size_t frame_size;
+
+// readbacks in flight, by frame number modulo CAPTURE_PBOS
+static GLuint pbos[CAPTURE_PBOS];
+static int pbo_frame[CAPTURE_PBOS];
+
+// Frames waiting for the writer are slots[head] up to count of them,
+// wrapping. The game thread fills the slot after the last and only the
+// writer moves head, so slots are filled and written outside the lock.
+static struct CaptureSlot_t slots[CAPTURE_QUEUE];
+static int head = 0, count = 0;
+static int stopping = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t filled = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t emptied = PTHREAD_COND_INITIALIZER;
+static pthread_t writer;
+
+static struct CaptureStats_t stats;
+static int running = 0;
+
+//-----------------------------------------------------------------------------
+// Writes one frame, flipping it to top row first. Returns FALSE (0) if the
+// file couldn't be written, or its name didn't fit.
+//-----------------------------------------------------------------------------
+static int write_frame( const struct CaptureSlot_t* slot, GLubyte* row ) {
+    char name[sizeof( prefix ) + sizeof( suffix ) + CAPTURE_NUMBER_MAX];
+    size_t stride = (size_t) width * 4;
+    FILE *file;
+    int y, x, ok, length;
+
+    if( number_zeros )
+        length = snprintf( name, sizeof( name ), "%s%0*d%s", prefix, number_width, slot->frame, suffix );
+    else
+        length = snprintf( name, sizeof( name ), "%s%*d%s", prefix, number_width, slot->frame, suffix );
+    if( length < 0 || length >= (int) sizeof( name ) )
+        return 0;
+    file = fopen( name, "wb" );
+    if( file == NULL )
+        return 0;
+
+    ok = 1;
+    if( ppm )
+        ok = fprintf( file, "P6\n%d %d\n255\n", width, height ) > 0;
+    for( y = height - 1; y >= 0 && ok; y-- ) {
+        const GLubyte *src = slot->pixels + stride * y;
+
+        if( ppm ) {
+            for( x = 0; x < width; x++ ) {
+                row[x * 3] = src[x * 4];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + 2];
+            }
+            ok = fwrite( row, 3, width, file ) == (size_t) width;
+        } else {
+            ok = fwrite( src, 1, stride, file ) == stride;
+        }
+    }
+    if( fclose( file ) != 0 )
+        ok = 0;
+    return ok;
+}
+
+//-----------------------------------------------------------------------------
+// Splits path into prefix, frame number and suffix. The number has to be
+// the only conversion, %d with an optional zero flag and a width of up to
+// CAPTURE_NUMBER_MAX; any other % must be written %%. Returns FALSE (0) if
+// the pattern isn't like that.
+//-----------------------------------------------------------------------------
+static int parse_pattern( const char* path ) {
+    char *out = prefix;
+    size_t used = 0;
+    int numbers = 0;
+
+    number_width = number_zeros = 0;
+    while( *path ) {
+        if( *path != '%' || path[1] == '%' ) {
+            if( used + 1 >= sizeof( prefix ) )
+                return 0;
+            out[used++] = *path;
+            path += *path == '%' ? 2 : 1;
+            continue;
+        }
+
+        // A conversion; only one, and only an integer one
+        if( numbers++ )
+            return 0;
+        path++;
+        if( *path == '0' ) {
+            number_zeros = 1;
+            path++;
+        }
+        while( *path >= '0' && *path <= '9' ) {
+            number_width = number_width * 10 + ( *path++ - '0' );
+            if( number_width > CAPTURE_NUMBER_MAX )
+                return 0;
+        }
+        if( *path != 'd' )
+            return 0;
+        path++;
+
+        out[used] = '\0';
+        out = suffix;
+        used = 0;
+    }
+    out[used] = '\0';
+    return numbers == 1;
+}
+
+//-----------------------------------------------------------------------------
+// Writer thread: writes queued frames until told to stop and the queue is
+// empty
+//-----------------------------------------------------------------------------
+static void* writer_main( void* arg ) {
+    GLubyte *row = malloc( (size_t) width * 3 );
+    int failed = 0;
+
+    for( ;; ) {
+        struct CaptureSlot_t* slot;
+        int ok;
+
+        pthread_mutex_lock( &lock );
+        while( count == 0 && !stopping )
+            pthread_cond_wait( &filled, &lock );
+        if( count == 0 ) {
+            pthread_mutex_unlock( &lock );
+            break;
+        }
+        slot = &slots[head];
+        pthread_mutex_unlock( &lock );
+
+        ok = row && write_frame( slot, row );
+        if( !ok && !failed ) {
+            printf( "tron: can't write capture frame %d, dropping frames\n", slot->frame );
+            failed = 1;
+        }
+
+        pthread_mutex_lock( &lock );
+        head = ( head + 1 ) % CAPTURE_QUEUE;
+        count--;
+        if( ok )
+            stats.written++;
+        else
+            stats.dropped++;
+        pthread_cond_signal( &emptied );
+        pthread_mutex_unlock( &lock );
+    }
+
+    free( row );
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Sets up the buffers and starts the writer. Needs a current context.
+// Returns FALSE (0) on failure.
+//-----------------------------------------------------------------------------
+int capture_init( const char *path, int w, int h ) {
+    const char *ext = strrchr( path, '.' );
+    int i;
+
+    if( !parse_pattern( path ) ) {
+        printf( "tron: capture pattern '%s' needs exactly one %%d, like frame%%05d.ppm,"
+                " and %%%% for any other %%\n", path );
+        return 0;
+    }
+    strncpy( pattern, path, sizeof( pattern ) - 1 );
+    width = w;
+    height = h;
+    ppm = ext && !strcmp( ext, ".ppm" );
+    frame_size = (size_t) w * h * 4;
+
+    for( i = 0; i < CAPTURE_QUEUE; i++ ) {
+        slots[i].pixels = malloc( frame_size );
+        if( slots[i].pixels == NULL ) {
+            printf( "tron: Sorry, out of memory for the capture queue.\n" );
+            return 0;
+        }
+    }
+
+    glGenBuffers( CAPTURE_PBOS, pbos );
+    for( i = 0; i < CAPTURE_PBOS; i++ ) {
+        glBindBuffer( GL_PIXEL_PACK_BUFFER, pbos[i] );
+        glBufferData( GL_PIXEL_PACK_BUFFER, frame_size, NULL, GL_STREAM_READ );
+        pbo_frame[i] = -1;
+    }
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+    memset( &stats, 0, sizeof( stats ) );
+    head = count = stopping = 0;
+    if( pthread_create( &writer, NULL, writer_main, NULL ) != 0 ) {
+        printf( "tron: can't start the capture writer\n" );
+        return 0;
+    }
+    running = 1;
+    printf( "tron: capturing %dx%d %s frames to %s\n", w, h, ppm ? "PPM" : "raw", pattern );
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Maps a finished readback and queues its pixels for the writer. With wait
+// FALSE a full queue drops the frame; with it TRUE we wait for room.
+//-----------------------------------------------------------------------------
+static void retire_pbo( int index, int wait ) {
+    const GLubyte *pixels;
+    int slot;
+
+    pthread_mutex_lock( &lock );
+    while( wait && count == CAPTURE_QUEUE )
+        pthread_cond_wait( &emptied, &lock );
+    if( count == CAPTURE_QUEUE ) {
+        stats.dropped++;
+        pthread_mutex_unlock( &lock );
+        pbo_frame[index] = -1;
+        return;
+    }
+    slot = ( head + count ) % CAPTURE_QUEUE;
+    pthread_mutex_unlock( &lock );
+
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, pbos[index] );
+    pixels = glMapBuffer( GL_PIXEL_PACK_BUFFER, GL_READ_ONLY );
+    if( pixels ) {
+        memcpy( slots[slot].pixels, pixels, frame_size );
+        glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+    }
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+    pthread_mutex_lock( &lock );
+    if( pixels ) {
+        slots[slot].frame = pbo_frame[index];
+        count++;
+        pthread_cond_signal( &filled );
+    } else {
+        stats.dropped++;
+    }
+    pthread_mutex_unlock( &lock );
+    pbo_frame[index] = -1;
+}
+
+//-----------------------------------------------------------------------------
+// Starts reading back the frame just drawn, before it's swapped, and hands
+// the one read CAPTURE_PBOS frames ago to the writer
+//-----------------------------------------------------------------------------
+void capture_frame( void ) {
+    int index;
+
+    if( !running )
+        return;
+
+    index = stats.frames % CAPTURE_PBOS;
+    if( pbo_frame[index] >= 0 )
+        retire_pbo( index, 0 );
+
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, pbos[index] );
+    glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+    glReadPixels( 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*) 0 );
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+    pbo_frame[index] = stats.frames++;
+}
+
+//-----------------------------------------------------------------------------
+// Copies out the counts so far
+//-----------------------------------------------------------------------------
+void capture_stats( struct CaptureStats_t* out ) {
+    pthread_mutex_lock( &lock );
+    *out = stats;
+    pthread_mutex_unlock( &lock );
+}
+
+//-----------------------------------------------------------------------------
+// Queues the readbacks still in flight, waits for the writer to finish
+// everything and frees the buffers. Needs the context to still be current.
+//-----------------------------------------------------------------------------
+void capture_shutdown( void ) {
+    int frame, i;
+
+    if( !running )
+        return;
+
+    for( frame = stats.frames - CAPTURE_PBOS; frame < stats.frames; frame++ ) {
+        if( frame >= 0 && pbo_frame[frame % CAPTURE_PBOS] == frame )
+            retire_pbo( frame % CAPTURE_PBOS, 1 );
+    }
+
+    pthread_mutex_lock( &lock );
+    stopping = 1;
+    pthread_cond_signal( &filled );
+    pthread_mutex_unlock( &lock );
+    pthread_join( writer, NULL );
+    running = 0;
+
+    glDeleteBuffers( CAPTURE_PBOS, pbos );
+    for( i = 0; i < CAPTURE_QUEUE; i++ ) {
+        free( slots[i].pixels );
+        slots[i].pixels = NULL;
+    }
+
+    printf( "capture: %d frames, %d written, %d dropped\n",
+            stats.frames, stats.written, stats.dropped );
+}
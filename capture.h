@@ -0,0 +1,35 @@
+// capture.h
+// Records the game to disk one image per frame without slowing it down.
+//
+// Each finished frame is read back with glReadPixels into a ring of
+// CAPTURE_PBOS pixel buffer objects, so the copy runs on the GPU while the
+// next frames are drawn; a buffer is only mapped when the ring comes back
+// round to it, CAPTURE_PBOS frames later. Its pixels are then handed to a
+// writer thread through a queue of CAPTURE_QUEUE frames. Memory use is
+// fixed at startup: if the writer falls behind and the queue is full, the
+// frame is dropped (and counted) rather than making the game wait.
+//
+// Frames are numbered from 0 and file names come from a printf-like pattern
+// with exactly one %d, optionally with a zero flag and width, like
+// "shots/frame%05d.ppm"; any other % has to be written %%. Dropped frames
+// leave gaps in the numbering. A pattern ending in .ppm writes binary PPM
+// (RGB); anything else writes raw RGBA, 4 bytes a pixel, top row first.
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#define CAPTURE_PBOS 3          // readbacks in flight
+#define CAPTURE_QUEUE 8         // frames waiting for the writer
+#define CAPTURE_NUMBER_MAX 20   // widest frame number a pattern may ask for
+
+struct CaptureStats_t {
+    int frames;                 // frames captured so far
+    int written;
+    int dropped;
+};
+
+int capture_init( const char *pattern, int width, int height );
+void capture_frame( void );
+void capture_stats( struct CaptureStats_t* stats );
+void capture_shutdown( void );
+
+#endif
@@ -0,0 +1,223 @@
+// cull.c
+// Sphere frustum culling. See cull.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "cull.h"
+#include "view.h"
+#include "jobs.h"
+
+struct VisibleList_t cull_visible[CULL_LISTS];
+
+// Spheres per culling job. Each chunk writes its survivors into its own
+// stretch of the list so jobs never share output.
+#define CULL_CHUNK JOBS_SPHERE_GRAIN
+
+struct CullJob_t {
+    float planes[6][4];
+    struct VisibleList_t *list;
+};
+
+// survivors per chunk for the list being culled
+static int *chunk_count = NULL;
+static int chunk_capacity = 0;
+
+//-----------------------------------------------------------------------------
+// Pulls the six clip planes out of a projection * modelview matrix (Gribb
+// and Hartmann). The planes end up in the space the matrix transforms from.
+//-----------------------------------------------------------------------------
+void frustum_extract( struct Frustum_t* f, const float m[16] ) {
+    int i, j;
+
+    for( i = 0; i < 3; i++ ) {
+        for( j = 0; j < 4; j++ ) {
+            // row 3 + row i, and row 3 - row i
+            f->planes[i*2][j] = m[j*4+3] + m[j*4+i];
+            f->planes[i*2+1][j] = m[j*4+3] - m[j*4+i];
+        }
+    }
+
+    for( i = 0; i < 6; i++ ) {
+        float *p = f->planes[i];
+        float len = sqrt( p[0]*p[0] + p[1]*p[1] + p[2]*p[2] );
+
+        // A projective matrix (the planar shadow) can flatten a plane so it
+        // no longer depends on position. Leave those as they are; they
+        // then only test the sign of d.
+        if( len > 1e-6f ) {
+            p[0] /= len;
+            p[1] /= len;
+            p[2] /= len;
+            p[3] /= len;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Makes sure a list can hold every sphere, and that there's a count for
+// every chunk
+//-----------------------------------------------------------------------------
+static void visible_reserve( struct VisibleList_t* v ) {
+    int chunks = ( view.spheres.capacity + CULL_CHUNK - 1 ) / CULL_CHUNK;
+
+    if( chunk_capacity < chunks ) {
+        free( chunk_count );
+        chunk_capacity = chunks;
+        chunk_count = malloc( sizeof( int ) * chunks );
+        if( !chunk_count ) {
+            printf( "tron: Sorry, out of memory for the visible sphere lists.\n" );
+            exit( 1 );
+        }
+    }
+
+    if( v->capacity >= view.spheres.capacity )
+        return;
+
+    free( v->index );
+    v->capacity = view.spheres.capacity;
+    v->index = malloc( sizeof( int ) * v->capacity );
+    if( !v->index ) {
+        printf( "tron: Sorry, out of memory for the visible sphere lists.\n" );
+        exit( 1 );
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Fills a visible list with every sphere that's big enough to draw, for
+// passes that aren't culled
+//-----------------------------------------------------------------------------
+void cull_all( int list ) {
+    struct VisibleList_t* v = &cull_visible[list];
+    int i;
+
+    visible_reserve( v );
+    v->count = 0;
+    for( i = 0; i < view.spheres.count; i++ ) {
+        if( view.spheres.size[i] != 0.0f )
+            v->index[v->count++] = i;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Tests spheres [begin, end) against the planes and writes the indices of
+// those inside to out. Returns how many there were.
+//-----------------------------------------------------------------------------
+static int cull_range( const float planes[6][4], int begin, int end, int* out ) {
+    int i = begin, p, n = 0;
+
+#ifdef __SSE__
+    // The arrays are padded and aligned and ranges split on batches; padding
+    // has size 0 and is rejected along with fully shrunk view.spheres.
+    for( ; i < end; i += 4 ) {
+        __m128 x = _mm_load_ps( view.spheres.x + i );
+        __m128 y = _mm_load_ps( view.spheres.y + i );
+        __m128 z = _mm_load_ps( view.spheres.z + i );
+        __m128 r = _mm_load_ps( view.spheres.size + i );
+        __m128 neg_r = _mm_sub_ps( _mm_setzero_ps(), r );
+        __m128 in = _mm_cmpgt_ps( r, _mm_setzero_ps() );
+        int mask, lane;
+
+        for( p = 0; p < 6 && _mm_movemask_ps( in ); p++ ) {
+            __m128 d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, _mm_set1_ps( planes[p][0] ) ),
+                                               _mm_mul_ps( y, _mm_set1_ps( planes[p][1] ) ) ),
+                                   _mm_add_ps( _mm_mul_ps( z, _mm_set1_ps( planes[p][2] ) ),
+                                               _mm_set1_ps( planes[p][3] ) ) );
+            in = _mm_and_ps( in, _mm_cmpge_ps( d, neg_r ) );
+        }
+
+        mask = _mm_movemask_ps( in );
+        for( lane = 0; mask; lane++, mask >>= 1 ) {
+            if( mask & 1 )
+                out[n++] = i + lane;
+        }
+    }
+#endif
+
+    // Scalar path for builds without SSE
+    for( ; i < end && i < view.spheres.count; i++ ) {
+        float r = view.spheres.size[i];
+
+        if( r == 0.0f )
+            continue;
+        for( p = 0; p < 6; p++ ) {
+            if( planes[p][0] * view.spheres.x[i] + planes[p][1] * view.spheres.y[i] +
+                planes[p][2] * view.spheres.z[i] + planes[p][3] < -r )
+                break;
+        }
+        if( p == 6 )
+            out[n++] = i;
+    }
+    return n;
+}
+
+//-----------------------------------------------------------------------------
+// Culls chunks [begin, end) of CULL_CHUNK spheres, a job for cull_spheres().
+// Each chunk's survivors go at the start of its own stretch of the list.
+//-----------------------------------------------------------------------------
+static void cull_chunks( void* arg, int begin, int end, int worker ) {
+    const struct CullJob_t* job = arg;
+    int c;
+
+    for( c = begin; c < end; c++ ) {
+        int first = c * CULL_CHUNK;
+        int last = first + CULL_CHUNK < view.spheres.capacity ? first + CULL_CHUNK : view.spheres.capacity;
+
+        chunk_count[c] = cull_range( job->planes, first, last, job->list->index + first );
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Tests every sphere against the frustum of clip, the matrix the pass draws
+// spheres with, and fills that pass's visible list. offset_y is the lift the
+// pass adds to each sphere (see sphere_reflection()).
+//-----------------------------------------------------------------------------
+void cull_spheres( int list, const float clip[16], float offset_y ) {
+    struct VisibleList_t* v = &cull_visible[list];
+    struct CullJob_t job;
+    struct Frustum_t f;
+    int chunks, c, p;
+
+    visible_reserve( v );
+    chunks = ( view.spheres.capacity + CULL_CHUNK - 1 ) / CULL_CHUNK;
+
+    // Spheres are drawn at (-x, y + offset_y, -z); fold that into the planes
+    // so the test runs straight off the position arrays.
+    frustum_extract( &f, clip );
+    for( p = 0; p < 6; p++ ) {
+        job.planes[p][0] = -f.planes[p][0];
+        job.planes[p][1] = f.planes[p][1];
+        job.planes[p][2] = -f.planes[p][2];
+        job.planes[p][3] = f.planes[p][3] + f.planes[p][1] * offset_y;
+    }
+    job.list = v;
+
+    jobs_parallel_for( chunks, 1, cull_chunks, &job );
+
+    // Close the gaps between chunks; the list stays in ascending order
+    v->count = chunk_count[0];
+    for( c = 1; c < chunks; c++ ) {
+        memmove( v->index + v->count, v->index + c * CULL_CHUNK, sizeof( int ) * chunk_count[c] );
+        v->count += chunk_count[c];
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Frees the visible lists
+//-----------------------------------------------------------------------------
+void cull_shutdown( void ) {
+    int i;
+
+    for( i = 0; i < CULL_LISTS; i++ ) {
+        free( cull_visible[i].index );
+        cull_visible[i].index = NULL;
+        cull_visible[i].count = cull_visible[i].capacity = 0;
+    }
+    free( chunk_count );
+    chunk_count = NULL;
+    chunk_capacity = 0;
+}
@@ -0,0 +1,35 @@
+// cull.h
+// View frustum culling for the sphere passes. Once per frame the frustum of
+// each pass is extracted from its clip matrix and every sphere is tested
+// against it (four at a time with SSE). The result is one list of visible
+// sphere indices per pass, which the draw code walks instead of the whole
+// sphere set.
+#ifndef CULL_H
+#define CULL_H
+
+// One list per sphere pass
+enum {
+    CULL_MAIN,              // spheres themselves, plus their highlight
+    CULL_REFLECTION,        // mirrored through the floor
+    CULL_SHADOW,            // projected onto the floor
+    CULL_LISTS
+};
+
+struct Frustum_t {
+    float planes[6][4];     // ax + by + cz + d >= 0 inside, normalized
+};
+
+struct VisibleList_t {
+    int *index;             // sphere indices, ascending
+    int count;
+    int capacity;
+};
+
+extern struct VisibleList_t cull_visible[CULL_LISTS];
+
+void frustum_extract( struct Frustum_t* f, const float clip[16] );
+void cull_spheres( int list, const float clip[16], float offset_y );
+void cull_all( int list );
+void cull_shutdown( void );
+
+#endif
@@ -0,0 +1,91 @@
+// events.c
+// Min-heap of timed simulation events. See events.h.
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "events.h"
+
+static struct SimEvent_t *heap = NULL;
+static int heap_count = 0;
+static int heap_capacity = 0;
+
+//-----------------------------------------------------------------------------
+// Schedules an event. Events due at the same time come out in no
+// particular order.
+//-----------------------------------------------------------------------------
+void events_push( unsigned int time, int sphere, int kind ) {
+    struct SimEvent_t event;
+    int i, parent;
+
+    if( heap_count == heap_capacity ) {
+        heap_capacity = heap_capacity ? heap_capacity * 2 : 64;
+        heap = realloc( heap, sizeof( struct SimEvent_t ) * heap_capacity );
+        if( !heap ) {
+            printf( "tron: Sorry, out of memory for simulation events.\n" );
+            exit( 1 );
+        }
+    }
+
+    event.time = time;
+    event.sphere = sphere;
+    event.kind = kind;
+
+    // sift up
+    for( i = heap_count++; i > 0; i = parent ) {
+        parent = ( i - 1 ) / 2;
+        if( heap[parent].time <= time )
+            break;
+        heap[i] = heap[parent];
+    }
+    heap[i] = event;
+}
+
+//-----------------------------------------------------------------------------
+// Takes the earliest event off the heap if it's due by now. Returns FALSE
+// (0) when nothing is due.
+//-----------------------------------------------------------------------------
+int events_pop_due( unsigned int now, struct SimEvent_t* event ) {
+    struct SimEvent_t last;
+    int i, child;
+
+    if( heap_count == 0 || heap[0].time > now )
+        return 0;
+
+    *event = heap[0];
+    last = heap[--heap_count];
+
+    // sift the last event down from the root
+    for( i = 0; ( child = i * 2 + 1 ) < heap_count; i = child ) {
+        if( child + 1 < heap_count && heap[child + 1].time < heap[child].time )
+            child++;
+        if( last.time <= heap[child].time )
+            break;
+        heap[i] = heap[child];
+    }
+    heap[i] = last;
+
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Number of events still to come
+//-----------------------------------------------------------------------------
+int events_pending( void ) {
+    return heap_count;
+}
+
+//-----------------------------------------------------------------------------
+// Drops every scheduled event
+//-----------------------------------------------------------------------------
+void events_clear( void ) {
+    heap_count = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Frees the heap
+//-----------------------------------------------------------------------------
+void events_free( void ) {
+    free( heap );
+    heap = NULL;
+    heap_count = heap_capacity = 0;
+}
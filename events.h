@@ -0,0 +1,26 @@
+// events.h
+// Timed simulation events. A binary min-heap ordered by due time, so the
+// simulation only looks at spheres whose state is about to change instead
+// of scanning all of them every step.
+#ifndef EVENTS_H
+#define EVENTS_H
+
+enum {
+    EVENT_SHRUNK,           // a dying sphere has shrunk away
+    EVENT_RESPAWN,          // a dead sphere comes back in the sky
+    EVENT_LANDED            // a falling sphere reaches the floor
+};
+
+struct SimEvent_t {
+    unsigned int time;      // simulation time (ms) the event is due at
+    int sphere;
+    int kind;               // EVENT_*
+};
+
+void events_push( unsigned int time, int sphere, int kind );
+int events_pop_due( unsigned int now, struct SimEvent_t* event );
+int events_pending( void );
+void events_clear( void );
+void events_free( void );
+
+#endif
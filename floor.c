@@ -0,0 +1,331 @@
+// floor.c
+// Tiled floor in a static vertex buffer. See floor.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "floor.h"
+#include "matrix.h"
+#include "cull.h"
+#include "shader.h"
+#include "shadowmap.h"
+#include "pipeline.h"
+
+#define FLOOR_VERTEX_FLOATS 5
+#define FLOOR_TILE_VERTICES 6   // two triangles
+
+struct Floor_t floor_mesh;
+
+// The shader pipeline's program (pipeline.h)
+static GLuint core_program = 0;
+static GLuint core_vao = 0;
+static GLint core_modelview, core_color, core_reflected, core_shadowed, core_shadow_matrix;
+
+enum {
+    ATTR_POSITION, ATTR_TEXCOORD
+};
+
+static const char *attribs[] = { "a_position", "a_texcoord", NULL };
+
+static const char *core_vertex_src =
+    "#version 330 core\n"
+    PIPELINE_BLOCKS_GLSL
+    "in vec3 a_position;\n"
+    "in vec2 a_texcoord;\n"
+    "uniform mat4 u_modelview;\n"
+    "uniform mat4 u_shadow_matrix;\n"
+    "out vec2 v_texcoord;\n"
+    "out vec4 v_shadow;\n"
+    "void main() {\n"
+    "    gl_Position = camera.projection * u_modelview * vec4( a_position, 1.0 );\n"
+    "    v_texcoord = a_texcoord;\n"
+    "    v_shadow = u_shadow_matrix * vec4( a_position, 1.0 );\n"
+    "}\n";
+
+// The texture modulated by the color, as fixed function did. With a
+// reflection texture that's mixed over the reflection by its alpha right
+// here; without one the result is premultiplied for blending over the
+// reflection already in the frame. Shadowed parts go half way to black,
+// like the blended quad the fixed function path lays over them.
+static const char *core_fragment_src =
+    "#version 330 core\n"
+    PIPELINE_BLOCKS_GLSL
+    "uniform sampler2D u_texture;\n"
+    "uniform sampler2D u_reflection;\n"
+    "uniform sampler2DShadow u_shadow_map;\n"
+    "uniform vec4 u_color;\n"
+    "uniform int u_reflected;\n"
+    "uniform int u_shadowed;\n"
+    "in vec2 v_texcoord;\n"
+    "in vec4 v_shadow;\n"
+    "out vec4 frag_color;\n"
+    "void main() {\n"
+    "    vec4 c = texture( u_texture, v_texcoord ) * u_color;\n"
+    "    float k = 1.0;\n"
+    "    if( u_shadowed != 0 )\n"
+    "        k = 0.5 + 0.5 * textureProj( u_shadow_map, v_shadow );\n"
+    "    if( u_reflected != 0 ) {\n"
+    "        vec2 at = ( gl_FragCoord.xy - camera.viewport.xy ) / camera.viewport.zw;\n"
+    "        vec3 r = texture( u_reflection, at ).rgb;\n"
+    "        frag_color = vec4( mix( r, c.rgb, c.a ) * k, 1.0 );\n"
+    "    } else {\n"
+    "        frag_color = vec4( c.rgb * c.a * k, 1.0 - ( 1.0 - c.a ) * k );\n"
+    "    }\n"
+    "}\n";
+
+//-----------------------------------------------------------------------------
+// Builds the tiles of a floor half_size either side of the origin at
+// height y, with the texture repeating repeat times across it
+//-----------------------------------------------------------------------------
+void floor_init( float half_size, float y, int tiles, float repeat ) {
+    // Same corners, wound the same way, as the single quad this replaces,
+    // split into two triangles
+    static const int corners[FLOOR_TILE_VERTICES][2] = {
+        { 0, 0 }, { 0, 1 }, { 1, 1 }, { 0, 0 }, { 1, 1 }, { 1, 0 }
+    };
+    float *vertices, *v;
+    float tile = 2.0f * half_size / tiles;
+    int tx, tz, k;
+
+    memset( &floor_mesh, 0, sizeof( floor_mesh ) );
+    floor_mesh.tiles = tiles;
+    floor_mesh.half_size = half_size;
+    floor_mesh.y = y;
+
+    vertices = malloc( sizeof( float ) * FLOOR_VERTEX_FLOATS * FLOOR_TILE_VERTICES * tiles * tiles );
+    floor_mesh.first = malloc( sizeof( GLint ) * tiles * tiles );
+    floor_mesh.count = malloc( sizeof( GLsizei ) * tiles * tiles );
+    if( !vertices || !floor_mesh.first || !floor_mesh.count ) {
+        printf( "tron: Sorry, out of memory for the floor.\n" );
+        exit( 1 );
+    }
+
+    v = vertices;
+    for( tz = 0; tz < tiles; tz++ ) {
+        for( tx = 0; tx < tiles; tx++ ) {
+            for( k = 0; k < FLOOR_TILE_VERTICES; k++ ) {
+                int cx = tx + corners[k][0];
+                int cz = tz + corners[k][1];
+
+                *v++ = -half_size + cx * tile;
+                *v++ = y;
+                *v++ = -half_size + cz * tile;
+                *v++ = repeat * cx / tiles;
+                *v++ = repeat * cz / tiles;
+            }
+        }
+    }
+
+    glGenBuffers( 1, &floor_mesh.vbo );
+    glBindBuffer( GL_ARRAY_BUFFER, floor_mesh.vbo );
+    glBufferData( GL_ARRAY_BUFFER,
+                  sizeof( float ) * FLOOR_VERTEX_FLOATS * FLOOR_TILE_VERTICES * tiles * tiles,
+                  vertices, GL_STATIC_DRAW );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    free( vertices );
+}
+
+//-----------------------------------------------------------------------------
+// TRUE if the flat box [x0, x1] by [z0, z1] at height y is at least partly
+// inside f
+//-----------------------------------------------------------------------------
+static int tile_visible( const struct Frustum_t* f, float x0, float x1, float z0, float z1,
+                         float y ) {
+    int p;
+
+    for( p = 0; p < 6; p++ ) {
+        const float *pl = f->planes[p];
+
+        // The corner furthest along the plane's normal
+        float x = pl[0] >= 0.0f ? x1 : x0;
+        float z = pl[2] >= 0.0f ? z1 : z0;
+
+        if( pl[0] * x + pl[1] * y + pl[2] * z + pl[3] < 0.0f )
+            return 0;
+    }
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Gathers the tiles inside the view of clip into runs for glMultiDrawArrays.
+// Returns how many runs there are.
+//-----------------------------------------------------------------------------
+static int floor_gather( const float clip[16] ) {
+    float tile = 2.0f * floor_mesh.half_size / floor_mesh.tiles;
+    struct Frustum_t f;
+    int tx, tz, n = 0;
+
+    frustum_extract( &f, clip );
+
+    for( tz = 0; tz < floor_mesh.tiles; tz++ ) {
+        for( tx = 0; tx < floor_mesh.tiles; tx++ ) {
+            float x0 = -floor_mesh.half_size + tx * tile;
+            float z0 = -floor_mesh.half_size + tz * tile;
+
+            if( !tile_visible( &f, x0, x0 + tile, z0, z0 + tile, floor_mesh.y ) )
+                continue;
+
+            // Neighbouring tiles in a row are neighbours in the buffer too
+            if( n > 0 && floor_mesh.first[n - 1] + floor_mesh.count[n - 1] ==
+                         ( tz * floor_mesh.tiles + tx ) * FLOOR_TILE_VERTICES ) {
+                floor_mesh.count[n - 1] += FLOOR_TILE_VERTICES;
+            } else {
+                floor_mesh.first[n] = ( tz * floor_mesh.tiles + tx ) * FLOOR_TILE_VERTICES;
+                floor_mesh.count[n] = FLOOR_TILE_VERTICES;
+                n++;
+            }
+        }
+    }
+
+    floor_mesh.visible = 0;
+    for( tx = 0; tx < n; tx++ )
+        floor_mesh.visible += floor_mesh.count[tx] / FLOOR_TILE_VERTICES;
+    return n;
+}
+
+//-----------------------------------------------------------------------------
+// Draws the tiles inside the view of the current projection and modelview
+// matrices, with the texture coordinates on the active texture unit
+//-----------------------------------------------------------------------------
+void floor_draw( void ) {
+    float proj[16], modelview[16], clip[16];
+    GLsizei stride = sizeof( float ) * FLOOR_VERTEX_FLOATS;
+    int n;
+
+    glGetFloatv( GL_PROJECTION_MATRIX, proj );
+    glGetFloatv( GL_MODELVIEW_MATRIX, modelview );
+    mat4_multiply( clip, proj, modelview );
+    n = floor_gather( clip );
+    if( n == 0 )
+        return;
+
+    glBindBuffer( GL_ARRAY_BUFFER, floor_mesh.vbo );
+    glEnableClientState( GL_VERTEX_ARRAY );
+    glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+    glVertexPointer( 3, GL_FLOAT, stride, (const GLvoid*) 0 );
+    glTexCoordPointer( 2, GL_FLOAT, stride, (const GLvoid*) ( sizeof( float ) * 3 ) );
+
+    glMultiDrawArrays( GL_TRIANGLES, floor_mesh.first, floor_mesh.count, n );
+
+    glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+    glDisableClientState( GL_VERTEX_ARRAY );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Builds the shader pipeline's program and the vertex array it draws the
+// tiles from. Returns FALSE (0) if it won't build.
+//-----------------------------------------------------------------------------
+int floor_core_init( void ) {
+    GLsizei stride = sizeof( float ) * FLOOR_VERTEX_FLOATS;
+
+    core_program = shader_build( "floor pipeline", core_vertex_src, core_fragment_src, attribs );
+    if( !core_program )
+        return 0;
+
+    core_modelview = glGetUniformLocation( core_program, "u_modelview" );
+    core_color = glGetUniformLocation( core_program, "u_color" );
+    core_reflected = glGetUniformLocation( core_program, "u_reflected" );
+    core_shadowed = glGetUniformLocation( core_program, "u_shadowed" );
+    core_shadow_matrix = glGetUniformLocation( core_program, "u_shadow_matrix" );
+
+    pipeline_program( core_program );
+    glUseProgram( core_program );
+    glUniform1i( glGetUniformLocation( core_program, "u_texture" ), 0 );
+    glUniform1i( glGetUniformLocation( core_program, "u_shadow_map" ), FLOOR_SHADOW_UNIT );
+    glUniform1i( glGetUniformLocation( core_program, "u_reflection" ), FLOOR_REFLECTION_UNIT );
+    glUseProgram( 0 );
+
+    // The tiles never move, so the pointers are set once
+    glGenVertexArrays( 1, &core_vao );
+    glBindVertexArray( core_vao );
+    glBindBuffer( GL_ARRAY_BUFFER, floor_mesh.vbo );
+    glEnableVertexAttribArray( ATTR_POSITION );
+    glEnableVertexAttribArray( ATTR_TEXCOORD );
+    glVertexAttribPointer( ATTR_POSITION, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid*) 0 );
+    glVertexAttribPointer( ATTR_TEXCOORD, 2, GL_FLOAT, GL_FALSE, stride,
+                           (const GLvoid*) ( sizeof( float ) * 3 ) );
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Draws the tiles in view of the shader pipeline's camera, textured from
+// unit 0 and colored with the pipeline's color. A reflection texture other
+// than 0 is mixed in by screen position; shadowed takes the shadow map's
+// shadows. Comes out premultiplied when there's no reflection texture, so
+// blend with GL_ONE, GL_ONE_MINUS_SRC_ALPHA.
+//-----------------------------------------------------------------------------
+void floor_core_draw( GLuint reflection_texture, int shadowed ) {
+    float clip[16];
+    int n;
+
+    mat4_multiply( clip, pipeline.camera.projection, pipeline.modelview );
+    n = floor_gather( clip );
+    if( n == 0 )
+        return;
+
+    glUseProgram( core_program );
+    glUniformMatrix4fv( core_modelview, 1, GL_FALSE, pipeline.modelview );
+    glUniform4fv( core_color, 1, pipeline.color );
+    glUniform1i( core_reflected, reflection_texture != 0 );
+    glUniform1i( core_shadowed, shadowed );
+    if( shadowed ) {
+        glUniformMatrix4fv( core_shadow_matrix, 1, GL_FALSE, shadow_map.texture_matrix );
+        glActiveTexture( GL_TEXTURE0 + FLOOR_SHADOW_UNIT );
+        glBindTexture( GL_TEXTURE_2D, shadow_map.texture );
+    }
+    if( reflection_texture ) {
+        glActiveTexture( GL_TEXTURE0 + FLOOR_REFLECTION_UNIT );
+        glBindTexture( GL_TEXTURE_2D, reflection_texture );
+    }
+    glActiveTexture( GL_TEXTURE0 );
+
+    glBindVertexArray( core_vao );
+    glMultiDrawArrays( GL_TRIANGLES, floor_mesh.first, floor_mesh.count, n );
+    glBindVertexArray( 0 );
+    glUseProgram( 0 );
+}
+
+//-----------------------------------------------------------------------------
+// TRUE if the eye is below the floor under the current modelview, or the
+// shader pipeline's when it's on, where it sees the floor's underside
+//-----------------------------------------------------------------------------
+int floor_eye_below( void ) {
+    float modelview[16], inv[16];
+
+    if( pipeline_core )
+        mat4_copy( modelview, pipeline.modelview );
+    else
+        glGetFloatv( GL_MODELVIEW_MATRIX, modelview );
+    if( !mat4_invert( inv, modelview ) )
+        return 0;
+
+    // The eye's position is the inverse's translation
+    return inv[13] < floor_mesh.y;
+}
+
+//-----------------------------------------------------------------------------
+// Releases the shader pipeline's program and vertex array
+//-----------------------------------------------------------------------------
+void floor_core_shutdown( void ) {
+    if( core_program )
+        glDeleteProgram( core_program );
+    if( core_vao )
+        glDeleteVertexArrays( 1, &core_vao );
+    core_program = core_vao = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Frees the vertex buffer
+//-----------------------------------------------------------------------------
+void floor_shutdown( void ) {
+    if( floor_mesh.vbo )
+        glDeleteBuffers( 1, &floor_mesh.vbo );
+    free( floor_mesh.first );
+    free( floor_mesh.count );
+    memset( &floor_mesh, 0, sizeof( floor_mesh ) );
+}
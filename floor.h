@@ -0,0 +1,48 @@
+// floor.h
+// The floor's geometry: a square at FLOOR_Y, split into a grid of tiles
+// that all live in one static vertex buffer. floor_draw() tests every tile
+// against the current view frustum and draws the ones left with a single
+// glMultiDrawArrays, so a floor much bigger than the view costs no more
+// than the part of it on screen. State (texturing, stencil, color) is the
+// caller's.
+//
+// The shader pipeline (pipeline.h) has its own floor_core_draw(), which
+// also mixes in the reflection and the shadow map's shadows, so the top
+// of the floor is one draw whatever else is on.
+#ifndef FLOOR_H
+#define FLOOR_H
+
+#include <GL/glut.h>
+
+// Height of the floor, in the space the spheres are drawn in. The spheres
+// rest with their bottom a little above it.
+#define FLOOR_Y -0.75f
+
+#define FLOOR_HALF_SIZE 50.0f   // the floor runs from -this to +this in x and z
+#define FLOOR_TILES 8           // along each side
+#define FLOOR_REPEAT 32.0f      // texture repeats across the whole floor
+
+// Texture units floor_core_draw() reads the shadow map and reflection from
+#define FLOOR_SHADOW_UNIT 1
+#define FLOOR_REFLECTION_UNIT 2
+
+struct Floor_t {
+    GLuint vbo;                 // two triangles per tile, x y z s t
+    int tiles;                  // along each side
+    float half_size, y;
+    GLint *first;               // visible tiles, for glMultiDrawArrays
+    GLsizei *count;
+    int visible;                // tiles drawn by the last floor_draw()
+};
+
+extern struct Floor_t floor_mesh;
+
+void floor_init( float half_size, float y, int tiles, float repeat );
+void floor_draw( void );
+int floor_core_init( void );
+void floor_core_draw( GLuint reflection_texture, int shadowed );
+void floor_core_shutdown( void );
+int floor_eye_below( void );
+void floor_shutdown( void );
+
+#endif
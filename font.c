@@ -0,0 +1,102 @@
+// font.c
+// The 9x15 X11 misc-fixed font (public domain), the same glyphs GLUT draws
+// for GLUT_BITMAP_9_BY_15. See font.h.
+#include "font.h"
+
+const unsigned short font_9x15[FONT_GLYPHS][FONT_HEIGHT] = {
+    {0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000}, /* ' ' */
+    {0x000,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x000,0x000,0x010,0x010,0x000,0x000,0x000,0x000}, /* '!' */
+    {0x000,0x000,0x024,0x024,0x024,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000}, /* '"' */
+    {0x000,0x000,0x000,0x048,0x048,0x0fc,0x048,0x048,0x0fc,0x048,0x048,0x000,0x000,0x000,0x000,0x000}, /* '#' */
+    {0x000,0x010,0x07c,0x092,0x090,0x050,0x038,0x014,0x012,0x012,0x092,0x07c,0x010,0x000,0x000,0x000}, /* '$' */
+    {0x000,0x000,0x042,0x0a4,0x0a4,0x048,0x010,0x010,0x024,0x04a,0x04a,0x084,0x000,0x000,0x000,0x000}, /* '%' */
+    {0x000,0x000,0x060,0x090,0x090,0x090,0x060,0x062,0x094,0x088,0x094,0x062,0x000,0x000,0x000,0x000}, /* '&' */
+    {0x000,0x000,0x00c,0x008,0x010,0x020,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000}, /* '\'' */
+    {0x000,0x008,0x010,0x010,0x020,0x020,0x020,0x020,0x020,0x020,0x010,0x010,0x008,0x000,0x000,0x000}, /* '(' */
+    {0x000,0x020,0x010,0x010,0x008,0x008,0x008,0x008,0x008,0x008,0x010,0x010,0x020,0x000,0x000,0x000}, /* ')' */
+    {0x000,0x000,0x000,0x000,0x010,0x092,0x054,0x038,0x054,0x092,0x010,0x000,0x000,0x000,0x000,0x000}, /* '*' */
+    {0x000,0x000,0x000,0x000,0x010,0x010,0x010,0x0fe,0x010,0x010,0x010,0x000,0x000,0x000,0x000,0x000}, /* '+' */
+    {0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x018,0x018,0x008,0x008,0x010,0x000}, /* ',' */
+    {0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x0fe,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000}, /* '-' */
+    {0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x018,0x018,0x000,0x000,0x000,0x000}, /* '.' */
+    {0x000,0x000,0x002,0x004,0x004,0x008,0x010,0x010,0x020,0x040,0x040,0x080,0x000,0x000,0x000,0x000}, /* '/' */
+    {0x000,0x000,0x038,0x044,0x082,0x082,0x082,0x082,0x082,0x082,0x044,0x038,0x000,0x000,0x000,0x000}, /* '0' */
+    {0x000,0x000,0x010,0x030,0x050,0x090,0x010,0x010,0x010,0x010,0x010,0x0fe,0x000,0x000,0x000,0x000}, /* '1' */
+    {0x000,0x000,0x07c,0x082,0x082,0x004,0x008,0x010,0x020,0x040,0x080,0x0fe,0x000,0x000,0x000,0x000}, /* '2' */
+    {0x000,0x000,0x0fe,0x002,0x004,0x008,0x01c,0x002,0x002,0x002,0x082,0x07c,0x000,0x000,0x000,0x000}, /* '3' */
+    {0x000,0x000,0x004,0x00c,0x014,0x024,0x044,0x084,0x0fe,0x004,0x004,0x004,0x000,0x000,0x000,0x000}, /* '4' */
+    {0x000,0x000,0x0fe,0x080,0x080,0x0bc,0x0c2,0x002,0x002,0x002,0x082,0x07c,0x000,0x000,0x000,0x000}, /* '5' */
+    {0x000,0x000,0x03c,0x040,0x080,0x080,0x0bc,0x0c2,0x082,0x082,0x082,0x07c,0x000,0x000,0x000,0x000}, /* '6' */
+    {0x000,0x000,0x0fe,0x002,0x002,0x004,0x008,0x010,0x020,0x020,0x040,0x040,0x000,0x000,0x000,0x000}, /* '7' */
+    {0x000,0x000,0x038,0x044,0x082,0x044,0x038,0x044,0x082,0x082,0x044,0x038,0x000,0x000,0x000,0x000}, /* '8' */
+    {0x000,0x000,0x07c,0x082,0x082,0x082,0x086,0x07a,0x002,0x002,0x004,0x078,0x000,0x000,0x000,0x000}, /* '9' */
+    {0x000,0x000,0x000,0x000,0x000,0x018,0x018,0x000,0x000,0x000,0x018,0x018,0x000,0x000,0x000,0x000}, /* ':' */
+    {0x000,0x000,0x000,0x000,0x000,0x018,0x018,0x000,0x000,0x000,0x018,0x018,0x008,0x008,0x010,0x000}, /* ';' */
+    {0x000,0x000,0x004,0x008,0x010,0x020,0x040,0x040,0x020,0x010,0x008,0x004,0x000,0x000,0x000,0x000}, /* '<' */
+    {0x000,0x000,0x000,0x000,0x000,0x000,0x0fe,0x000,0x000,0x0fe,0x000,0x000,0x000,0x000,0x000,0x000}, /* '=' */
+    {0x000,0x000,0x040,0x020,0x010,0x008,0x004,0x004,0x008,0x010,0x020,0x040,0x000,0x000,0x000,0x000}, /* '>' */
+    {0x000,0x000,0x07c,0x082,0x082,0x002,0x004,0x008,0x010,0x010,0x000,0x010,0x000,0x000,0x000,0x000}, /* '?' */
+    {0x000,0x000,0x07c,0x082,0x082,0x09e,0x0a2,0x0a6,0x09a,0x080,0x080,0x07c,0x000,0x000,0x000,0x000}, /* '@' */
+    {0x000,0x000,0x010,0x028,0x044,0x082,0x082,0x082,0x0fe,0x082,0x082,0x082,0x000,0x000,0x000,0x000}, /* 'A' */
+    {0x000,0x000,0x0fc,0x042,0x042,0x042,0x0fc,0x042,0x042,0x042,0x042,0x0fc,0x000,0x000,0x000,0x000}, /* 'B' */
+    {0x000,0x000,0x07c,0x082,0x080,0x080,0x080,0x080,0x080,0x080,0x082,0x07c,0x000,0x000,0x000,0x000}, /* 'C' */
+    {0x000,0x000,0x0fc,0x042,0x042,0x042,0x042,0x042,0x042,0x042,0x042,0x0fc,0x000,0x000,0x000,0x000}, /* 'D' */
+    {0x000,0x000,0x0fe,0x040,0x040,0x040,0x078,0x040,0x040,0x040,0x040,0x0fe,0x000,0x000,0x000,0x000}, /* 'E' */
+    {0x000,0x000,0x0fe,0x040,0x040,0x040,0x078,0x040,0x040,0x040,0x040,0x040,0x000,0x000,0x000,0x000}, /* 'F' */
+    {0x000,0x000,0x07c,0x082,0x080,0x080,0x080,0x08e,0x082,0x082,0x082,0x07c,0x000,0x000,0x000,0x000}, /* 'G' */
+    {0x000,0x000,0x082,0x082,0x082,0x082,0x0fe,0x082,0x082,0x082,0x082,0x082,0x000,0x000,0x000,0x000}, /* 'H' */
+    {0x000,0x000,0x07c,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x07c,0x000,0x000,0x000,0x000}, /* 'I' */
+    {0x000,0x000,0x01f,0x004,0x004,0x004,0x004,0x004,0x004,0x004,0x084,0x078,0x000,0x000,0x000,0x000}, /* 'J' */
+    {0x000,0x000,0x082,0x084,0x088,0x090,0x0e0,0x0a0,0x090,0x088,0x084,0x082,0x000,0x000,0x000,0x000}, /* 'K' */
+    {0x000,0x000,0x080,0x080,0x080,0x080,0x080,0x080,0x080,0x080,0x080,0x0fe,0x000,0x000,0x000,0x000}, /* 'L' */
+    {0x000,0x000,0x082,0x082,0x0c6,0x0aa,0x0aa,0x092,0x092,0x082,0x082,0x082,0x000,0x000,0x000,0x000}, /* 'M' */
+    {0x000,0x000,0x082,0x082,0x0c2,0x0a2,0x092,0x08a,0x086,0x082,0x082,0x082,0x000,0x000,0x000,0x000}, /* 'N' */
+    {0x000,0x000,0x07c,0x082,0x082,0x082,0x082,0x082,0x082,0x082,0x082,0x07c,0x000,0x000,0x000,0x000}, /* 'O' */
+    {0x000,0x000,0x0fc,0x082,0x082,0x082,0x0fc,0x080,0x080,0x080,0x080,0x080,0x000,0x000,0x000,0x000}, /* 'P' */
+    {0x000,0x000,0x07c,0x082,0x082,0x082,0x082,0x082,0x082,0x0a2,0x092,0x07c,0x008,0x006,0x000,0x000}, /* 'Q' */
+    {0x000,0x000,0x0fc,0x082,0x082,0x082,0x0fc,0x090,0x088,0x084,0x082,0x082,0x000,0x000,0x000,0x000}, /* 'R' */
+    {0x000,0x000,0x07c,0x082,0x082,0x080,0x070,0x00c,0x002,0x082,0x082,0x07c,0x000,0x000,0x000,0x000}, /* 'S' */
+    {0x000,0x000,0x0fe,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x000,0x000,0x000,0x000}, /* 'T' */
+    {0x000,0x000,0x082,0x082,0x082,0x082,0x082,0x082,0x082,0x082,0x082,0x07c,0x000,0x000,0x000,0x000}, /* 'U' */
+    {0x000,0x000,0x082,0x082,0x082,0x044,0x044,0x044,0x028,0x028,0x028,0x010,0x000,0x000,0x000,0x000}, /* 'V' */
+    {0x000,0x000,0x082,0x082,0x082,0x082,0x092,0x092,0x092,0x092,0x0aa,0x044,0x000,0x000,0x000,0x000}, /* 'W' */
+    {0x000,0x000,0x082,0x082,0x044,0x028,0x010,0x010,0x028,0x044,0x082,0x082,0x000,0x000,0x000,0x000}, /* 'X' */
+    {0x000,0x000,0x082,0x082,0x044,0x028,0x010,0x010,0x010,0x010,0x010,0x010,0x000,0x000,0x000,0x000}, /* 'Y' */
+    {0x000,0x000,0x0fe,0x002,0x004,0x008,0x010,0x020,0x040,0x080,0x080,0x0fe,0x000,0x000,0x000,0x000}, /* 'Z' */
+    {0x000,0x03c,0x020,0x020,0x020,0x020,0x020,0x020,0x020,0x020,0x020,0x020,0x03c,0x000,0x000,0x000}, /* '[' */
+    {0x000,0x000,0x080,0x040,0x040,0x020,0x010,0x010,0x008,0x004,0x004,0x002,0x000,0x000,0x000,0x000}, /* backslash */
+    {0x000,0x078,0x008,0x008,0x008,0x008,0x008,0x008,0x008,0x008,0x008,0x008,0x078,0x000,0x000,0x000}, /* ']' */
+    {0x000,0x000,0x010,0x028,0x044,0x082,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000}, /* '^' */
+    {0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x1fe,0x000,0x000,0x000}, /* '_' */
+    {0x000,0x060,0x020,0x010,0x008,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000}, /* '`' */
+    {0x000,0x000,0x000,0x000,0x000,0x07c,0x002,0x002,0x07e,0x082,0x086,0x07a,0x000,0x000,0x000,0x000}, /* 'a' */
+    {0x000,0x000,0x080,0x080,0x080,0x0bc,0x0c2,0x082,0x082,0x082,0x0c2,0x0bc,0x000,0x000,0x000,0x000}, /* 'b' */
+    {0x000,0x000,0x000,0x000,0x000,0x07c,0x082,0x080,0x080,0x080,0x082,0x07c,0x000,0x000,0x000,0x000}, /* 'c' */
+    {0x000,0x000,0x002,0x002,0x002,0x07a,0x086,0x082,0x082,0x082,0x086,0x07a,0x000,0x000,0x000,0x000}, /* 'd' */
+    {0x000,0x000,0x000,0x000,0x000,0x07c,0x082,0x082,0x0fe,0x080,0x080,0x07c,0x000,0x000,0x000,0x000}, /* 'e' */
+    {0x000,0x000,0x01c,0x022,0x022,0x020,0x020,0x0f8,0x020,0x020,0x020,0x020,0x000,0x000,0x000,0x000}, /* 'f' */
+    {0x000,0x000,0x000,0x000,0x000,0x07a,0x084,0x084,0x084,0x078,0x080,0x07c,0x082,0x082,0x07c,0x000}, /* 'g' */
+    {0x000,0x000,0x080,0x080,0x080,0x0bc,0x0c2,0x082,0x082,0x082,0x082,0x082,0x000,0x000,0x000,0x000}, /* 'h' */
+    {0x000,0x000,0x030,0x000,0x000,0x070,0x010,0x010,0x010,0x010,0x010,0x07c,0x000,0x000,0x000,0x000}, /* 'i' */
+    {0x000,0x000,0x00c,0x000,0x000,0x01c,0x004,0x004,0x004,0x004,0x004,0x084,0x084,0x084,0x078,0x000}, /* 'j' */
+    {0x000,0x000,0x080,0x080,0x080,0x082,0x08c,0x0b0,0x0c0,0x0b0,0x08c,0x082,0x000,0x000,0x000,0x000}, /* 'k' */
+    {0x000,0x000,0x070,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x07c,0x000,0x000,0x000,0x000}, /* 'l' */
+    {0x000,0x000,0x000,0x000,0x000,0x0ec,0x092,0x092,0x092,0x092,0x092,0x082,0x000,0x000,0x000,0x000}, /* 'm' */
+    {0x000,0x000,0x000,0x000,0x000,0x0bc,0x0c2,0x082,0x082,0x082,0x082,0x082,0x000,0x000,0x000,0x000}, /* 'n' */
+    {0x000,0x000,0x000,0x000,0x000,0x07c,0x082,0x082,0x082,0x082,0x082,0x07c,0x000,0x000,0x000,0x000}, /* 'o' */
+    {0x000,0x000,0x000,0x000,0x000,0x0bc,0x0c2,0x082,0x082,0x082,0x0c2,0x0bc,0x080,0x080,0x080,0x000}, /* 'p' */
+    {0x000,0x000,0x000,0x000,0x000,0x07a,0x086,0x082,0x082,0x082,0x086,0x07a,0x002,0x002,0x002,0x000}, /* 'q' */
+    {0x000,0x000,0x000,0x000,0x000,0x09c,0x062,0x042,0x040,0x040,0x040,0x040,0x000,0x000,0x000,0x000}, /* 'r' */
+    {0x000,0x000,0x000,0x000,0x000,0x07c,0x082,0x080,0x07c,0x002,0x082,0x07c,0x000,0x000,0x000,0x000}, /* 's' */
+    {0x000,0x000,0x000,0x020,0x020,0x0fc,0x020,0x020,0x020,0x020,0x022,0x01c,0x000,0x000,0x000,0x000}, /* 't' */
+    {0x000,0x000,0x000,0x000,0x000,0x084,0x084,0x084,0x084,0x084,0x084,0x07a,0x000,0x000,0x000,0x000}, /* 'u' */
+    {0x000,0x000,0x000,0x000,0x000,0x082,0x082,0x044,0x044,0x028,0x028,0x010,0x000,0x000,0x000,0x000}, /* 'v' */
+    {0x000,0x000,0x000,0x000,0x000,0x082,0x082,0x092,0x092,0x092,0x0aa,0x044,0x000,0x000,0x000,0x000}, /* 'w' */
+    {0x000,0x000,0x000,0x000,0x000,0x082,0x044,0x028,0x010,0x028,0x044,0x082,0x000,0x000,0x000,0x000}, /* 'x' */
+    {0x000,0x000,0x000,0x000,0x000,0x084,0x084,0x084,0x084,0x084,0x08c,0x074,0x004,0x084,0x078,0x000}, /* 'y' */
+    {0x000,0x000,0x000,0x000,0x000,0x0fe,0x004,0x008,0x010,0x020,0x040,0x0fe,0x000,0x000,0x000,0x000}, /* 'z' */
+    {0x000,0x00e,0x010,0x010,0x010,0x008,0x030,0x030,0x008,0x010,0x010,0x010,0x00e,0x000,0x000,0x000}, /* '{' */
+    {0x000,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x010,0x000,0x000,0x000}, /* '|' */
+    {0x000,0x0e0,0x010,0x010,0x010,0x020,0x018,0x018,0x020,0x010,0x010,0x010,0x0e0,0x000,0x000,0x000}, /* '}' */
+    {0x000,0x000,0x062,0x092,0x08c,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000,0x000}, /* '~' */
+};
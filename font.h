@@ -0,0 +1,16 @@
+// font.h
+// Built in bitmap font for the HUD, so text needs neither GLUT nor X fonts.
+// Printable ASCII only. Each glyph is FONT_HEIGHT rows, top row first, with
+// bit 8 of a row as the leftmost pixel.
+#ifndef FONT_H
+#define FONT_H
+
+#define FONT_WIDTH 9
+#define FONT_HEIGHT 16
+#define FONT_ASCENT 12          // rows above the baseline
+#define FONT_FIRST 32           // ' '
+#define FONT_GLYPHS 95          // ' ' through '~'
+
+extern const unsigned short font_9x15[FONT_GLYPHS][FONT_HEIGHT];
+
+#endif
@@ -0,0 +1,217 @@
+// frametime.c
+// Frame time profiler. See frametime.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "frametime.h"
+
+// recent frames, oldest at history_head once the ring is full
+static double history[FRAMETIME_HISTORY];
+static int history_head = 0;
+static int history_count = 0;
+static int since_refresh = 0;
+static struct FrameStats_t recent;
+
+// whole run
+static unsigned int histogram[FRAMETIME_BUCKETS];
+static int total_frames = 0;
+static double total_ms = 0.0;
+static double total_max_ms = 0.0;
+static int hitches = 0;
+
+static double last_tick = -1.0;
+
+//-----------------------------------------------------------------------------
+// Monotonic wall clock in milliseconds. Unlike clock() this keeps running
+// while we wait on the GPU or vsync.
+//-----------------------------------------------------------------------------
+double frametime_now( void ) {
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int compare_ms( const void *a, const void *b ) {
+    double x = *(const double*) a, y = *(const double*) b;
+    return ( x > y ) - ( x < y );
+}
+
+//-----------------------------------------------------------------------------
+// Nearest rank percentile of a sorted array
+//-----------------------------------------------------------------------------
+static double percentile( const double *sorted, int n, double p ) {
+    int rank = (int) ( p * n + 0.999999 ) - 1;
+
+    if( rank < 0 )
+        rank = 0;
+    if( rank >= n )
+        rank = n - 1;
+    return sorted[rank];
+}
+
+//-----------------------------------------------------------------------------
+// Recomputes the HUD stats from the ring buffer
+//-----------------------------------------------------------------------------
+static void refresh_recent( void ) {
+    double sorted[FRAMETIME_HISTORY];
+    double sum = 0.0;
+    int i;
+
+    memcpy( sorted, history, sizeof( double ) * history_count );
+    qsort( sorted, history_count, sizeof( double ), compare_ms );
+    for( i = 0; i < history_count; i++ )
+        sum += sorted[i];
+
+    recent.frames = history_count;
+    recent.avg_ms = sum / history_count;
+    recent.p50_ms = percentile( sorted, history_count, 0.50 );
+    recent.p95_ms = percentile( sorted, history_count, 0.95 );
+    recent.p99_ms = percentile( sorted, history_count, 0.99 );
+    recent.max_ms = sorted[history_count - 1];
+    recent.hitches = hitches;
+}
+
+//-----------------------------------------------------------------------------
+// Marks the end of a frame. The first call only starts the clock.
+//-----------------------------------------------------------------------------
+void frametime_tick( void ) {
+    double now = frametime_now();
+    double ms;
+    int bucket;
+
+    if( last_tick < 0.0 ) {
+        last_tick = now;
+        return;
+    }
+    ms = now - last_tick;
+    last_tick = now;
+
+    history[history_head] = ms;
+    history_head = ( history_head + 1 ) % FRAMETIME_HISTORY;
+    if( history_count < FRAMETIME_HISTORY )
+        history_count++;
+
+    bucket = 0;
+    if( ms > FRAMETIME_BUCKET_MIN_MS )
+        bucket = (int) ceil( log( ms / FRAMETIME_BUCKET_MIN_MS ) / log( FRAMETIME_BUCKET_GROWTH ) );
+    if( bucket >= FRAMETIME_BUCKETS )
+        bucket = FRAMETIME_BUCKETS - 1;
+    histogram[bucket]++;
+    total_frames++;
+    total_ms += ms;
+    if( ms > total_max_ms )
+        total_max_ms = ms;
+
+    // Judge hitches against the median from before this frame, so one long
+    // frame can't raise its own bar
+    if( recent.frames > 0 && ms > FRAMETIME_HITCH_FACTOR * recent.p50_ms )
+        hitches++;
+
+    if( ++since_refresh >= FRAMETIME_REFRESH || recent.frames == 0 ) {
+        refresh_recent();
+        since_refresh = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Drawing stopped for a while (demand pacing idles when nothing changes).
+// The next tick only restarts the clock, so the gap isn't counted as a
+// frame.
+//-----------------------------------------------------------------------------
+void frametime_resume( void ) {
+    last_tick = -1.0;
+}
+
+//-----------------------------------------------------------------------------
+// Stats over the last FRAMETIME_HISTORY frames, updated every
+// FRAMETIME_REFRESH frames. All zero until the first frame is timed.
+//-----------------------------------------------------------------------------
+const struct FrameStats_t* frametime_recent( void ) {
+    return &recent;
+}
+
+//-----------------------------------------------------------------------------
+// Stats over the whole run, read from the histogram. Percentiles are the
+// upper edge of their bucket, no more than the longest frame.
+//-----------------------------------------------------------------------------
+void frametime_total( struct FrameStats_t* stats ) {
+    double targets[3] = { 0.50, 0.95, 0.99 };
+    double *results[3];
+    unsigned int seen = 0;
+    int b, t = 0;
+
+    memset( stats, 0, sizeof( *stats ) );
+    stats->frames = total_frames;
+    stats->hitches = hitches;
+    if( total_frames == 0 )
+        return;
+
+    stats->avg_ms = total_ms / total_frames;
+    stats->max_ms = total_max_ms;
+
+    results[0] = &stats->p50_ms;
+    results[1] = &stats->p95_ms;
+    results[2] = &stats->p99_ms;
+    for( b = 0; b < FRAMETIME_BUCKETS && t < 3; b++ ) {
+        seen += histogram[b];
+        while( t < 3 && seen >= targets[t] * total_frames ) {
+            *results[t] = FRAMETIME_BUCKET_MIN_MS * pow( FRAMETIME_BUCKET_GROWTH, b );
+            if( *results[t] > total_max_ms )
+                *results[t] = total_max_ms;
+            t++;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Writes the whole run stats to path. A .json file gets the stats and the
+// recent frame times; anything else is treated as CSV and gets one row
+// appended, so runs of different builds collect in one table. Returns FALSE
+// (0) if the file can't be written.
+//-----------------------------------------------------------------------------
+int frametime_dump( const char *path ) {
+    struct FrameStats_t total;
+    size_t len = strlen( path );
+    FILE *fp;
+    int i;
+
+    frametime_total( &total );
+
+    if( len > 5 && !strcmp( path + len - 5, ".json" ) ) {
+        fp = fopen( path, "w" );
+        if( !fp ) {
+            printf( "tron: can't write frame log %s\n", path );
+            return 0;
+        }
+        fprintf( fp, "{\n  \"frames\": %d,\n  \"avg_ms\": %.3f,\n"
+                     "  \"p50_ms\": %.3f,\n  \"p95_ms\": %.3f,\n  \"p99_ms\": %.3f,\n"
+                     "  \"max_ms\": %.3f,\n  \"hitches\": %d,\n  \"recent_ms\": [",
+                 total.frames, total.avg_ms, total.p50_ms, total.p95_ms,
+                 total.p99_ms, total.max_ms, total.hitches );
+        for( i = 0; i < history_count; i++ ) {
+            int slot = ( history_head - history_count + i + FRAMETIME_HISTORY ) % FRAMETIME_HISTORY;
+            fprintf( fp, "%s%.3f", i ? ", " : "", history[slot] );
+        }
+        fprintf( fp, "]\n}\n" );
+    } else {
+        fp = fopen( path, "a" );
+        if( !fp ) {
+            printf( "tron: can't write frame log %s\n", path );
+            return 0;
+        }
+        // Only a new file gets the header
+        fseek( fp, 0, SEEK_END );
+        if( ftell( fp ) == 0 )
+            fprintf( fp, "frames,avg_ms,p50_ms,p95_ms,p99_ms,max_ms,hitches\n" );
+        fprintf( fp, "%d,%.3f,%.3f,%.3f,%.3f,%.3f,%d\n",
+                 total.frames, total.avg_ms, total.p50_ms, total.p95_ms,
+                 total.p99_ms, total.max_ms, total.hitches );
+    }
+
+    fclose( fp );
+    return 1;
+}
@@ -0,0 +1,39 @@
+// frametime.h
+// Frame time profiler. frametime_tick() is called once per frame and the
+// time since the previous tick, taken from a monotonic wall clock, is kept
+// in a ring buffer of the most recent frames (for the HUD) and in a
+// histogram covering the whole run (for the log written on exit).
+//
+// A frame counts as a hitch when it takes more than FRAMETIME_HITCH_FACTOR
+// times the recent median. Time spent not drawing at all, like demand
+// pacing sitting idle, is left out with frametime_resume().
+#ifndef FRAMETIME_H
+#define FRAMETIME_H
+
+#define FRAMETIME_HISTORY 512           // recent frames kept for the HUD
+#define FRAMETIME_REFRESH 30            // frames between HUD stat updates
+#define FRAMETIME_HITCH_FACTOR 2.0
+
+// Whole run histogram, log scaled: bucket b holds frames up to
+// FRAMETIME_BUCKET_MIN_MS * FRAMETIME_BUCKET_GROWTH^b, so every percentile
+// is within 1% whatever the frame times are. The last bucket (past a
+// couple of days) catches the rest.
+#define FRAMETIME_BUCKET_MIN_MS 0.01
+#define FRAMETIME_BUCKET_GROWTH 1.01
+#define FRAMETIME_BUCKETS 2400
+
+struct FrameStats_t {
+    int frames;             // frames the stats cover
+    double avg_ms;
+    double p50_ms, p95_ms, p99_ms, max_ms;
+    int hitches;            // over the whole run
+};
+
+double frametime_now( void );
+void frametime_tick( void );
+void frametime_resume( void );
+const struct FrameStats_t* frametime_recent( void );
+void frametime_total( struct FrameStats_t* stats );
+int frametime_dump( const char *path );
+
+#endif
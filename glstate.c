@@ -0,0 +1,121 @@
+// glstate.c
+// Redundant state change filter. See glstate.h.
+#include <GL/gl.h>
+
+#include "glstate.h"
+
+#define STATE_UNKNOWN -1
+
+// Capabilities worth tracking; the rest go straight through
+static const GLenum caps[] = {
+    GL_LIGHTING,
+    GL_DEPTH_TEST,
+    GL_STENCIL_TEST,
+    GL_BLEND,
+    GL_TEXTURE_2D,
+    GL_COLOR_MATERIAL,
+    GL_CULL_FACE,
+    GL_NORMALIZE,
+    GL_POLYGON_OFFSET_FILL
+};
+#define CAP_COUNT ( (int) ( sizeof( caps ) / sizeof( caps[0] ) ) )
+
+static int cap_state[CAP_COUNT];
+static int depth_mask = STATE_UNKNOWN;
+static GLenum blend_src, blend_dst;
+static int blend_known = 0;
+
+// calls that didn't need to reach GL since the last glstate_filtered()
+static int filtered = 0;
+
+//-----------------------------------------------------------------------------
+// Forgets everything, so the next change of each kind goes through
+//-----------------------------------------------------------------------------
+void glstate_reset( void ) {
+    int i;
+
+    for( i = 0; i < CAP_COUNT; i++ )
+        cap_state[i] = STATE_UNKNOWN;
+    depth_mask = STATE_UNKNOWN;
+    blend_known = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Where cap sits in the cache, or -1 if it isn't tracked
+//-----------------------------------------------------------------------------
+static int cap_slot( GLenum cap ) {
+    int i;
+
+    for( i = 0; i < CAP_COUNT; i++ ) {
+        if( caps[i] == cap )
+            return i;
+    }
+    return -1;
+}
+
+static void cap_set( GLenum cap, int on ) {
+    int slot = cap_slot( cap );
+
+    if( slot >= 0 ) {
+        if( cap_state[slot] == on ) {
+            filtered++;
+            return;
+        }
+        cap_state[slot] = on;
+    }
+
+    if( on )
+        glEnable( cap );
+    else
+        glDisable( cap );
+}
+
+//-----------------------------------------------------------------------------
+// glEnable() and glDisable()
+//-----------------------------------------------------------------------------
+void glstate_enable( GLenum cap ) {
+    cap_set( cap, 1 );
+}
+
+void glstate_disable( GLenum cap ) {
+    cap_set( cap, 0 );
+}
+
+//-----------------------------------------------------------------------------
+// glDepthMask()
+//-----------------------------------------------------------------------------
+void glstate_depth_mask( GLboolean flag ) {
+    int on = flag ? 1 : 0;
+
+    if( depth_mask == on ) {
+        filtered++;
+        return;
+    }
+    depth_mask = on;
+    glDepthMask( flag );
+}
+
+//-----------------------------------------------------------------------------
+// glBlendFunc()
+//-----------------------------------------------------------------------------
+void glstate_blend_func( GLenum src, GLenum dst ) {
+    if( blend_known && blend_src == src && blend_dst == dst ) {
+        filtered++;
+        return;
+    }
+    blend_src = src;
+    blend_dst = dst;
+    blend_known = 1;
+    glBlendFunc( src, dst );
+}
+
+//-----------------------------------------------------------------------------
+// Returns how many calls were filtered out since the last time, and starts
+// counting again
+//-----------------------------------------------------------------------------
+int glstate_filtered( void ) {
+    int n = filtered;
+
+    filtered = 0;
+    return n;
+}
@@ -0,0 +1,24 @@
+// glstate.h
+// Shadow copy of the fixed-function state render() toggles, so a pass can
+// state what it needs without paying for calls that change nothing. Each
+// pass sets up its own state through glstate_*() and the calls are only
+// passed on to GL when the value actually differs from the cached one.
+//
+// The cache only knows about changes made through it. State changed inside
+// a glPushAttrib()/glPopAttrib() pair is fine, the pop puts back what the
+// cache expects. Anything else that changes cached state behind its back
+// must be followed by glstate_reset(), which forgets every value so the
+// next call of each kind goes through. render() resets once per frame.
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/gl.h>
+
+void glstate_reset( void );
+void glstate_enable( GLenum cap );
+void glstate_disable( GLenum cap );
+void glstate_depth_mask( GLboolean flag );
+void glstate_blend_func( GLenum src, GLenum dst );
+int glstate_filtered( void );
+
+#endif
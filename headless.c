@@ -0,0 +1,87 @@
+// headless.c
+// Runs the lightballs simulation without GLUT or a GL context and reports
+// how fast it steps. Used to measure simulation throughput on machines
+// without a display.
+//
+// usage: lightballs_headless [--steps N] [options], see options.h
+//
+// With --replay the recorded inputs replace the scripted ones and the run
+// ends with the recording, so a replay runs as fast as the simulation can.
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "sim.h"
+#include "pick.h"
+#include "options.h"
+#include "lod.h"
+#include "replay.h"
+#include "jobs.h"
+#include "view.h"
+
+#define KILL_INTERVAL 30        // steps between scripted kills
+
+#define TRUE 1
+#define FALSE 0
+
+// Level of detail is picked as if for a 600 pixel high, 40 degree view
+#define FOCAL_PX 824.0f
+
+//-----------------------------------------------------------------------------
+// Wall clock in seconds
+//-----------------------------------------------------------------------------
+static double wall_time( void ) {
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+//-----------------------------------------------------------------------------
+// Main Function
+//-----------------------------------------------------------------------------
+int main( int argc, char **argv ) {
+    int steps;
+    double start, elapsed;
+    int i, target;
+
+    options_parse( argc, argv );
+    steps = options.steps;
+
+    replay_init();
+    jobs_init( options.threads );
+    sim_init( options.sphere_count, options.seed );
+    view_init( FALSE );
+
+    start = wall_time();
+    for( i = 0; i < steps && !replay_done(); i++ ) {
+        // Drive the player forward, sweep the view and keep the crosshair
+        // selection up to date like the renderer does every frame. Shoot a
+        // sphere every so often so the death, respawn and fall paths all
+        // get exercised.
+        replay_key( 'w' );
+        replay_motion( i % 7, 0 );
+        pick_crosshair( 4.0f / 3.0f, TRUE );
+        if( i % KILL_INTERVAL == 0 ) {
+            target = rand() % spheres.count;
+            replay_kill( target );
+        }
+
+        sim_step( SIM_DT );
+        view_alias();
+        calculate_distances();
+        lod_update( FOCAL_PX );
+    }
+    elapsed = wall_time() - start;
+    steps = i;
+    replay_close();
+
+    printf( "steps: %d (%.1f s simulated)\n", steps, steps * SIM_DT );
+    printf( "spheres: %d score: %d threads: %d\n", spheres.count, score, jobs_workers() );
+    printf( "time: %.3f s, %.0f steps/s, %.0f sphere updates/s\n",
+            elapsed, steps / elapsed, (double) steps * spheres.count / elapsed );
+
+    sim_shutdown();
+    jobs_shutdown();
+
+    return 0;
+}
@@ -0,0 +1,199 @@
+// hudtext.c
+// Batched HUD text. See hudtext.h.
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "hudtext.h"
+#include "font.h"
+
+// glyphs are laid out ATLAS_COLUMNS to a row
+#define ATLAS_COLUMNS 16
+#define ATLAS_WIDTH 256
+#define ATLAS_HEIGHT 128
+
+struct HudVertex_t {
+    GLfloat x, y;
+    GLfloat u, v;
+    GLubyte color[4];
+};
+
+static struct HudVertex_t vertices[HUD_TEXT_MAX_GLYPHS * 6];
+static int vertex_count = 0;
+static GLubyte text_color[4] = { 255, 255, 255, 255 };
+
+static GLuint atlas = 0;
+static GLuint vbo = 0;
+
+//-----------------------------------------------------------------------------
+// Bakes the font into the atlas texture. Needs a current context.
+//-----------------------------------------------------------------------------
+int hud_text_init( void ) {
+    static GLubyte pixels[ATLAS_HEIGHT][ATLAS_WIDTH];
+    int glyph, row, col;
+
+    memset( pixels, 0, sizeof( pixels ) );
+    for( glyph = 0; glyph < FONT_GLYPHS; glyph++ ) {
+        int cell_x = ( glyph % ATLAS_COLUMNS ) * FONT_WIDTH;
+        int cell_y = ( glyph / ATLAS_COLUMNS ) * FONT_HEIGHT;
+
+        for( row = 0; row < FONT_HEIGHT; row++ ) {
+            for( col = 0; col < FONT_WIDTH; col++ ) {
+                if( font_9x15[glyph][row] & ( 1 << ( FONT_WIDTH - 1 - col ) ) )
+                    pixels[cell_y + row][cell_x + col] = 255;
+            }
+        }
+    }
+
+    glGenTextures( 1, &atlas );
+    glBindTexture( GL_TEXTURE_2D, atlas );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_ALPHA8, ATLAS_WIDTH, ATLAS_HEIGHT, 0,
+                  GL_ALPHA, GL_UNSIGNED_BYTE, pixels );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+
+    glGenBuffers( 1, &vbo );
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Sets the color for the strings printed after this
+//-----------------------------------------------------------------------------
+void hud_text_color( float r, float g, float b ) {
+    text_color[0] = (GLubyte) ( r * 255.0f );
+    text_color[1] = (GLubyte) ( g * 255.0f );
+    text_color[2] = (GLubyte) ( b * 255.0f );
+}
+
+//-----------------------------------------------------------------------------
+// Appends one vertex of a glyph quad
+//-----------------------------------------------------------------------------
+static void add_vertex( float x, float y, float u, float v ) {
+    struct HudVertex_t* vert = &vertices[vertex_count++];
+
+    vert->x = x;
+    vert->y = y;
+    vert->u = u;
+    vert->v = v;
+    memcpy( vert->color, text_color, sizeof( text_color ) );
+}
+
+//-----------------------------------------------------------------------------
+// Queues a formatted string for this frame's text batch. '\n' starts a new
+// line; characters the font doesn't have show as '?'.
+//-----------------------------------------------------------------------------
+void hud_printf( int x, int y, const char *format, ... ) {
+    char text[HUD_TEXT_MAX_STRING];
+    float pen_x = x, top = y - FONT_ASCENT;
+    const char *c;
+    va_list ap;
+
+    va_start( ap, format );
+    vsnprintf( text, sizeof( text ), format, ap );
+    va_end( ap );
+
+    for( c = text; *c != '\0'; c++ ) {
+        int glyph = (unsigned char) *c - FONT_FIRST;
+        float u0, v0, u1, v1;
+
+        if( *c == '\n' ) {
+            pen_x = x;
+            top += FONT_HEIGHT;
+            continue;
+        }
+        if( glyph < 0 || glyph >= FONT_GLYPHS )
+            glyph = '?' - FONT_FIRST;
+        if( glyph == 0 ) {
+            pen_x += FONT_WIDTH;
+            continue;
+        }
+        if( vertex_count + 6 > HUD_TEXT_MAX_GLYPHS * 6 )
+            return;
+
+        u0 = (float) ( glyph % ATLAS_COLUMNS ) * FONT_WIDTH / ATLAS_WIDTH;
+        v0 = (float) ( glyph / ATLAS_COLUMNS ) * FONT_HEIGHT / ATLAS_HEIGHT;
+        u1 = u0 + (float) FONT_WIDTH / ATLAS_WIDTH;
+        v1 = v0 + (float) FONT_HEIGHT / ATLAS_HEIGHT;
+
+        add_vertex( pen_x, top, u0, v0 );
+        add_vertex( pen_x, top + FONT_HEIGHT, u0, v1 );
+        add_vertex( pen_x + FONT_WIDTH, top + FONT_HEIGHT, u1, v1 );
+        add_vertex( pen_x, top, u0, v0 );
+        add_vertex( pen_x + FONT_WIDTH, top + FONT_HEIGHT, u1, v1 );
+        add_vertex( pen_x + FONT_WIDTH, top, u1, v0 );
+        pen_x += FONT_WIDTH;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Draws everything printed since the last call in one go and empties the
+// batch
+//-----------------------------------------------------------------------------
+void hud_text_draw( void ) {
+    GLsizei stride = sizeof( struct HudVertex_t );
+    GLint viewport[4];
+
+    if( vertex_count == 0 )
+        return;
+
+    // Window pixels, origin top left
+    glGetIntegerv( GL_VIEWPORT, viewport );
+    glMatrixMode( GL_PROJECTION );
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho( viewport[0], viewport[0] + viewport[2],
+             viewport[1] + viewport[3], viewport[1], -1, 1 );
+    glMatrixMode( GL_MODELVIEW );
+    glPushMatrix();
+    glLoadIdentity();
+
+    glPushAttrib( GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT );
+    glDisable( GL_DEPTH_TEST );
+    glDisable( GL_LIGHTING );
+    glDisable( GL_CULL_FACE );
+    glEnable( GL_BLEND );
+    glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+    glEnable( GL_TEXTURE_2D );
+    glBindTexture( GL_TEXTURE_2D, atlas );
+    glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+
+    // Orphan last frame's storage rather than wait on it
+    glBindBuffer( GL_ARRAY_BUFFER, vbo );
+    glBufferData( GL_ARRAY_BUFFER, stride * vertex_count, vertices, GL_STREAM_DRAW );
+
+    glPushClientAttrib( GL_CLIENT_VERTEX_ARRAY_BIT );
+    glEnableClientState( GL_VERTEX_ARRAY );
+    glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+    glEnableClientState( GL_COLOR_ARRAY );
+    glVertexPointer( 2, GL_FLOAT, stride, (const GLvoid*) 0 );
+    glTexCoordPointer( 2, GL_FLOAT, stride, (const GLvoid*) ( 2 * sizeof( GLfloat ) ) );
+    glColorPointer( 4, GL_UNSIGNED_BYTE, stride, (const GLvoid*) ( 4 * sizeof( GLfloat ) ) );
+
+    glDrawArrays( GL_TRIANGLES, 0, vertex_count );
+
+    glPopClientAttrib();
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glPopAttrib();
+
+    glMatrixMode( GL_PROJECTION );
+    glPopMatrix();
+    glMatrixMode( GL_MODELVIEW );
+    glPopMatrix();
+
+    vertex_count = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Frees the atlas and the vertex buffer
+//-----------------------------------------------------------------------------
+void hud_text_shutdown( void ) {
+    glDeleteTextures( 1, &atlas );
+    glDeleteBuffers( 1, &vbo );
+    atlas = vbo = 0;
+}
@@ -0,0 +1,22 @@
+// hudtext.h
+// Batched HUD text. The built in font (font.h) is baked into one alpha
+// texture at startup. Strings printed during a frame are turned into quads
+// in a fixed size vertex array, and hud_text_draw() puts all of them on
+// screen with a single draw call. Printing never allocates; text past
+// HUD_TEXT_MAX_GLYPHS glyphs in a frame is dropped.
+//
+// Positions are window pixels from the top left corner, y on the baseline,
+// the same as the old glPrintf().
+#ifndef HUDTEXT_H
+#define HUDTEXT_H
+
+#define HUD_TEXT_MAX_GLYPHS 4096
+#define HUD_TEXT_MAX_STRING 256     // longest single formatted string
+
+int hud_text_init( void );
+void hud_text_color( float r, float g, float b );
+void hud_printf( int x, int y, const char *format, ... );
+void hud_text_draw( void );
+void hud_text_shutdown( void );
+
+#endif
@@ -0,0 +1,269 @@
+// jobs.c
+// Work-stealing job system. See jobs.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "jobs.h"
+
+// One parallel for in flight
+struct JobGroup_t {
+    JobFunc_t func;
+    void *arg;
+    int grain;
+    int remaining;              // items not finished yet, atomic
+};
+
+struct Job_t {
+    struct JobGroup_t *group;
+    int begin, end;
+};
+
+// The owner pushes and pops at the bottom, thieves take from the top. A
+// lock per deque keeps it simple; jobs are coarse enough that it never
+// shows up next to the work itself.
+struct Deque_t {
+    pthread_mutex_t lock;
+    struct Job_t jobs[JOBS_DEQUE_SIZE];
+    int top, bottom;
+};
+
+// Workers come first, then threads that attached to start parallel fors
+static struct Deque_t deques[JOBS_MAX_WORKERS + JOBS_MAX_CALLERS];
+static pthread_t threads[JOBS_MAX_WORKERS];
+static int worker_count = 1;
+static int deque_count = 1;             // atomic
+
+// this thread's deque
+static __thread int self = 0;
+
+// Workers sleep on wake while no parallel for is running
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static int active = 0;
+static int quit = 0;
+
+//-----------------------------------------------------------------------------
+// Deque operations. Return FALSE (0) when full or empty.
+//-----------------------------------------------------------------------------
+static int deque_push( struct Deque_t* d, const struct Job_t* job ) {
+    int ok = 0;
+
+    pthread_mutex_lock( &d->lock );
+    if( d->bottom - d->top < JOBS_DEQUE_SIZE ) {
+        d->jobs[d->bottom & ( JOBS_DEQUE_SIZE - 1 )] = *job;
+        d->bottom++;
+        ok = 1;
+    }
+    pthread_mutex_unlock( &d->lock );
+    return ok;
+}
+
+static int deque_pop( struct Deque_t* d, struct Job_t* job ) {
+    int ok = 0;
+
+    pthread_mutex_lock( &d->lock );
+    if( d->bottom > d->top ) {
+        d->bottom--;
+        *job = d->jobs[d->bottom & ( JOBS_DEQUE_SIZE - 1 )];
+        ok = 1;
+    }
+    pthread_mutex_unlock( &d->lock );
+    return ok;
+}
+
+static int deque_steal( struct Deque_t* d, struct Job_t* job ) {
+    int ok = 0;
+
+    pthread_mutex_lock( &d->lock );
+    if( d->bottom > d->top ) {
+        *job = d->jobs[d->top & ( JOBS_DEQUE_SIZE - 1 )];
+        d->top++;
+        ok = 1;
+    }
+    pthread_mutex_unlock( &d->lock );
+    return ok;
+}
+
+//-----------------------------------------------------------------------------
+// Runs a job, first splitting off back halves for others to steal until
+// what's left is no bigger than the grain
+//-----------------------------------------------------------------------------
+static void job_run( struct Job_t job, int worker ) {
+    struct JobGroup_t *group = job.group;
+
+    while( job.end - job.begin > group->grain ) {
+        struct Job_t back = job;
+        int chunks = ( job.end - job.begin + group->grain - 1 ) / group->grain;
+
+        back.begin = job.begin + chunks / 2 * group->grain;
+        if( !deque_push( &deques[worker], &back ) )
+            break;
+        job.end = back.begin;
+    }
+
+    group->func( group->arg, job.begin, job.end, worker );
+    __atomic_sub_fetch( &group->remaining, job.end - job.begin, __ATOMIC_ACQ_REL );
+}
+
+//-----------------------------------------------------------------------------
+// Finds a job: our own newest first, then the oldest of someone else's,
+// starting from a random victim. Returns FALSE (0) if there's none.
+//-----------------------------------------------------------------------------
+static int job_find( int worker, unsigned int* seed, struct Job_t* job ) {
+    int i, victim, victims;
+
+    if( deque_pop( &deques[worker], job ) )
+        return 1;
+
+    // xorshift; rand() would disturb the game's random sequence
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    victims = __atomic_load_n( &deque_count, __ATOMIC_ACQUIRE );
+    victim = *seed % victims;
+    for( i = 0; i < victims; i++, victim = ( victim + 1 ) % victims ) {
+        if( victim != worker && deque_steal( &deques[victim], job ) )
+            return 1;
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Worker thread: steals while a parallel for is running, sleeps otherwise
+//-----------------------------------------------------------------------------
+static void* worker_main( void* arg ) {
+    int worker = (int) (long) arg;
+    unsigned int seed = 2463534242u + worker;
+    struct Job_t job;
+
+    for( ;; ) {
+        if( job_find( worker, &seed, &job ) ) {
+            job_run( job, worker );
+            continue;
+        }
+
+        pthread_mutex_lock( &lock );
+        while( active == 0 && !quit )
+            pthread_cond_wait( &wake, &lock );
+        pthread_mutex_unlock( &lock );
+        if( quit )
+            break;
+        sched_yield();
+    }
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Starts threads - 1 workers to go with the calling thread. threads <= 1
+// runs every loop inline.
+//-----------------------------------------------------------------------------
+void jobs_init( int threads_wanted ) {
+    int i;
+
+    if( threads_wanted > JOBS_MAX_WORKERS )
+        threads_wanted = JOBS_MAX_WORKERS;
+    if( threads_wanted < 1 )
+        threads_wanted = 1;
+
+    for( i = 0; i < JOBS_MAX_WORKERS + JOBS_MAX_CALLERS; i++ ) {
+        pthread_mutex_init( &deques[i].lock, NULL );
+        deques[i].top = deques[i].bottom = 0;
+    }
+
+    quit = 0;
+    worker_count = 1;
+    self = 0;
+    for( i = 1; i < threads_wanted; i++ ) {
+        if( pthread_create( &threads[i], NULL, worker_main, (void*) (long) i ) != 0 ) {
+            printf( "tron: could only start %d job threads\n", i );
+            break;
+        }
+        worker_count++;
+    }
+    deque_count = worker_count;
+}
+
+//-----------------------------------------------------------------------------
+// Gives the calling thread a deque so it can start parallel fors. Call once
+// per thread, after jobs_init().
+//-----------------------------------------------------------------------------
+void jobs_attach( void ) {
+    int slot = __atomic_fetch_add( &deque_count, 1, __ATOMIC_ACQ_REL );
+
+    if( slot >= JOBS_MAX_WORKERS + JOBS_MAX_CALLERS ) {
+        printf( "tron: too many threads using jobs\n" );
+        exit( 1 );
+    }
+    self = slot;
+}
+
+//-----------------------------------------------------------------------------
+// Number of threads running jobs, the caller included
+//-----------------------------------------------------------------------------
+int jobs_workers( void ) {
+    return worker_count;
+}
+
+//-----------------------------------------------------------------------------
+// Calls func over [0, count) split into pieces of about grain items, spread
+// over the workers, and waits for all of them
+//-----------------------------------------------------------------------------
+void jobs_parallel_for( int count, int grain, JobFunc_t func, void* arg ) {
+    struct JobGroup_t group;
+    struct Job_t job;
+    unsigned int seed = 2463534242u + self;
+
+    if( count <= 0 )
+        return;
+    if( grain < 1 )
+        grain = 1;
+    if( worker_count == 1 || count <= grain ) {
+        func( arg, 0, count, self );
+        return;
+    }
+
+    group.func = func;
+    group.arg = arg;
+    group.grain = grain;
+    group.remaining = count;
+
+    job.group = &group;
+    job.begin = 0;
+    job.end = count;
+    deque_push( &deques[self], &job );
+
+    pthread_mutex_lock( &lock );
+    active++;
+    pthread_cond_broadcast( &wake );
+    pthread_mutex_unlock( &lock );
+
+    // Help out until the last piece is done, wherever it ran
+    while( __atomic_load_n( &group.remaining, __ATOMIC_ACQUIRE ) > 0 ) {
+        if( job_find( self, &seed, &job ) )
+            job_run( job, self );
+        else
+            sched_yield();
+    }
+
+    pthread_mutex_lock( &lock );
+    active--;
+    pthread_mutex_unlock( &lock );
+}
+
+//-----------------------------------------------------------------------------
+// Stops and joins the workers
+//-----------------------------------------------------------------------------
+void jobs_shutdown( void ) {
+    int i;
+
+    pthread_mutex_lock( &lock );
+    quit = 1;
+    pthread_cond_broadcast( &wake );
+    pthread_mutex_unlock( &lock );
+
+    for( i = 1; i < worker_count; i++ )
+        pthread_join( threads[i], NULL );
+    worker_count = 1;
+}
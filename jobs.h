@@ -0,0 +1,42 @@
+// jobs.h
+// A small work-stealing job system for data parallel loops over the sphere
+// arrays.
+//
+// jobs_init() starts a pool of worker threads, each with its own deque of
+// jobs; the thread calling jobs_parallel_for() takes part as worker 0. A
+// parallel for starts as one job covering the whole range. Whoever runs a
+// job bigger than the grain splits it in half, pushes the back half onto
+// the bottom of their own deque and carries on with the front half, so
+// work spreads out as a tree. Idle workers steal from the top of other
+// workers' deques, which is where the biggest pieces are.
+//
+// Job functions get a [begin, end) range and the index of the deque of the
+// thread running them (below JOBS_MAX_WORKERS + JOBS_MAX_CALLERS), for
+// indexing per thread scratch.
+// Ranges start on a multiple of the grain, so a grain that's a multiple
+// of SPHERE_BATCH keeps SIMD kernels on aligned, whole batches.
+//
+// jobs_parallel_for() returns once the whole range is done. The thread
+// that called jobs_init() can start them straight away, other threads
+// after calling jobs_attach() once to get a deque of their own. Jobs must
+// not start parallel fors themselves.
+#ifndef JOBS_H
+#define JOBS_H
+
+#define JOBS_MAX_WORKERS 64
+#define JOBS_MAX_CALLERS 4          // threads besides the first starting parallel fors
+#define JOBS_DEQUE_SIZE 256         // jobs a worker can have queued, power of 2
+
+// Default grain for loops over spheres: big enough to amortise a steal,
+// small enough to balance a few hundred thousand spheres over 16 cores
+#define JOBS_SPHERE_GRAIN 4096
+
+typedef void (*JobFunc_t)( void* arg, int begin, int end, int worker );
+
+void jobs_init( int threads );
+void jobs_attach( void );
+int jobs_workers( void );
+void jobs_parallel_for( int count, int grain, JobFunc_t func, void* arg );
+void jobs_shutdown( void );
+
+#endif
@@ -7,13 +7,39 @@
 // ADDED REFLECTIONS, SHADOWS, TEXTURE MAPS, MENU, FULLSCREEN GAME //MODE
 #include <GL/glut.h>
 #include <GL/glext.h>
+#include <GL/glx.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <math.h>
 #include <sys/time.h>
-#include <stdarg.h>
+
+#include "sim.h"
+#include "matrix.h"
+#include "pick.h"
+#include "options.h"
+#include "spheremesh.h"
+#include "sphereinst.h"
+#include "lod.h"
+#include "cull.h"
+#include "frametime.h"
+#include "passtime.h"
+#include "pacing.h"
+#include "hudtext.h"
+#include "bikemodel.h"
+#include "offscreen.h"
+#include "capture.h"
+#include "replay.h"
+#include "jobs.h"
+#include "view.h"
+#include "simthread.h"
+#include "glstate.h"
+#include "renderqueue.h"
+#include "shadowmap.h"
+#include "reflection.h"
+#include "floor.h"
+#include "pipeline.h"
 
 // Some <math.h> files do not define M_PI...
 #ifndef M_PI
@@ -24,63 +50,14 @@
 #define TRUE 1
 #define FALSE !TRUE
 #define MIN(a,b) ((a)>(b)?(b):(a))
-#define FSIZE 32
-#define WIDTH 600
-#define HEIGHT 800
-#define FRAME_RATE_SAMPLES 50
-
-// Number of spheres in the game
-#define sphere_count 20
-#define respawn_time 5000
-
-//-----------------------------------------------------------------------------
-// 3D vector
-//-----------------------------------------------------------------------------
-struct Vector3 {
-    float x, y, z;
-};
-
-//-----------------------------------------------------------------------------
-// Third Person Camera structure
-//-----------------------------------------------------------------------------
-struct ThirdPersonCamera_t {
-    struct Vector3 vecPos;
-    struct Vector3 vecRot;
-    float fRadius;          // Distance between the camera and the object.
-    float fLastX;
-    float fLastY;
-};
-
-//-----------------------------------------------------------------------------
-// Sphere structure
-//-----------------------------------------------------------------------------
-struct Sphere_t {
-    struct Vector3 position;    // Position in 3D space
-    int selected;               // Did OpenGL select this one?
-    int dead;                   // Is this sphere dead?
-    unsigned int death_time;    // How long has this sphere been dead?
-    // Respawn after X milliseconds
-    float distance;             // Distance between you and the sphere.
-    float size;                 // The size of the sphere. Decreases during
-    // death phase.
-};
-
+#define FOVY 40.0
+#define LIGHT_SPEED 1.8     // radians per second the light circles at
+#define BENCH_KILL_INTERVAL 30  // frames between shots in --bench
 
 //-----------------------------------------------------------------------------
 // Global variables
 //-----------------------------------------------------------------------------
 
-//spheres
-struct Sphere_t spheres[sphere_count];
-
-// our camera
-struct ThirdPersonCamera_t camera;
-
-// for selection of spheres
-GLuint select_buffer[sphere_count*4] = {0};
-GLint hits = 0;
-int score = 0;
-
 // angle
 static float lightAngle = 0.0, lightHeight = 20;
 int moving, startx, starty;
@@ -89,10 +66,6 @@ int lightMoving = 0, lightStartX, lightStartY;
 // width of player body
 static GLdouble bodyWidth = 3.0;
  
-//bike variables
-GLfloat bikeTireAngle = 0.0, bikeHandlAngle = 0.0, bikeAngle = 0.0;
-float bikex = 0.0, bikey = 0.0, bikez = 0.0;
- 
 //distance between camera and player
 float dist_cam_player;
  
@@ -103,12 +76,22 @@ float movement_angle;
 static GLfloat lightPosition[4];
 static GLfloat lightColor[] = {0.8, 1.0, 0.8, 1.0}; // green-tinted
  
-// for the player
-static GLfloat playerColor[] = {0.1, 1.0, 0.1, 1.0};
+// show the per pass timings, toggled with 'p'
+static int show_passes = 0;
+
+// state changes the cache saved last frame, for the overlay
+static int state_filtered = 0;
+ 
+// TRUE when drawing into the offscreen framebuffer instead of a window
+static int offscreen = 0;
  
 // for floor and shadow
 static GLfloat floorPlane[4];
 static GLfloat floorShadow[4][4];
+
+// the camera's projection, and its view as matrix.h works it out
+static float projection[16];
+static float camera_view[16];
  
  
 //enums for vector coordinates
@@ -141,39 +124,6 @@ static char *circles[] = {
     "................",
 };
 
-// timer function
-unsigned GetTickCount() {
-    struct timeval tv;
-    if(gettimeofday(&tv, NULL) != 0)
-        return 0;
- 
-    return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
-}
-
-// Frames per second (FPS) statistic variables and routine.
-
-
-int FrameCount=0;
-float FrameRate=0;
-
-static void getFPS(
-   void
-)
-{
-   static clock_t last=0;
-   clock_t now;
-   float delta;
-
-   if (++FrameCount >= FRAME_RATE_SAMPLES) {
-      now  = clock();
-      delta= (now - last) / (float) CLOCKS_PER_SEC;
-      last = now;
-
-      FrameRate = FRAME_RATE_SAMPLES / delta;
-      FrameCount = 0;
-   }
-}
-
  
 //-----------------------------------------------------------------------------
 // render floor texture
@@ -207,38 +157,32 @@ static void makeFloorTexture(void) {
     gluBuild2DMipmaps(GL_TEXTURE_2D, 3, 16, 16, GL_RGB, GL_UNSIGNED_BYTE, floorTexture);
 }
  
-// simple vertices for floor
+// simple vertices for floor, for the shadow plane
 static GLfloat floorVertices[4][3] = {
-    { -20.0, 0.0, 20.0 },
-    { 20.0, 0.0, 20.0 },
-    { 20.0, 0.0, -20.0 },
-    { -20.0, 0.0, -20.0 },
+    { -20.0, FLOOR_Y, 20.0 },
+    { 20.0, FLOOR_Y, 20.0 },
+    { 20.0, FLOOR_Y, -20.0 },
+    { -20.0, FLOOR_Y, -20.0 },
 };
  
 //-----------------------------------------------------------------------------
-// draw a texturedfloor
+// draw a texturedfloor, with the current color
 //-----------------------------------------------------------------------------
-static void drawFloor(float size, float y) {
-    glDisable(GL_LIGHTING);
+static void drawFloor(void) {
+    if( pipeline_core ) {
+        floor_core_draw( 0, FALSE );
+        return;
+    }
+
+    glstate_disable( GL_LIGHTING );
  
-    glEnable(GL_TEXTURE_2D);
+    glstate_enable( GL_TEXTURE_2D );
  
-    glTranslatef( 0.0f, y, 0.0f );
- 
-    glBegin(GL_QUADS);
-    glTexCoord2f( 0.0f, 0.0f );
-    glVertex3f( -size, y, -size );
-    glTexCoord2f( 0.0f, FSIZE );
-    glVertex3f( -size, y, +size );
-    glTexCoord2f( FSIZE, FSIZE );
-    glVertex3f( +size, y, +size );
-    glTexCoord2f( FSIZE, 0.0f );
-    glVertex3f( +size, y, -size );
-    glEnd();
+    floor_draw();
  
-    glDisable(GL_TEXTURE_2D);
+    glstate_disable( GL_TEXTURE_2D );
  
-    glEnable(GL_LIGHTING);
+    glstate_enable( GL_LIGHTING );
 }
  
  
@@ -346,168 +290,159 @@ void glDisable2D( void ) {
 }
  
 //-----------------------------------------------------------------------------
-//Prints a string of chars using GLUT's pre-defined char blitting API.
+// Draws a visible list's spheres with no highlights, bias levels coarser
+// than the main pass and lifted by offset_y
 //-----------------------------------------------------------------------------
-void glPrintf( int x, int y, void* font, char* string, ... ) {
-    char *c;
-    char temp[256];
-    va_list ap;
- 
-    va_start( ap, string );
-    vsprintf( temp, string, ap );
-    va_end( ap );
- 
-    glEnable2D();
- 
-    glRasterPos2i(x,y);
- 
-    for (c=temp; *c != '\0'; c++) {
-        glutBitmapCharacter(font, *c);
+static void sphere_list_draw( int list, int pass, float offset_y, int bias ) {
+    const struct RenderQueue_t* q = &render_queues[list];
+    struct SphereMesh_t *mesh, *bound = NULL;
+    int n, i;
+ 
+    if( sphere_instancing ) {
+        sphere_instances_draw( list, pass, offset_y, 1.0f, bias );
+        return;
     }
  
-    glDisable2D();
-}
- 
-//-----------------------------------------------------------------------------
-// Calculates the distance between two points.
-//-----------------------------------------------------------------------------
-float distance( const struct Vector3* v1, const struct Vector3* v2 ) {
-    float d = 0.0f;
-    float x = v2->x - v1->x;
-    float y = v2->y - v1->y;
-    float z = v2->z - v1->z;
- 
-    x *= x;
-    y *= y;
-    z *= z;
- 
-    // normalize vector
-    d = sqrt(x+y+z);
- 
-    return d;
-}
- 
+    // Front to back; there are no shells in these queues
+    for( n = 0; n < q->count; n++ ) {
+        i = q->items[n].sphere;
+        mesh = sphere_mesh_lod( lod_biased( view.spheres.lod[i], bias ) );
+        if( mesh != bound ) {
+            sphere_mesh_bind( mesh );
+            bound = mesh;
+        }
  
-//-----------------------------------------------------------------------------
-// Desc: Calulates the distance between each sphere and the camera.
-//-----------------------------------------------------------------------------
-void calculate_distances( void ) {
-    int i;
-    struct Vector3 neg_camera;
- 
-    // In order to accurately calculate the distance between the spheres and
-    // the camera, the x and z values should be converted to negatives, and
-    // the y coordinate should be ignored.  The camera updates the y value
-    // still, but in a 3rd person shooter/adventure style game, the is calc-
-    // lations are done seperately from the camera to compensate for jumping
-    // and gravity, etc.
-    neg_camera.x = camera.vecPos.x * -1.0f;
-    neg_camera.y = 0.0f;
-    neg_camera.z = camera.vecPos.z * -1.0f;
- 
-    for( i = 0; i < sphere_count; i++ ) {
-        spheres[i].distance = distance( &neg_camera, &spheres[i].position );
+        glPushMatrix();
+        glTranslatef( -view.spheres.x[i], view.spheres.y[i] + offset_y, -view.spheres.z[i] );
+        sphere_mesh_draw( mesh, view.spheres.size[i] );
+        glPopMatrix();
     }
+    sphere_mesh_unbind();
 }
  
- 
 //-----------------------------------------------------------------------------
-// Desc: Gives each sphere a random position in 3D space.
+// draws the spheres reflections. Also used for the planar shadows, in which
+// case pass is SPHERE_PASS_FLAT. Both get by with coarser meshes than the
+// spheres themselves.
 //-----------------------------------------------------------------------------
-void spheres_init( void ) {
-    int i;
- 
-    // Give each sphere a random position
-    for( i = 0; i < sphere_count; i++ ) {
-        spheres[i].position.x = (float) ( ( rand() % 100 ) + 1 ) - 50;
-        spheres[i].position.y = 2.0f;
-        spheres[i].position.z = (float) ( ( rand() % 100 ) + 1 ) - 50;
-        spheres[i].selected = 0;
-        spheres[i].dead = 0;
-        spheres[i].death_time = 0;
-        spheres[i].distance = 0.0f;
-        spheres[i].size = 2.0f;
-    }
+void sphere_reflection( int pass ) {
+    if( pass == SPHERE_PASS_FLAT )
+        sphere_list_draw( CULL_SHADOW, pass, 0.0f, LOD_SHADOW_BIAS );
+    else
+        sphere_list_draw( CULL_REFLECTION, pass, 0.0f, LOD_REFLECTION_BIAS );
 }
 
 //-----------------------------------------------------------------------------
-// draws the spheres reflections
+// Sets up for the translucent purple shells drawn around selected spheres
 //-----------------------------------------------------------------------------
-void sphere_reflection() {
-      int i;
-  
-    for( i = 0; i < sphere_count; i++ ) {
-            glPushMatrix();
-            glTranslatef( -spheres[i].position.x, spheres[i].position.y + 1.0f, -spheres[i].position.z );
-            glutSolidSphere( spheres[i].size, 20, 20 );
-            glPopMatrix();
-        }
+static void shell_state( void ) {
+    pipeline_color( 128 / 255.0f, 0.0f, 1.0f, 64 / 255.0f );
+    glstate_disable( GL_COLOR_MATERIAL );
+    glstate_disable( GL_LIGHTING );
+    glstate_disable( GL_TEXTURE_2D );
+    glstate_depth_mask( GL_FALSE );
+    glstate_enable( GL_BLEND );
+    glstate_blend_func( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
 }
- 
+
 //-----------------------------------------------------------------------------
-// Renders each sphere in it's random position
+// Renders each sphere in it's random position, then a slightly larger
+// purple transparent sphere around selected objects. Leaves lighting off
+// and blending on when there were shells; only the depth mask is put back.
 //-----------------------------------------------------------------------------
 void spheres_render() {
-    int i;
+    const struct RenderQueue_t* q = &render_queues[CULL_MAIN];
+    struct SphereMesh_t *mesh, *bound = NULL;
+    const struct RenderItem_t* item;
+    int n, i;
  
     // Render each sphere with a solid green colour
     //glColor3f( 0.0f, 1.0f, 0.0f );
- 
-    for( i = 0; i < sphere_count; i++ ) {
-        // Is this sphere dead?
-        if( spheres[i].dead ) {
-            unsigned int current_time;
- 
-            // Slowly decrease the size of the sphere when it's dying
-            if( spheres[i].size > 0.0f )
-                spheres[i].size -= 0.1f;
- 
-            // When time expires, bring the sphere back into play (respawn).
-            // The sphere will fall from the sky after the respawn time expires.
-            current_time = GetTickCount();
-            if( (current_time - spheres[i].death_time) > respawn_time ) {
-                spheres[i].position.y = 50.0f;
-                spheres[i].dead = 0;
-                spheres[i].size = 2.0f;
-            }
+    glstate_enable( GL_LIGHTING );
+    glstate_disable( GL_TEXTURE_2D );
+    glstate_disable( GL_BLEND );
+    glstate_depth_mask( GL_TRUE );
+ 
+    if( sphere_instancing ) {
+        sphere_instances_draw( CULL_MAIN, SPHERE_PASS_LIT, 0.0f, 1.0f, 0 );
+ 
+        // Highlight shells for every selected sphere in one go
+        if( q->count > q->first[RQ_SHELL] ) {
+            shell_state();
+            sphere_instances_draw( CULL_MAIN, SPHERE_PASS_SHELL, 0.0f, 1.5f, 0 );
+            glstate_depth_mask( GL_TRUE );
         }
+        return;
+    }
  
-        //if( !spheres[i].dead )
-        if( spheres[i].size != 0.0f ) {
-            glPushMatrix();
-            glTranslatef( -spheres[i].position.x, spheres[i].position.y, -spheres[i].position.z );
-            glutSolidSphere( spheres[i].size, 20, 20 );
- 
-            // Render a slightly larger purple transparent sphere around
-            // selected objects.
-            if( spheres[i].selected ) {
-                glPushAttrib( GL_ALL_ATTRIB_BITS );
- 
-                glColor4ub( 128, 0, 255, 64 );
- 
-                glDisable( GL_COLOR_MATERIAL );
-                glDisable( GL_LIGHTING );
-                // glDisable( GL_DEPTH_TEST );
-                glDepthMask( GL_FALSE );
-                glDisable( GL_TEXTURE_2D );
-                glEnable( GL_BLEND );
-                glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+    // Only what culling left; fully shrunk spheres are never in the list.
+    // Opaque spheres come first, grouped by mesh and front to back, then
+    // the shells back to front.
+    for( n = 0; n < q->count; n++ ) {
+        item = &q->items[n];
+        i = item->sphere;
+        if( n == q->first[RQ_SHELL] )
+            shell_state();
+
+        mesh = sphere_mesh_lod( view.spheres.lod[i] );
+        if( mesh != bound ) {
+            sphere_mesh_bind( mesh );
+            bound = mesh;
+        }
  
-                glutSolidSphere( spheres[i].size * 1.5f, 20, 20 );
+        glPushMatrix();
+        glTranslatef( -view.spheres.x[i], view.spheres.y[i], -view.spheres.z[i] );
+        if( RQ_KEY_GROUP( item->key ) == RQ_SHELL )
+            sphere_mesh_draw( mesh, view.spheres.size[i] * 1.5f );
+        else
+            sphere_mesh_draw( mesh, view.spheres.size[i] );
+        glPopMatrix();
+    }
+    sphere_mesh_unbind();
+    glstate_depth_mask( GL_TRUE );
+}
  
-                glPopAttrib();
-            }
  
-            glPopMatrix();
-        }
+//-----------------------------------------------------------------------------
+// Builds the visible sphere list of every pass. Expects the modelview the
+// spheres are drawn with to be current, or the shader pipeline's camera to
+// be set when it's on.
+//-----------------------------------------------------------------------------
+static void cull_passes( void ) {
+    float proj[16], modelview[16], pass[16], clip[16];
+ 
+    if( !options.cull ) {
+        cull_all( CULL_MAIN );
+        cull_all( CULL_REFLECTION );
+        cull_all( CULL_SHADOW );
+        return;
+    }
  
-        // If the sphere is in the sky, let it fall back down to the ground
-        if( spheres[i].position.y > 2.0f ) {
-            spheres[i].position.y -= 0.5f;
-        }
+    if( pipeline_core ) {
+        mat4_copy( proj, pipeline.camera.projection );
+        mat4_copy( modelview, pipeline.camera.view );
+    } else {
+        glGetFloatv( GL_PROJECTION_MATRIX, proj );
+        glGetFloatv( GL_MODELVIEW_MATRIX, modelview );
     }
-}
  
+    mat4_multiply( clip, proj, modelview );
+    cull_spheres( CULL_MAIN, clip, 0.0f );
+ 
+    // The reflection sees the spheres mirrored through the floor, so it
+    // needs its own mirrored frustum
+    mat4_copy( pass, modelview );
+    mat4_translate( pass, 0.0f, 2.0f * FLOOR_Y, 0.0f );
+    mat4_scale( pass, 1.0f, -1.0f, 1.0f );
+    mat4_multiply( clip, proj, pass );
+    cull_spheres( CULL_REFLECTION, clip, 0.0f );
+ 
+    // Shadows: test where the light throws each sphere onto the floor, so
+    // casters off screen still count if their shadow is on screen
+    mat4_multiply( pass, modelview, (float*) floorShadow );
+    mat4_multiply( clip, proj, pass );
+    cull_spheres( CULL_SHADOW, clip, 0.0f );
+}
  
 //-----------------------------------------------------------------------------
 // Draws an aiming crosshair
@@ -539,174 +474,49 @@ void draw_crosshair( void ) {
 // Show the players stats
 //-----------------------------------------------------------------------------
 void show_player_stats( void ) {
-    char string[128];
-    char buf[128];
-    sprintf(buf,"FPS: %f F: %2d", FrameRate, FrameCount);
-    sprintf( string, "Player pos:<%f,%f,%f> score: <%d>", camera.vecPos.x, camera.vecPos.y, camera.vecPos.z, score );
-    glPrintf( 30, 30, GLUT_BITMAP_9_BY_15, string );
-    glPrintf( 30, 530, GLUT_BITMAP_9_BY_15, buf );
+    const struct FrameStats_t* ft = frametime_recent();
+
+    hud_printf( 30, 30, "Player pos:<%f,%f,%f> score: <%d>",
+                view.camera.vecPos.x, view.camera.vecPos.y, view.camera.vecPos.z, view.score );
+    hud_printf( 30, 530, "FPS: %.1f  ms p50 %.1f p95 %.1f p99 %.1f max %.1f  hitches: %d",
+                ft->avg_ms > 0.0 ? 1000.0 / ft->avg_ms : 0.0,
+                ft->p50_ms, ft->p95_ms, ft->p99_ms, ft->max_ms, ft->hitches );
 }
   
 //-----------------------------------------------------------------------------
-// Marks selected object as dead.
+// Shows the average CPU and GPU time of each render pass
 //-----------------------------------------------------------------------------
-void kill_selected_object( void ) {
-    int i = 0;
-    char string[64];
+void show_pass_times( void ) {
+    double cpu_ms, gpu_ms;
+    int pass, gpu;
 
-    // kill all spheres that are selected
-    for( i = 0; i < sphere_count; i++ ) {      
-          // the sphere was selected kill it
-          if(spheres[i].selected) {
-            score += 100;
-            spheres[i].dead = 1;
-            spheres[i].death_time = GetTickCount();
-           }
-        }
+    hud_printf( 30, 60, "pass           cpu ms  gpu ms  (%d gpu frames dropped)",
+                passtime_dropped() );
+    for( pass = 0; pass < PASS_COUNT; pass++ ) {
+        gpu = passtime_average( pass, &cpu_ms, &gpu_ms );
+        if( gpu )
+            hud_printf( 30, 78 + pass * 18, "%-14s %6.2f  %6.2f",
+                        passtime_names[pass], cpu_ms, gpu_ms );
+        else
+            hud_printf( 30, 78 + pass * 18, "%-14s %6.2f       -",
+                        passtime_names[pass], cpu_ms );
+    }
+    hud_printf( 30, 78 + PASS_COUNT * 18,
+                "%s  state changes filtered: %d  sort: %s  reflection: %s  floor tiles: %d/%d",
+                pipeline_core ? "core" : "legacy",
+                state_filtered, render_queues[CULL_MAIN].radix ? "radix" : "insertion",
+                !reflection_texturing ? "direct" : reflection.reused ? "reused" : "drawn",
+                floor_mesh.visible, floor_mesh.tiles * floor_mesh.tiles );
 }
-
+ 
 //-----------------------------------------------------------------------------
-// Uses OpenGL's slection buffer to select objects in viewport
+// Selects the sphere under the crosshair by casting a ray on the CPU
 //-----------------------------------------------------------------------------
-void do_selection( int select_x, int select_y, int preselect ) {
-    GLint iViewport[4];
+void do_selection( int preselect ) {
     float fViewport[4];
-    int i;
- 
-    // Set the selection buffer and specify it's size
-    glSelectBuffer( sphere_count*4, select_buffer );
- 
-    // Get a copy of the current viewport
-    glGetIntegerv( GL_VIEWPORT, iViewport );
-    glGetFloatv( GL_VIEWPORT, fViewport );
- 
-    // Switch into selection mode
-    glRenderMode( GL_SELECT );
- 
-    // Clear the name stack
-    glInitNames();
-    // Give the stack at least one name or else it will generate an error
-    glPushName(0);
- 
-    // Save the projection matrix
-    glMatrixMode( GL_PROJECTION );
-    glPushMatrix();
-    glLoadIdentity();
- 
-    // Restrict the rendering area to the given point using gluPickMatrix
-    gluPickMatrix( select_x, select_y, 1.0f, 1.0f, iViewport );
-    gluPerspective( 45.0f, (GLdouble) fViewport[2]/fViewport[3], 0.1f, 500.0f );
- 
-    // Now render selectable objects to the screen
-    glMatrixMode( GL_MODELVIEW );
 
-    for( i = 0; i < sphere_count; i++ ) {
-        //  if( !spheres[i].dead )
-        if( spheres[i].size != 0.0f ) {
-            glPushMatrix();
-            glLoadName(i);
-            glTranslatef( -spheres[i].position.x, spheres[i].position.y, -spheres[i].position.z );
-            glutSolidSphere( spheres[i].size, 20, 20 );
-            glPopMatrix();
-        }
-    }
-
-    // Restore the projection matrix
-    glMatrixMode( GL_PROJECTION );
-    glPopMatrix();
- 
-    // Get the number of hits (the number of objects drawn within that
-    // specified area) and return to render mode
-    hits = glRenderMode( GL_RENDER );
-
-    // Don't do anything except mark objects as selected in preselect mode
-    if( preselect ) {
-        // Go through the list of objects and deselect them all
-        for( i = 0; i < sphere_count; i++ ) {
-           spheres[i].selected = 0;
-        }
- 
-        // Now mark all selected objects
-        for( i = 0; i < hits; i++ ) {
-            GLubyte name = select_buffer[i*4+3];
-            spheres[name].selected = 1;
-        }
-    } else {
-        kill_selected_object();
-    }
- 
-    // Return to the modelview matrix
-    glMatrixMode( GL_MODELVIEW );
-}
- 
- 
-//-----------------------------------------------------------------------------
-// Draws the lightcycle bike
-//----------------------------------------------------------------------------- 
-static void drawbike(void) {
-    float bikeMaterialAmbient0[] = {0.0, 0.0, 0.0, 1.0};
-    float bikeMaterialDiffuse0[] = {0.0, 0.2, 0.0, 1.0};
-    float bikeMaterialSpecular0[] = {0.0, 0.8, 0.0, 1.0 };
-    float bikeMaterialShininess0[] = {100.0};
-    float bikeMaterialEmission0[] = {0.0, 0.02, 0.0, 1.0};
- 
-    // scale our model
-    glScalef(2.0F, 2.0F, 2.0F);
- 
-    glMaterialfv(GL_FRONT, GL_AMBIENT, bikeMaterialAmbient0);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, bikeMaterialDiffuse0);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, bikeMaterialSpecular0);
-    glMaterialfv(GL_FRONT, GL_SHININESS, bikeMaterialShininess0);
-    glMaterialfv(GL_FRONT, GL_EMISSION, bikeMaterialEmission0);
-    //Draws a bike
-    glPushMatrix();
-    glTranslatef(bikex,bikey,bikez-1.8);
-    glRotatef(bikeAngle, 0.0,1.0,0.0);
-    glPushMatrix();
-    glTranslatef(bikex,bikey,bikez);
-    glScalef(1.0, 1.0, 3.0);
-    glRotatef(180.0, 0.0, 0.0, 1.0);
-    glutSolidSphere(0.5, 5.0, 20.0);
-    glPopMatrix();
-    glPushMatrix();
-    glTranslatef(bikex,bikey-0.3,bikez+1.2);
-    glScalef(2.4, 1.0, 1.0);
-    glRotatef(90.0, 0.0, 1.0, 0.0);
-    glRotatef(bikeTireAngle, 0.0, 0.0, 1.0);
-    glutSolidTorus(0.25, 0.25, 10.0, 10.0);
-    glPushMatrix();
-    glDisable(GL_LIGHTING);
-    glColor3f(0.0, 0.0, 0.0);
-    glutWireTorus(0.25, 0.25, 10.0, 10.0);
-    glEnable(GL_LIGHTING);
-    glPopMatrix();
-    glPopMatrix();
-    glPushMatrix();
-    glTranslatef(bikex,bikey-0.3,bikez-1.2);
-    glScalef(2.4, 1.0, 1.0);
-    glRotatef(90.0, 0.0, 1.0, 0.0);
-    glRotatef(bikeTireAngle, 0.0, 0.0, 1.0);
-    glutSolidTorus(0.25, 0.25, 10.0, 10.0);
-    glPushMatrix();
-    glDisable(GL_LIGHTING);
-    glColor3f(0.0, 0.0, 0.0);
-    glutWireTorus(0.25, 0.25, 10.0, 10.0);
-    glEnable(GL_LIGHTING);
-    glPopMatrix();
-    glPopMatrix();
-    glPushMatrix();
-    glTranslatef(bikex,bikey+0.4,bikez-0.8);
-    if(bikeHandlAngle < 0) {
-        glRotatef(40.0, 0.0, 1.0, 0.0);
-    } else if(bikeHandlAngle > 0) {
-        glRotatef(-40.0, 0.0, 1.0, 0.0);
-    }
-    glScalef(1.2, 0.1, 0.1);
-    glutSolidCube(1.0);
-    glPopMatrix();
- 
-    glPopMatrix();
- 
+    glGetFloatv( GL_VIEWPORT, fViewport );
+    pick_crosshair( fViewport[2]/fViewport[3], preselect );
 }
  
  
@@ -720,11 +530,8 @@ static void drawplayer(void) {
     // Translate the player position
     glTranslatef(-8, 1.5, -bodyWidth / 2);
  
-    //setup player color material
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, playerColor);
- 
     // draw player model
-    drawbike();
+    bike_model_draw( view.bikeAngle, view.bikeTireAngle, view.bikeHandlAngle );
  
     glPopMatrix();
 }
@@ -735,6 +542,16 @@ static void drawplayer(void) {
 static void render(void) {
     int start, end;
     int iViewport[4];
+    float mirror[16];
+    struct SphereMesh_t* marker;
+
+    // Everything below draws the latest snapshot, blended to now
+    view_update( frametime_now() );
+
+    // The HUD and anything else outside the cache may have changed state
+    // since last frame
+    state_filtered = glstate_filtered();
+    glstate_reset();
  
     // Clear; default stencil clears to zero.
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
@@ -749,138 +566,251 @@ static void render(void) {
  
     glPushMatrix();
     // Position the camera behind our character and render it
-    glTranslatef( 0.0f, -2.0f, -camera.fRadius );
-    glRotatef( camera.vecRot.x, 1.0f, 0.0f, 0.0f );
+    glTranslatef( 0.0f, -CAMERA_DROP, -view.camera.fRadius );
+    glRotatef( view.camera.vecRot.x, 1.0f, 0.0f, 0.0f );
  
     // draw bike here
-    glTranslatef( 8.0f, 0.0, 0.0);
+    glTranslatef( CAMERA_PLAYER_X, 0.0, 0.0);
+    passtime_begin( PASS_PLAYER );
     drawplayer();
+    passtime_end( PASS_PLAYER );
  
     // Rotate the camera as necessary
-    glRotatef( camera.vecRot.y, 0.0f, 1.0f, 0.0f );
-    glTranslatef( -camera.vecPos.x, 2.2f, -camera.vecPos.z );
- 
-    // Calculate distances
-    calculate_distances();
+    glRotatef( view.camera.vecRot.y, 0.0f, 1.0f, 0.0f );
+    glTranslatef( -view.camera.vecPos.x, CAMERA_LIFT, -view.camera.vecPos.z );
  
     // Do pre-selection
-    glGetIntegerv( GL_VIEWPORT, iViewport );
-    do_selection( iViewport[2]/2, iViewport[3]/2, TRUE );
+    passtime_begin( PASS_SELECTION );
+    do_selection( TRUE );
+    passtime_end( PASS_SELECTION );
  
-    // Tell GL new light source position.
-    glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
+    // Calculate distances and pick each sphere's level of detail from them
+    passtime_begin( PASS_PREPARE );
+    calculate_distances();
+    glGetIntegerv( GL_VIEWPORT, iViewport );
+    lod_update( iViewport[3] / ( 2.0 * tan( FOVY * M_PI / 360.0 ) ) );
+
+    // The shader pipeline takes the same camera, built on the CPU
+    if( pipeline_core ) {
+        camera_view_matrix( &view.camera, camera_view );
+        pipeline_model( NULL );
+        pipeline_camera( projection, camera_view, iViewport );
+        pipeline_light_position( lightPosition );
+    }
  
-    // Don't update color or depth.
-    glDisable(GL_DEPTH_TEST);
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    // Work out which spheres each pass can actually see, and the order
+    // to draw them in
+    cull_passes();
+
+    // With a shadow map the casters are whatever lies between the light
+    // and the receivers, rather than what the floor shadow shows
+    if( shadow_mapping ) {
+        shadow_map_fit( lightPosition );
+        if( options.cull )
+            cull_spheres( CULL_SHADOW, shadow_map.clip, 0.0f );
+    }
+    render_queue_build( CULL_MAIN, TRUE );
+    render_queue_build( CULL_REFLECTION, FALSE );
+    render_queue_build( CULL_SHADOW, FALSE );
  
-    // Draw 1 into the stencil buffer.
-    glEnable(GL_STENCIL_TEST);
-    glStencilOp(GL_REPLACE, GL_REPLACE, GL_REPLACE);
-    glStencilFunc(GL_ALWAYS, 1, 0xffffffff);
+    // Every sphere pass this frame draws from the same instance data
+    sphere_instances_update();
+    passtime_end( PASS_PREPARE );
+
+    // Shadow casters' depth, as the light sees them
+    if( shadow_mapping ) {
+        GLint map_viewport[4] = { 0, 0, shadow_map.size, shadow_map.size };
+
+        passtime_begin( PASS_SHADOW_MAP );
+        shadow_map_begin();
+        if( pipeline_core )
+            pipeline_camera( shadow_map.projection, shadow_map.view, map_viewport );
+        sphere_list_draw( CULL_SHADOW, SPHERE_PASS_DEPTH, 0.0f, LOD_SHADOW_BIAS );
+        if( pipeline_core )
+            pipeline_camera( projection, camera_view, iViewport );
+        shadow_map_end();
+        passtime_end( PASS_SHADOW_MAP );
+    }
  
-    // Now render floor; floor pixels just get their stencil set to 1.
-    drawFloor(50.0f, -0.75f);
-  
-    // Re-enable update of color and depth.
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-    glEnable(GL_DEPTH_TEST);
+    // Tell GL new light source position.
+    glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
  
-    // Now, only render where stencil is set to 1.
-    glStencilFunc(GL_EQUAL, 1, 0xffffffff);  // draw if ==1
-    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    // Without a reflection texture the reflection is drawn straight into
+    // the frame, and the stencil keeps it to where the floor is
+    if( !reflection_texturing ) {
+        // Don't update color or depth.
+        passtime_begin( PASS_STENCIL_FLOOR );
+        glstate_disable( GL_DEPTH_TEST );
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+ 
+        // Draw 1 into the stencil buffer.
+        glstate_enable( GL_STENCIL_TEST );
+        glStencilOp(GL_REPLACE, GL_REPLACE, GL_REPLACE);
+        glStencilFunc(GL_ALWAYS, 1, 0xffffffff);
+ 
+        // Now render floor; floor pixels just get their stencil set to 1.
+        drawFloor();
+ 
+        // Re-enable update of color and depth.
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glstate_enable( GL_DEPTH_TEST );
+        passtime_end( PASS_STENCIL_FLOOR );
+ 
+        // Now, only render where stencil is set to 1.
+        glStencilFunc(GL_EQUAL, 1, 0xffffffff);  // draw if ==1
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    }
  
+    passtime_begin( PASS_REFLECTION );
     glPushMatrix();
  
-    // move reflection beneath floor
-    glTranslatef(0.0, -1.3, 0.0);
-    // reflect the objects through the floor (y-plane)
-    glScalef(1.0, -1.0, 1.0);
- 
-    // reflect light position
-    glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
- 
-    // normalize light
-    glEnable(GL_NORMALIZE);
-    glCullFace(GL_FRONT);
+    // reflect the objects through the floor
+    mat4_identity( mirror );
+    mat4_translate( mirror, 0.0f, 2.0f * FLOOR_Y, 0.0f );
+    mat4_scale( mirror, 1.0f, -1.0f, 1.0f );
+    glMultMatrixf( mirror );
+    pipeline_model( mirror );
+ 
+    // With a reflection texture the mirrored spheres are only drawn again
+    // when something they show has changed
+    if( !reflection_texturing || reflection_begin( lightPosition ) ) {
+        // reflect light position; the pipeline's light goes through the
+        // mirror by itself
+        if( !pipeline_core ) {
+            glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
+ 
+            // normalize light
+            glstate_enable( GL_NORMALIZE );
+        }
+        glCullFace(GL_FRONT);
  
-    // Draw the reflected objects.
-    // Render spheres reflections
-    sphere_reflection();
+        // Draw the reflected objects.
+        // Render spheres reflections
+        sphere_reflection( SPHERE_PASS_LIT );
  
-    // Disable noramlize again and re-enable back face culling.
-    glDisable(GL_NORMALIZE);
-    glCullFace(GL_BACK);
+        // Disable noramlize again and re-enable back face culling.
+        glstate_disable( GL_NORMALIZE );
+        glCullFace(GL_BACK);
+
+        if( reflection_texturing )
+            reflection_end();
+    }
  
     glPopMatrix();
+    pipeline_model( NULL );
  
     // Switch back to the unreflected light position.
-    glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
- 
- 
-    // disable stenciling
-    glDisable(GL_STENCIL_TEST);
- 
-    // Draw "bottom" of floor in blue.
-    glFrontFace(GL_CW);  // Switch face orientation.
-    glColor4f(0.1, 0.1, 0.7, 1.0);
-    drawFloor(50.0f, -0.75f);
-    glFrontFace(GL_CCW);
+    if( !pipeline_core )
+        glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
+    passtime_end( PASS_REFLECTION );
+ 
+    passtime_begin( PASS_FLOOR );
+ 
+    // Draw "bottom" of floor in blue, when the eye is under it to see it.
+    if( floor_eye_below() ) {
+        glstate_disable( GL_STENCIL_TEST );
+        glFrontFace(GL_CW);  // Switch face orientation.
+        pipeline_color(0.1, 0.1, 0.7, 1.0);
+        drawFloor();
+        glFrontFace(GL_CCW);
+    }
  
-    glEnable(GL_STENCIL_TEST);
+    // The top's pixels get 3, for the planar shadows
+    glstate_enable( GL_STENCIL_TEST );
     glStencilFunc(GL_ALWAYS, 3, 0xffffffff);
     glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
  
-    // Draw "top" of floor.  Use blending to blend in reflection.
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glColor4f(0.7, 0.0, 0.0, 0.3);
-    glColor4f(1.0, 1.0, 1.0, 0.3);
-    drawFloor(50.0f, -0.75f);
-    glDisable(GL_BLEND);
+    // Draw "top" of floor, with the reflection showing through as much as
+    // the alpha lets it: mixed in on the second texture unit when it's in a
+    // texture, blended over it otherwise. The pipeline's floor does either
+    // in its shader, and takes the shadow map's shadows in the same pass.
+    pipeline_color(1.0, 1.0, 1.0, 0.3);
+    if( pipeline_core ) {
+        if( !reflection_texturing ) {
+            glstate_enable( GL_BLEND );
+            glstate_blend_func( GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+        }
+        floor_core_draw( reflection_texturing ? reflection.texture : 0, shadow_mapping );
+        glstate_disable( GL_BLEND );
+    } else if( reflection_texturing ) {
+        reflection_blend_begin( 1 );
+        drawFloor();
+        reflection_blend_end( 1 );
+    } else {
+        glstate_enable( GL_BLEND );
+        glstate_blend_func( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+        drawFloor();
+        glstate_disable( GL_BLEND );
+    }
+    passtime_end( PASS_FLOOR );
  
     // Draw "actual" objects not their reflection
     // Render spheres
+    passtime_begin( PASS_SPHERES );
     spheres_render();
+    passtime_end( PASS_SPHERES );
+ 
+    passtime_begin( PASS_SHADOWS );
+    if( shadow_mapping && pipeline_core ) {
+        // The floor took its shadows as it was drawn
+        glstate_disable( GL_STENCIL_TEST );
+    } else if( shadow_mapping ) {
+        // The floor's top once more, darkened where the map has it in
+        // shadow. These are the tiles the top was drawn with, so they pass
+        // the depth test exactly where the top showed. The spheres took
+        // their shadows as they were drawn.
+        glstate_disable( GL_STENCIL_TEST );
+        shadow_map_receive_begin();
+        floor_draw();
+        shadow_map_receive_end();
+    } else {
+        glStencilFunc(GL_LESS, 2, 0xffffffff);  // draw if ==3
+        glStencilOp(GL_REPLACE, GL_REPLACE, GL_REPLACE);
  
-    glStencilFunc(GL_LESS, 2, 0xffffffff);  // draw if ==1
-    glStencilOp(GL_REPLACE, GL_REPLACE, GL_REPLACE);
- 
-    // one of these will work
-    // glEnable(GL_POLYGON_OFFSET_EXT);
-    glEnable(GL_POLYGON_OFFSET_FILL);
+        // The shadows lie right on the floor, so pull them toward the eye
+        glstate_enable( GL_POLYGON_OFFSET_FILL );
+        glPolygonOffset( -1.0f, -2.0f );
  
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDisable(GL_LIGHTING);  // Force the 50% black.
-    glColor4f(0.0, 0.0, 0.0, 0.5);
+        glstate_enable( GL_BLEND );
+        glstate_blend_func( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+        glstate_disable( GL_LIGHTING );  // Force the 50% black.
+        pipeline_color(0.0, 0.0, 0.0, 0.5);
  
-    glPushMatrix();
+        glPushMatrix();
  
-    // Project the shadow.
-    glMultMatrixf((GLfloat *) floorShadow);
+        // Project the shadow.
+        glMultMatrixf((GLfloat *) floorShadow);
+        pipeline_model( (float*) floorShadow );
  
-    //draw object shadows
-    sphere_reflection();
+        //draw object shadows
+        sphere_reflection( SPHERE_PASS_FLAT );
     
-    glPopMatrix();
+        glPopMatrix();
+        pipeline_model( NULL );
  
-    glDisable(GL_BLEND);
-    glEnable(GL_LIGHTING);
+        glstate_disable( GL_BLEND );
+        glstate_enable( GL_LIGHTING );
  
-    //glDisable(GL_POLYGON_OFFSET_FILL);
-    glDisable(GL_STENCIL_TEST);
+        glstate_disable( GL_POLYGON_OFFSET_FILL );
+        glPolygonOffset( 0.0f, 0.0f );
+        glstate_disable( GL_STENCIL_TEST );
+    }
+    passtime_end( PASS_SHADOWS );
  
+    passtime_begin( PASS_LIGHT );
     glPushMatrix();
-    glDisable(GL_LIGHTING);
+    glstate_disable( GL_LIGHTING );
     glColor3f(1.0, 1.0, 0.0);
  
     // Draw an arrowhead for light source
-    glDisable(GL_CULL_FACE);
+    glstate_disable( GL_CULL_FACE );
     glTranslatef(lightPosition[0], lightPosition[1], lightPosition[2]);
     glRotatef(lightAngle * -180.0 / M_PI, 0, 1, 0);
     glRotatef(atan(lightHeight/12) * 180.0 / M_PI, 0, 0, 1);
-    glutSolidSphere(2.0, 10, 10);
+    marker = sphere_mesh_get( 10, 10 );
+    sphere_mesh_bind( marker );
+    sphere_mesh_draw( marker, 2.0 );
+    sphere_mesh_unbind();
     // glBegin(GL_TRIANGLE_FAN);
     // glVertex3f(0, 0, 0);
     // glVertex3f(2, 1, 1);
@@ -895,97 +825,138 @@ static void render(void) {
     // glVertex3f(0, 0, 0);
     // glVertex3f(5, 0, 0);
     // glEnd();
-     glEnable(GL_CULL_FACE);
+     glstate_enable( GL_CULL_FACE );
  
-    glEnable(GL_LIGHTING);
+    glstate_enable( GL_LIGHTING );
     glPopMatrix();
+    passtime_end( PASS_LIGHT );
  
     glPopMatrix();
 
  
     // Draw the crosshair
+    passtime_begin( PASS_HUD );
     draw_crosshair();
 
-    getFPS();
+    frametime_tick();
 
     // Show player's statistics
-    glColor3f( 0.0f, 0.0f, 1.0f );
+    hud_text_color( 0.0f, 0.0f, 1.0f );
     show_player_stats();
+    if( show_passes )
+        show_pass_times();
+    hud_text_draw();
+    passtime_end( PASS_HUD );
+
+    if( options.capture[0] ) {
+        passtime_begin( PASS_CAPTURE );
+        capture_frame();
+        passtime_end( PASS_CAPTURE );
+    }
+    passtime_frame();
  
-    glutSwapBuffers();
+    if( offscreen )
+        offscreen_present();
+    else
+        glutSwapBuffers();
+}
+ 
+static void idle(void);
+ 
+//-----------------------------------------------------------------------------
+// Input or a window event changed what's on screen. Make sure a frame gets
+// drawn for it, even when demand pacing has stopped idling.
+//-----------------------------------------------------------------------------
+static void scene_changed( void ) {
+    pace_mark_dirty();
+    glutIdleFunc( idle );
 }
  
 //-----------------------------------------------------------------------------
 // Handles mouse clicks
 //-----------------------------------------------------------------------------
 static void mouse(int button, int state, int x, int y) {
-    int iViewport[4];
-    int center_x;
-    int center_y;
- 
     if( ( button == GLUT_LEFT_BUTTON ) && ( state == GLUT_DOWN ) ) {
-        glGetIntegerv( GL_VIEWPORT, iViewport );
- 
-        center_x = iViewport[2]/2;
-        center_y = iViewport[3]/2;
-        do_selection( center_x, center_y, FALSE );
+        do_selection( FALSE );
     }
+    scene_changed();
 }
  
 //-----------------------------------------------------------------------------
 // Handles mouse movement
 //-----------------------------------------------------------------------------
 static void motion(int x, int y) {
-    int diffx = x - camera.fLastX;
-    int diffy = y - camera.fLastY;
- 
-    camera.fLastX = x;
-    camera.fLastY = y;
- 
-    camera.vecRot.x += (float) diffy;
-    camera.vecRot.y += (float) diffx;
- 
-    if( diffy > 0) {
-        bikeHandlAngle = 1;
-    } else if( diffy < 0 ) {
-        bikeHandlAngle = -1;
-    } else {
-        bikeHandlAngle = 0;
-    }
- 
-    // reset camera if underneath floor or above it
-    if( camera.vecRot.x < -30.0f ) {
-        camera.vecRot.x = -30.0f;
-    }
- 
-    if( camera.vecRot.x > 90.0f ) {
-        camera.vecRot.x = 90.0f;
-    }
+    input_motion( x, y );
+    scene_changed();
 }
  
 //-----------------------------------------------------------------------------
-// A timer for animations used in code
+// A timer for animations used in code. Advances everything by the wall time
+// that has passed and lets the frame pacing decide when to draw. With the
+// simulation thread running that advances by itself; we only keep drawing
+// while it has something new or a snapshot is still being blended in.
 //-----------------------------------------------------------------------------
 static void idle(void) {
-    static float time = 0.0;
- 
-    time = glutGet(GLUT_ELAPSED_TIME) / 500.0;
+    static int last_time = -1;
+    int time;
+    int fast = options.replay_fast && replay_playing();
+    int animating;
+ 
+    view_update( frametime_now() );
+    if( view.done ) {
+        printf( "replay: finished at %.1f s simulated, score %d\n",
+                view.time / 1000.0, view.score );
+        exit( 0 );
+    }
  
-    //jump = 4.0 * fabs(sin(time)*0.5);
+    // Run the simulation for however much wall time has passed, or a step
+    // a frame when replaying as fast as we can
+    time = glutGet(GLUT_ELAPSED_TIME);
+    if( last_time < 0 )
+        last_time = time;
+    if( sim_thread_running() ) {
+        // Input the thread hasn't shown us yet counts as a change too
+        animating = view.active || replay_playing() || input_queued() != view.input_seq;
+    } else {
+        if( fast )
+            sim_step( SIM_DT );
+        else
+            sim_advance( time - last_time );
+        animating = sim_active() || replay_playing();
+    }
  
-    if (!lightMoving) {
-        lightAngle += 0.03;
+    // The light only circles while we draw continuously; in demand mode it
+    // would keep every frame dirty
+    if( fast ) {
+        lightAngle += LIGHT_SPEED * SIM_DT;
+    } else if( !lightMoving && options.pacing != PACE_ON_DEMAND ) {
+        lightAngle += LIGHT_SPEED * ( time - last_time ) / 1000.0f;
+    }
+    last_time = time;
+ 
+    // A replay keeps going by itself, like the dying spheres
+    if( !pace_should_render( animating ) ) {
+        // Nothing to draw: stop idling until scene_changed() wakes us, and
+        // don't time the wait as a frame
+        glutIdleFunc( NULL );
+        frametime_resume();
+        return;
     }
  
+    if( !fast )
+        pace_wait();
     glutPostRedisplay();
 }
  
  
 //-----------------------------------------------------------------------------
-// A simple idle visibility routine
+// Only idle while the window can be seen
 //-----------------------------------------------------------------------------
 static void visible(int vis) {
-    glutIdleFunc(idle);
+    if( vis == GLUT_VISIBLE )
+        scene_changed();
+    else
+        glutIdleFunc( NULL );
 }
  
 //-----------------------------------------------------------------------------
@@ -993,71 +964,50 @@ static void visible(int vis) {
 //-----------------------------------------------------------------------------
 static void key(GLubyte k, int x, int y) {
  
-    static float fRotSpeed = 1.0f;
+    input_key( k );
  
-    if (k=='q') {
-        camera.vecRot.x += fRotSpeed;
-        if (camera.vecRot.x > 360) camera.vecRot.x -= 360;
-    }
-    if (k=='z') {
-        camera.vecRot.x -= 1;
-        if (camera.vecRot.x < -360) camera.vecRot.x += 360;
-    }
-    if (k=='w') {
-        float xrotrad, yrotrad;
-        yrotrad = (camera.vecRot.y / 180.0f * 3.141592654f);
-        xrotrad = (camera.vecRot.x / 180.0f * 3.141592654f);
-        camera.vecPos.x += (float)(sin(yrotrad));
-        camera.vecPos.z -= (float)(cos(yrotrad));
-        camera.vecPos.y -= (float)(sin(xrotrad));
-        bikeTireAngle -= 10.0;
-        bikeHandlAngle = 0.0;
-    }
-    if (k=='s') {
-        float xrotrad, yrotrad;
-        yrotrad = (camera.vecRot.y / 180.0f * 3.141592654f);
-        xrotrad = (camera.vecRot.x / 180.0f * 3.141592654f);
-        camera.vecPos.x -= (float)(sin(yrotrad));
-        camera.vecPos.z += (float)(cos(yrotrad));
-        camera.vecPos.y += (float)(sin(xrotrad));
-        bikeTireAngle += 10.0;
-        bikeHandlAngle = 0.0;
-    }
-    if (k=='d') {
-        float yrotrad;
-        yrotrad = (camera.vecRot.y / 180.0f * 3.141592654f);
-        camera.vecPos.x += (float)(cos(yrotrad)) * 0.5f;
-        camera.vecPos.z += (float)(sin(yrotrad)) * 0.5f;
-        //bikeAngle -= 2.0;
-        bikeHandlAngle = 1;
-    }
-    if (k =='a') {
-        float yrotrad;
-        yrotrad = (camera.vecRot.y / 180.0f * 3.141592654f);
-        camera.vecPos.x -= (float)(cos(yrotrad)) * 0.5f;
-        camera.vecPos.z -= (float)(sin(yrotrad)) * 0.5f;
-        //  bikeAngle += 2.0;
-        bikeHandlAngle = -1;
-    }
+    if( k == 'p' )
+        show_passes = !show_passes;
  
     // Has escape been pressed?
     if( k == 27 ) {
         exit(0);
     }
-    glutPostRedisplay();
+    scene_changed();
 }
 
 //-----------------------------------------------------------------------------
 // Special keyboard functions not implemented
 //-----------------------------------------------------------------------------
 static void special(int k, int x, int y) {
-    glutPostRedisplay();
+    scene_changed();
 }
 
 //-----------------------------------------------------------------------------
-// Initialize opengl settings
+// Sets the buffer swap interval: 1 waits for vsync, 0 doesn't. GLUT has no
+// call for this, so go to GLX directly. Quietly does nothing if the driver
+// has neither extension.
 //-----------------------------------------------------------------------------
-static void init() {
+static void set_swap_interval( int interval ) {
+    PFNGLXSWAPINTERVALEXTPROC swap_ext;
+    PFNGLXSWAPINTERVALMESAPROC swap_mesa;
+
+    swap_ext = (PFNGLXSWAPINTERVALEXTPROC)
+        glXGetProcAddressARB( (const GLubyte*) "glXSwapIntervalEXT" );
+    if( swap_ext ) {
+        swap_ext( glXGetCurrentDisplay(), glXGetCurrentDrawable(), interval );
+        return;
+    }
+    swap_mesa = (PFNGLXSWAPINTERVALMESAPROC)
+        glXGetProcAddressARB( (const GLubyte*) "glXSwapIntervalMESA" );
+    if( swap_mesa )
+        swap_mesa( interval );
+}
+
+//-----------------------------------------------------------------------------
+// Opens the game window, full screen if we can
+//-----------------------------------------------------------------------------
+static void init_window( void ) {
 
     glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH | GLUT_STENCIL | GLUT_MULTISAMPLE);
  
@@ -1066,7 +1016,7 @@ static void init() {
     if (glutGameModeGet(GLUT_GAME_MODE_POSSIBLE))
         glutEnterGameMode();
     else {
-        glutInitWindowSize(HEIGHT,WIDTH);
+        glutInitWindowSize( options.width, options.height );
         glutCreateWindow("TRON Game");
     }
  
@@ -1074,17 +1024,47 @@ static void init() {
         printf("tron: Sorry, I need at least 2 bits of stencil.\n");
         exit(1);
     }
+}
+
+//-----------------------------------------------------------------------------
+// Initialize opengl settings. Needs a current context, from either
+// init_window() or offscreen_init().
+//-----------------------------------------------------------------------------
+static void init() {
 
    glEnable(GL_CULL_FACE);
     glEnable(GL_DEPTH_TEST);
+    // cached sphere meshes are scaled unit spheres
+    glEnable(GL_RESCALE_NORMAL);
+ 
+    if( options.instancing )
+        sphere_instancing_init();
+    shadow_map_init( options.shadow_size );
+    reflection_init( options.reflection_scale );
+    passtime_init();
+    hud_text_init();
+    bike_model_init();
+
+    // The spheres are lit with the bike's material too, and nothing else
+    // changes it
+    bike_model_material();
+    if( !offscreen ) {
+        pace_init( options.pacing, options.fps );
+        set_swap_interval( options.pacing == PACE_VSYNC ? 1 : 0 );
+    }
+    if( options.trace[0] && passtime_trace_open( options.trace ) )
+        atexit( passtime_trace_close );
+    lod_config.enabled = options.lod;
+    lod_config.scale = options.lod_scale;
     glEnable(GL_TEXTURE_2D);
     glLineWidth(3.0);
  
     glMatrixMode(GL_PROJECTION);
-    gluPerspective( 40.0, 1.0, 20.0, 100.0);
+    mat4_perspective( projection, FOVY, 1.0, 20.0, 100.0 );
+    glLoadMatrixf( projection );
     glMatrixMode(GL_MODELVIEW);
-    gluLookAt(0.0, 8.0, 60.0,  /* eye is at (0,0,30) */
-              0.0, 8.0, 0.0,      /* center is at (0,0,0) */
+    gluLookAt(0.0, CAMERA_EYE_Y, CAMERA_EYE_Z,  /* eye is at (0,8,60) */
+              0.0, CAMERA_EYE_Y, 0.0,      /* center is at (0,8,0) */
               0.0, 1.0, 0.);      /* up is in postivie Y direction */
  
     glLightModeli(GL_LIGHT_MODEL_LOCAL_VIEWER, 1);
@@ -1095,33 +1075,121 @@ static void init() {
     glEnable(GL_LIGHTING);
  
     //enable scene
-    spheres_init();
- 
-    // setup camera
-    memset( &camera, 0, sizeof( struct ThirdPersonCamera_t ) );
-    camera.fRadius = 10.0f;
- 
-    //timer
-    srand( time( NULL ) );
+    sim_init( options.sphere_count, options.seed );
 
     // make floor
     makeFloorTexture();
- 
-    // Setup floor plane for projected shadow calculations.
+    floor_init( FLOOR_HALF_SIZE, FLOOR_Y, FLOOR_TILES, FLOOR_REPEAT );
+
+    // Last, so it can take the light and material set up above
+    if( options.renderer == RENDERER_CORE )
+        pipeline_init();
+    if( options.impostors )
+        sphere_impostors_init();
+ 
+    // Setup floor plane for projected shadow calculations. They also pick
+    // the shadow casters for the shadow map.
     findPlane(floorPlane, floorVertices[1], floorVertices[2], floorVertices[3]);
 
 }
 
+//-----------------------------------------------------------------------------
+// Writes the frame time log on the way out
+//-----------------------------------------------------------------------------
+static void write_frame_log( void ) {
+    frametime_dump( options.frame_log );
+}
+
+//-----------------------------------------------------------------------------
+// Renders options.bench frames into the offscreen framebuffer and reports
+// how long they took. The game runs the same scripted session as
+// lightballs_headless, one simulation step per frame, so runs are
+// repeatable for a given seed. With --replay the recorded inputs drive it
+// instead and the run stops early if the recording ends.
+//-----------------------------------------------------------------------------
+static void run_bench( void ) {
+    struct FrameStats_t stats;
+    double start, elapsed;
+    int i;
+
+    start = frametime_now();
+    for( i = 0; i < options.bench && !replay_done(); i++ ) {
+        // Ignored while replaying
+        replay_key( 'w' );
+        replay_motion( i % 7, 0 );
+        if( i % BENCH_KILL_INTERVAL == 0 )
+            replay_kill( rand() % spheres.count );
+        sim_step( SIM_DT );
+        lightAngle += LIGHT_SPEED * SIM_DT;
+
+        render();
+    }
+    elapsed = ( frametime_now() - start ) / 1000.0;
+
+    // The first frame only starts the frame clock
+    frametime_total( &stats );
+    printf( "bench: %d frames at %dx%d, %d spheres in %.3f s, %.1f fps\n",
+            i, options.width, options.height, spheres.count, elapsed, i / elapsed );
+    printf( "frame ms: avg %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f hitches %d\n",
+            stats.avg_ms, stats.p50_ms, stats.p95_ms, stats.p99_ms, stats.max_ms,
+            stats.hitches );
+    if( passtime_dropped() )
+        printf( "pass times: %d frames of GPU times dropped, not back in time\n",
+                passtime_dropped() );
+
+    replay_close();
+    capture_shutdown();
+    offscreen_shutdown();
+    jobs_shutdown();
+}
+
 //-----------------------------------------------------------------------------
 // Main Function
 //----------------------------------------------------------------------------- 
 int main(int argc, char **argv) {
-    int i;
+    int i, threaded;
+ 
+    // Options go first: benchmarking must not touch GLUT, which wants a
+    // display as soon as it's initialised
+    options_parse( argc, argv );
+    if( options.frame_log[0] )
+        atexit( write_frame_log );
+    replay_init();
+    jobs_init( options.threads );
+ 
+    if( options.bench > 0 ) {
+        offscreen = 1;
+        if( !offscreen_init( options.width, options.height ) )
+            exit( 1 );
+        init();
+        view_init( FALSE );
+        if( options.capture[0] && !capture_init( options.capture, options.width, options.height ) )
+            exit( 1 );
+        run_bench();
+        exit( 0 );
+    }
  
     glutInit( &argc, argv );
- 
+    init_window();
     init();
 
+    // Fast replays step once a frame on this thread to stay as quick as
+    // the renderer allows
+    threaded = options.sim_thread && !( options.replay_fast && options.replay[0] );
+    view_init( threaded );
+    if( options.capture[0] ) {
+        if( !capture_init( options.capture, glutGet( GLUT_WINDOW_WIDTH ), glutGet( GLUT_WINDOW_HEIGHT ) ) )
+            exit( 1 );
+        atexit( capture_shutdown );
+    }
+    atexit( replay_close );
+    if( threaded ) {
+        // atexit runs backwards, so this stops the thread before the
+        // replay is closed under it
+        sim_thread_start();
+        atexit( sim_thread_stop );
+    }
+
     // Register GLUT callbacks.
     glutDisplayFunc(render);
     glutMouseFunc(mouse);
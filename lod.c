@@ -0,0 +1,89 @@
+// lod.c
+// Sphere level of detail selection. See lod.h.
+#include "lod.h"
+#include "matrix.h"
+#include "view.h"
+#include "jobs.h"
+
+// A sphere drawn with n slices strays r * (1 - cos(pi / n)) pixels from its
+// silhouette. Each level takes over at about the radius where its own error
+// is a quarter pixel. Projected radii only run to about 23 px at 600 lines
+// and 42 px at 1080, so the thresholds have to sit well inside that range.
+struct LodConfig_t lod_config = {
+    {
+        { 20, 20, 20.0f },      // what the game always used
+        { 14, 14, 12.0f },
+        { 10, 10, 5.0f },
+        { 6, 6, 0.0f },
+    },
+    0.15f,
+    1.0f,
+    1,
+};
+
+// What every lod_range() job needs
+struct LodJob_t {
+    float up[LOD_LEVELS], down[LOD_LEVELS];
+    float focal_px;
+    float eye_offset;
+};
+
+//-----------------------------------------------------------------------------
+// Picks levels for spheres [begin, end), a job for lod_update()
+//-----------------------------------------------------------------------------
+static void lod_range( void* arg, int begin, int end, int worker ) {
+    const struct LodJob_t* job = arg;
+    int i;
+
+    for( i = begin; i < end; i++ ) {
+        float r_px = view.spheres.size[i] * job->focal_px / ( view.spheres.distance[i] + job->eye_offset );
+        int cur = view.spheres.lod[i];
+
+        // Refine while the next finer level's threshold is cleared...
+        while( cur > 0 && r_px >= job->up[cur-1] )
+            cur--;
+        // ...and coarsen while this level's threshold is clearly missed
+        while( cur < LOD_LEVELS - 1 && r_px < job->down[cur] )
+            cur++;
+
+        view.spheres.lod[i] = (unsigned char) cur;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Picks a level for every sphere. focal_px is the projection's focal length
+// in pixels: viewport height / (2 * tan(fovy / 2)).
+//-----------------------------------------------------------------------------
+void lod_update( float focal_px ) {
+    struct LodJob_t job;
+    int i, l;
+
+    if( !lod_config.enabled ) {
+        for( i = 0; i < view.spheres.count; i++ )
+            view.spheres.lod[i] = 0;
+        return;
+    }
+
+    // Thresholds a sphere has to pass to refine into level l, and to drop
+    // back out of it
+    for( l = 0; l < LOD_LEVELS; l++ ) {
+        float t = lod_config.levels[l].min_radius_px * lod_config.scale;
+        job.up[l] = t * ( 1.0f + lod_config.hysteresis );
+        job.down[l] = t * ( 1.0f - lod_config.hysteresis );
+    }
+
+    // The distance field is measured from the player; the eye sits behind
+    // the player by the camera rig's offset.
+    job.eye_offset = CAMERA_EYE_Z + view.camera.fRadius;
+    job.focal_px = focal_px;
+
+    jobs_parallel_for( view.spheres.count, JOBS_SPHERE_GRAIN, lod_range, &job );
+}
+
+//-----------------------------------------------------------------------------
+// A level made coarser by bias, clamped to the coarsest level
+//-----------------------------------------------------------------------------
+int lod_biased( int level, int bias ) {
+    level += bias;
+    return level < LOD_LEVELS ? level : LOD_LEVELS - 1;
+}
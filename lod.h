@@ -0,0 +1,35 @@
+// lod.h
+// Distance based level of detail for the spheres. Each frame the projected
+// radius of every sphere (in pixels) is estimated from the distance field
+// calculate_distances() fills in, and a tessellation level is picked from
+// LOD_LEVELS precomputed meshes. Levels only change once the projected size
+// moves a hysteresis margin past a threshold, so spheres sitting on a
+// boundary don't flicker between meshes.
+#ifndef LOD_H
+#define LOD_H
+
+#define LOD_LEVELS 4
+
+// Passes that never show sphere detail up close draw this many levels
+// coarser than the main pass.
+#define LOD_REFLECTION_BIAS 1
+#define LOD_SHADOW_BIAS 2
+
+struct LodLevel_t {
+    int slices, stacks;
+    float min_radius_px;        // finest level whose threshold is met wins
+};
+
+struct LodConfig_t {
+    struct LodLevel_t levels[LOD_LEVELS];
+    float hysteresis;           // fraction of a threshold to overshoot by
+    float scale;                // multiplies every threshold
+    int enabled;                // FALSE pins everything to level 0
+};
+
+extern struct LodConfig_t lod_config;
+
+void lod_update( float focal_px );
+int lod_biased( int level, int bias );
+
+#endif
@@ -0,0 +1,213 @@
+// matrix.c
+// CPU side matrix helpers. See matrix.h.
+#include <string.h>
+#include <math.h>
+
+#include "matrix.h"
+
+// Some <math.h> files do not define M_PI...
+#ifndef M_PI
+#define M_PI 3.14159265
+#endif
+
+//-----------------------------------------------------------------------------
+// Loads the identity matrix
+//-----------------------------------------------------------------------------
+void mat4_identity( float m[16] ) {
+    memset( m, 0, sizeof( float ) * 16 );
+    m[0] = m[5] = m[10] = m[15] = 1.0f;
+}
+
+void mat4_copy( float out[16], const float m[16] ) {
+    memcpy( out, m, sizeof( float ) * 16 );
+}
+
+//-----------------------------------------------------------------------------
+// out = a * b. out may alias either input.
+//-----------------------------------------------------------------------------
+void mat4_multiply( float out[16], const float a[16], const float b[16] ) {
+    float r[16];
+    int i, j;
+
+    for( i = 0; i < 4; i++ ) {
+        for( j = 0; j < 4; j++ ) {
+            r[j*4+i] = a[0*4+i] * b[j*4+0] +
+                       a[1*4+i] * b[j*4+1] +
+                       a[2*4+i] * b[j*4+2] +
+                       a[3*4+i] * b[j*4+3];
+        }
+    }
+    mat4_copy( out, r );
+}
+
+//-----------------------------------------------------------------------------
+// Same as glTranslatef
+//-----------------------------------------------------------------------------
+void mat4_translate( float m[16], float x, float y, float z ) {
+    m[12] += m[0] * x + m[4] * y + m[8] * z;
+    m[13] += m[1] * x + m[5] * y + m[9] * z;
+    m[14] += m[2] * x + m[6] * y + m[10] * z;
+    m[15] += m[3] * x + m[7] * y + m[11] * z;
+}
+
+//-----------------------------------------------------------------------------
+// Same as glRotatef: angle in degrees around the axis (x, y, z)
+//-----------------------------------------------------------------------------
+void mat4_rotate( float m[16], float angle, float x, float y, float z ) {
+    float r[16];
+    float len = sqrt( x*x + y*y + z*z );
+    float rad = angle * M_PI / 180.0;
+    float c = cos( rad ), s = sin( rad ), t = 1.0f - c;
+
+    if( len == 0.0f )
+        return;
+    x /= len;
+    y /= len;
+    z /= len;
+
+    mat4_identity( r );
+    r[0] = x*x*t + c;
+    r[1] = y*x*t + z*s;
+    r[2] = x*z*t - y*s;
+    r[4] = x*y*t - z*s;
+    r[5] = y*y*t + c;
+    r[6] = y*z*t + x*s;
+    r[8] = x*z*t + y*s;
+    r[9] = y*z*t - x*s;
+    r[10] = z*z*t + c;
+
+    mat4_multiply( m, m, r );
+}
+
+//-----------------------------------------------------------------------------
+// Same as glScalef
+//-----------------------------------------------------------------------------
+void mat4_scale( float m[16], float x, float y, float z ) {
+    int i;
+
+    for( i = 0; i < 4; i++ ) {
+        m[i] *= x;
+        m[4+i] *= y;
+        m[8+i] *= z;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Same as glLoadIdentity followed by gluPerspective
+//-----------------------------------------------------------------------------
+void mat4_perspective( float m[16], float fovy, float aspect, float znear, float zfar ) {
+    float f = 1.0f / tan( fovy * M_PI / 360.0 );
+
+    memset( m, 0, sizeof( float ) * 16 );
+    m[0] = f / aspect;
+    m[5] = f;
+    m[10] = (zfar + znear) / (znear - zfar);
+    m[11] = -1.0f;
+    m[14] = 2.0f * zfar * znear / (znear - zfar);
+}
+
+//-----------------------------------------------------------------------------
+// Same as glLoadIdentity followed by glOrtho
+//-----------------------------------------------------------------------------
+void mat4_ortho( float m[16], float left, float right, float bottom, float top,
+                 float znear, float zfar ) {
+    memset( m, 0, sizeof( float ) * 16 );
+    m[0] = 2.0f / (right - left);
+    m[5] = 2.0f / (top - bottom);
+    m[10] = -2.0f / (zfar - znear);
+    m[12] = -(right + left) / (right - left);
+    m[13] = -(top + bottom) / (top - bottom);
+    m[14] = -(zfar + znear) / (zfar - znear);
+    m[15] = 1.0f;
+}
+
+//-----------------------------------------------------------------------------
+// General 4x4 inverse. Returns FALSE (0) if the matrix is singular.
+//-----------------------------------------------------------------------------
+int mat4_invert( float out[16], const float m[16] ) {
+    float inv[16], det;
+    int i;
+
+    inv[0] = m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] +
+             m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+    inv[4] = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] -
+             m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+    inv[8] = m[4]*m[9]*m[15] - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] +
+             m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+    inv[12] = -m[4]*m[9]*m[14] + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] -
+              m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+    inv[1] = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] -
+             m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+    inv[5] = m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] +
+             m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+    inv[9] = -m[0]*m[9]*m[15] + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] -
+             m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+    inv[13] = m[0]*m[9]*m[14] - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] +
+              m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+    inv[2] = m[1]*m[6]*m[15] - m[1]*m[7]*m[14] - m[5]*m[2]*m[15] +
+             m[5]*m[3]*m[14] + m[13]*m[2]*m[7] - m[13]*m[3]*m[6];
+    inv[6] = -m[0]*m[6]*m[15] + m[0]*m[7]*m[14] + m[4]*m[2]*m[15] -
+             m[4]*m[3]*m[14] - m[12]*m[2]*m[7] + m[12]*m[3]*m[6];
+    inv[10] = m[0]*m[5]*m[15] - m[0]*m[7]*m[13] - m[4]*m[1]*m[15] +
+              m[4]*m[3]*m[13] + m[12]*m[1]*m[7] - m[12]*m[3]*m[5];
+    inv[14] = -m[0]*m[5]*m[14] + m[0]*m[6]*m[13] + m[4]*m[1]*m[14] -
+              m[4]*m[2]*m[13] - m[12]*m[1]*m[6] + m[12]*m[2]*m[5];
+    inv[3] = -m[1]*m[6]*m[11] + m[1]*m[7]*m[10] + m[5]*m[2]*m[11] -
+             m[5]*m[3]*m[10] - m[9]*m[2]*m[7] + m[9]*m[3]*m[6];
+    inv[7] = m[0]*m[6]*m[11] - m[0]*m[7]*m[10] - m[4]*m[2]*m[11] +
+             m[4]*m[3]*m[10] + m[8]*m[2]*m[7] - m[8]*m[3]*m[6];
+    inv[11] = -m[0]*m[5]*m[11] + m[0]*m[7]*m[9] + m[4]*m[1]*m[11] -
+              m[4]*m[3]*m[9] - m[8]*m[1]*m[7] + m[8]*m[3]*m[5];
+    inv[15] = m[0]*m[5]*m[10] - m[0]*m[6]*m[9] - m[4]*m[1]*m[10] +
+              m[4]*m[2]*m[9] + m[8]*m[1]*m[6] - m[8]*m[2]*m[5];
+
+    det = m[0]*inv[0] + m[1]*inv[4] + m[2]*inv[8] + m[3]*inv[12];
+    if( det == 0.0f )
+        return 0;
+
+    det = 1.0f / det;
+    for( i = 0; i < 16; i++ )
+        out[i] = inv[i] * det;
+
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Transforms a point (w = 1) or a direction (w = 0) by m
+//-----------------------------------------------------------------------------
+void mat4_transform_point( const float m[16], const struct Vector3* in, struct Vector3* out ) {
+    struct Vector3 v = *in;
+
+    out->x = m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12];
+    out->y = m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13];
+    out->z = m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14];
+}
+
+void mat4_transform_dir( const float m[16], const struct Vector3* in, struct Vector3* out ) {
+    struct Vector3 v = *in;
+
+    out->x = m[0] * v.x + m[4] * v.y + m[8] * v.z;
+    out->y = m[1] * v.x + m[5] * v.y + m[9] * v.z;
+    out->z = m[2] * v.x + m[6] * v.y + m[10] * v.z;
+}
+
+//-----------------------------------------------------------------------------
+// Builds the world to eye transform the spheres are drawn with in render():
+// the gluLookAt from init() followed by the third person camera rig. Keep
+// the two in step.
+//-----------------------------------------------------------------------------
+void camera_view_matrix( const struct ThirdPersonCamera_t* cam, float m[16] ) {
+    mat4_identity( m );
+
+    // gluLookAt(0, 8, 60, 0, 8, 0, 0, 1, 0) is a plain translation
+    mat4_translate( m, 0.0f, -CAMERA_EYE_Y, -CAMERA_EYE_Z );
+
+    // Position the camera behind our character
+    mat4_translate( m, 0.0f, -CAMERA_DROP, -cam->fRadius );
+    mat4_rotate( m, cam->vecRot.x, 1.0f, 0.0f, 0.0f );
+    mat4_translate( m, CAMERA_PLAYER_X, 0.0f, 0.0f );
+
+    // Rotate the camera as necessary
+    mat4_rotate( m, cam->vecRot.y, 0.0f, 1.0f, 0.0f );
+    mat4_translate( m, -cam->vecPos.x, CAMERA_LIFT, -cam->vecPos.z );
+}
@@ -0,0 +1,36 @@
+// matrix.h
+// Small 4x4 matrix helpers that mirror the OpenGL matrix stack on the CPU.
+// Matrices are column-major float[16], the same layout glLoadMatrixf takes,
+// and the transform calls post-multiply just like glTranslatef/glRotatef.
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include "sim.h"
+
+// Fixed parts of the third person camera rig built in render()
+#define CAMERA_EYE_Y 8.0f
+#define CAMERA_EYE_Z 60.0f
+#define CAMERA_DROP 2.0f
+#define CAMERA_PLAYER_X 8.0f
+// Eye height over the camera's target. The spheres and the floor used to be
+// drawn 2.25 lower than this rig says, through translations the floor left
+// on the matrix stack; that's now part of the lift.
+#define CAMERA_LIFT -0.05f
+
+void mat4_identity( float m[16] );
+void mat4_copy( float out[16], const float m[16] );
+void mat4_multiply( float out[16], const float a[16], const float b[16] );
+void mat4_translate( float m[16], float x, float y, float z );
+void mat4_rotate( float m[16], float angle, float x, float y, float z );
+void mat4_scale( float m[16], float x, float y, float z );
+void mat4_perspective( float m[16], float fovy, float aspect, float znear, float zfar );
+void mat4_ortho( float m[16], float left, float right, float bottom, float top,
+                 float znear, float zfar );
+int mat4_invert( float out[16], const float m[16] );
+
+void mat4_transform_point( const float m[16], const struct Vector3* in, struct Vector3* out );
+void mat4_transform_dir( const float m[16], const struct Vector3* in, struct Vector3* out );
+
+void camera_view_matrix( const struct ThirdPersonCamera_t* cam, float m[16] );
+
+#endif
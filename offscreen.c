@@ -0,0 +1,148 @@
+// offscreen.c
+// EGL + framebuffer object render target. See offscreen.h.
+#include <stdio.h>
+#include <string.h>
+
+#include "offscreen.h"
+
+#ifdef __APPLE__
+
+int offscreen_init( int width, int height ) {
+    printf( "tron: offscreen rendering needs EGL, which this platform lacks\n" );
+    return 0;
+}
+
+void offscreen_present( void ) {
+}
+
+void offscreen_shutdown( void ) {
+}
+
+#else
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static EGLSurface surface = EGL_NO_SURFACE;
+static GLuint framebuffer = 0;
+static GLuint renderbuffers[2];
+
+//-----------------------------------------------------------------------------
+// Opens a display that needs no window system: Mesa's surfaceless platform
+// if we can get it, else whatever EGL gives us by default
+//-----------------------------------------------------------------------------
+static EGLDisplay open_display( void ) {
+    const char *ext = eglQueryString( EGL_NO_DISPLAY, EGL_EXTENSIONS );
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+    EGLDisplay d;
+
+    if( ext && strstr( ext, "EGL_MESA_platform_surfaceless" ) ) {
+        get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+            eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+        if( get_platform_display ) {
+            d = get_platform_display( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL );
+            if( d != EGL_NO_DISPLAY )
+                return d;
+        }
+    }
+    return eglGetDisplay( EGL_DEFAULT_DISPLAY );
+}
+
+//-----------------------------------------------------------------------------
+// Creates the context and a width x height framebuffer with depth and
+// stencil, and makes them current. Returns FALSE (0) on failure.
+//-----------------------------------------------------------------------------
+int offscreen_init( int width, int height ) {
+    static const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    EGLint major, minor, configs;
+    EGLConfig config;
+    GLenum status;
+
+    display = open_display();
+    if( display == EGL_NO_DISPLAY || !eglInitialize( display, &major, &minor ) ) {
+        printf( "tron: can't open an EGL display\n" );
+        return 0;
+    }
+
+    if( !eglBindAPI( EGL_OPENGL_API ) ||
+        !eglChooseConfig( display, config_attribs, &config, 1, &configs ) || configs < 1 ) {
+        printf( "tron: EGL has no desktop OpenGL config\n" );
+        return 0;
+    }
+
+    context = eglCreateContext( display, config, EGL_NO_CONTEXT, NULL );
+    if( context == EGL_NO_CONTEXT ) {
+        printf( "tron: can't create an EGL context\n" );
+        return 0;
+    }
+
+    // Everything is drawn into the framebuffer object, so the context only
+    // needs a surface if the driver can't do without one
+    if( !eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context ) ) {
+        surface = eglCreatePbufferSurface( display, config, pbuffer_attribs );
+        if( surface == EGL_NO_SURFACE || !eglMakeCurrent( display, surface, surface, context ) ) {
+            printf( "tron: can't make the EGL context current\n" );
+            return 0;
+        }
+    }
+
+    glGenFramebuffers( 1, &framebuffer );
+    glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+    glGenRenderbuffers( 2, renderbuffers );
+
+    glBindRenderbuffer( GL_RENDERBUFFER, renderbuffers[0] );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width, height );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0] );
+
+    glBindRenderbuffer( GL_RENDERBUFFER, renderbuffers[1] );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1] );
+    glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+    status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+    if( status != GL_FRAMEBUFFER_COMPLETE ) {
+        printf( "tron: offscreen framebuffer incomplete (0x%x)\n", status );
+        return 0;
+    }
+
+    glViewport( 0, 0, width, height );
+    printf( "tron: offscreen %dx%d on %s, %s\n", width, height,
+            (const char*) glGetString( GL_RENDERER ), (const char*) glGetString( GL_VERSION ) );
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Ends a frame. There's nothing to swap; wait for the frame to finish so
+// frame times mean the same as with a window.
+//-----------------------------------------------------------------------------
+void offscreen_present( void ) {
+    glFinish();
+}
+
+//-----------------------------------------------------------------------------
+// Tears the framebuffer and context down
+//-----------------------------------------------------------------------------
+void offscreen_shutdown( void ) {
+    if( display == EGL_NO_DISPLAY )
+        return;
+
+    glDeleteFramebuffers( 1, &framebuffer );
+    glDeleteRenderbuffers( 2, renderbuffers );
+    eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+    eglDestroyContext( display, context );
+    if( surface != EGL_NO_SURFACE )
+        eglDestroySurface( display, surface );
+    eglTerminate( display );
+    display = EGL_NO_DISPLAY;
+}
+
+#endif
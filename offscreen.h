@@ -0,0 +1,12 @@
+// offscreen.h
+// Offscreen rendering without a window or display: an EGL context (Mesa's
+// surfaceless platform when it's there, so llvmpipe works on build
+// machines) rendering into a framebuffer object of the requested size.
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+int offscreen_init( int width, int height );
+void offscreen_present( void );
+void offscreen_shutdown( void );
+
+#endif
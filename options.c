@@ -0,0 +1,278 @@
+// options.c
+// Command line and config file parsing. See options.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "options.h"
+#include "sim.h"
+#include "pacing.h"
+#include "jobs.h"
+
+struct Options_t options;
+
+//-----------------------------------------------------------------------------
+// Prints the usage and quits
+//-----------------------------------------------------------------------------
+static void usage( const char *prog ) {
+    printf( "usage: %s [-n|--spheres N] [--seed N] [--config FILE]\n"
+            "       [--instancing 0|1] [--lod 0|1] [--lod-scale F]\n"
+            "       [--cull 0|1] [--frame-log FILE] [--trace FILE]\n"
+            "       [--pacing uncapped|fixed|vsync|demand] [--fps N]\n"
+            "       [--width N] [--height N] [--bench N] [--capture PATTERN]\n"
+            "       [--record FILE] [--replay FILE] [--replay-fast 0|1]\n"
+            "       [--threads N] [--sim-thread 0|1] [--shadow-size N]\n"
+            "       [--reflection-scale F] [--renderer core|legacy]\n"
+            "       [--impostors 0|1] [--steps N]\n", prog );
+    exit( 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Parses a whole, positive number or bails out
+//-----------------------------------------------------------------------------
+static int parse_count( const char *name, const char *value, int max ) {
+    char *end;
+    long n = strtol( value, &end, 10 );
+
+    if( *value == '\0' || *end != '\0' || n <= 0 || n > max ) {
+        printf( "tron: bad value for %s: '%s'\n", name, value );
+        exit( 1 );
+    }
+    return (int) n;
+}
+
+//-----------------------------------------------------------------------------
+// Parses a random seed, any whole number from 0 up. Replays depend on it
+// being exactly what was asked for, so anything else bails out.
+//-----------------------------------------------------------------------------
+static unsigned int parse_seed( const char *name, const char *value ) {
+    char *end;
+    unsigned long n = strtoul( value, &end, 10 );
+
+    if( *value < '0' || *value > '9' || *end != '\0' || n > UINT_MAX ) {
+        printf( "tron: bad value for %s: '%s'\n", name, value );
+        exit( 1 );
+    }
+    return (unsigned int) n;
+}
+
+//-----------------------------------------------------------------------------
+// Parses a positive number
+//-----------------------------------------------------------------------------
+static float parse_float( const char *name, const char *value ) {
+    char *end;
+    float f = strtod( value, &end );
+
+    if( *value == '\0' || *end != '\0' || f <= 0.0f ) {
+        printf( "tron: bad value for %s: '%s'\n", name, value );
+        exit( 1 );
+    }
+    return f;
+}
+
+//-----------------------------------------------------------------------------
+// Parses a 0 or 1 switch
+//-----------------------------------------------------------------------------
+static int parse_flag( const char *name, const char *value ) {
+    if( strcmp( value, "0" ) && strcmp( value, "1" ) ) {
+        printf( "tron: bad value for %s: '%s' (expected 0 or 1)\n", name, value );
+        exit( 1 );
+    }
+    return value[0] == '1';
+}
+
+//-----------------------------------------------------------------------------
+// Looks a frame pacing mode up by name
+//-----------------------------------------------------------------------------
+static int parse_pacing( const char *name, const char *value ) {
+    int mode;
+
+    for( mode = 0; mode < PACE_MODES; mode++ ) {
+        if( !strcmp( value, pace_mode_names[mode] ) )
+            return mode;
+    }
+    printf( "tron: bad value for %s: '%s'\n", name, value );
+    exit( 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Looks a renderer up by name
+//-----------------------------------------------------------------------------
+static int parse_renderer( const char *name, const char *value ) {
+    if( !strcmp( value, "core" ) )
+        return RENDERER_CORE;
+    if( !strcmp( value, "legacy" ) )
+        return RENDERER_LEGACY;
+    printf( "tron: bad value for %s: '%s'\n", name, value );
+    exit( 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Copies a file name option, refusing ones that don't fit
+//-----------------------------------------------------------------------------
+static void parse_path( const char *name, const char *value, char *out ) {
+    if( strlen( value ) >= OPTIONS_PATH_MAX ) {
+        printf( "tron: bad value for %s: path too long\n", name );
+        exit( 1 );
+    }
+    strcpy( out, value );
+}
+
+//-----------------------------------------------------------------------------
+// Applies one option by its long name. Returns FALSE (0) if unknown.
+//-----------------------------------------------------------------------------
+static int options_set( const char *name, const char *value ) {
+    if( !strcmp( name, "spheres" ) ) {
+        options.sphere_count = parse_count( name, value, OPTIONS_MAX_SPHERES );
+    } else if( !strcmp( name, "seed" ) ) {
+        options.seed = parse_seed( name, value );
+    } else if( !strcmp( name, "instancing" ) ) {
+        options.instancing = parse_flag( name, value );
+    } else if( !strcmp( name, "lod" ) ) {
+        options.lod = parse_flag( name, value );
+    } else if( !strcmp( name, "lod-scale" ) ) {
+        options.lod_scale = parse_float( name, value );
+    } else if( !strcmp( name, "cull" ) ) {
+        options.cull = parse_flag( name, value );
+    } else if( !strcmp( name, "pacing" ) ) {
+        options.pacing = parse_pacing( name, value );
+    } else if( !strcmp( name, "fps" ) ) {
+        options.fps = parse_count( name, value, 1000 );
+    } else if( !strcmp( name, "width" ) ) {
+        options.width = parse_count( name, value, 16384 );
+    } else if( !strcmp( name, "height" ) ) {
+        options.height = parse_count( name, value, 16384 );
+    } else if( !strcmp( name, "bench" ) ) {
+        options.bench = parse_count( name, value, 0x7fffffff );
+    } else if( !strcmp( name, "capture" ) ) {
+        parse_path( name, value, options.capture );
+    } else if( !strcmp( name, "record" ) ) {
+        parse_path( name, value, options.record );
+    } else if( !strcmp( name, "replay" ) ) {
+        parse_path( name, value, options.replay );
+    } else if( !strcmp( name, "replay-fast" ) ) {
+        options.replay_fast = parse_flag( name, value );
+    } else if( !strcmp( name, "threads" ) ) {
+        options.threads = parse_count( name, value, JOBS_MAX_WORKERS );
+    } else if( !strcmp( name, "sim-thread" ) ) {
+        options.sim_thread = parse_flag( name, value );
+    } else if( !strcmp( name, "shadow-size" ) ) {
+        // 0 turns the shadow map off
+        if( !strcmp( value, "0" ) )
+            options.shadow_size = 0;
+        else
+            options.shadow_size = parse_count( name, value, OPTIONS_SHADOW_SIZE_MAX );
+    } else if( !strcmp( name, "reflection-scale" ) ) {
+        // 0 turns the reflection texture off; past 1 buys nothing
+        if( !strcmp( value, "0" ) )
+            options.reflection_scale = 0.0f;
+        else
+            options.reflection_scale = parse_float( name, value );
+        if( options.reflection_scale > 1.0f )
+            options.reflection_scale = 1.0f;
+    } else if( !strcmp( name, "renderer" ) ) {
+        options.renderer = parse_renderer( name, value );
+    } else if( !strcmp( name, "impostors" ) ) {
+        options.impostors = parse_flag( name, value );
+    } else if( !strcmp( name, "frame-log" ) ) {
+        parse_path( name, value, options.frame_log );
+    } else if( !strcmp( name, "trace" ) ) {
+        parse_path( name, value, options.trace );
+    } else if( !strcmp( name, "steps" ) ) {
+        options.steps = parse_count( name, value, 0x7fffffff );
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Reads "name = value" lines from a config file
+//-----------------------------------------------------------------------------
+static void options_load( const char *path ) {
+    FILE *fp = fopen( path, "r" );
+    char line[256], name[64], value[192];
+    int lineno = 0;
+
+    if( !fp ) {
+        printf( "tron: can't open config file %s\n", path );
+        exit( 1 );
+    }
+
+    while( fgets( line, sizeof( line ), fp ) ) {
+        lineno++;
+        if( sscanf( line, " %63[^ =\t\n#] = %191s", name, value ) != 2 ) {
+            // blank lines and comments
+            if( sscanf( line, " %63s", name ) != 1 || name[0] == '#' )
+                continue;
+            printf( "tron: %s:%d: expected 'name = value'\n", path, lineno );
+            exit( 1 );
+        }
+        if( !options_set( name, value ) ) {
+            printf( "tron: %s:%d: unknown option '%s'\n", path, lineno, name );
+            exit( 1 );
+        }
+    }
+    fclose( fp );
+}
+
+//-----------------------------------------------------------------------------
+// Fills in options from the defaults, an optional config file and then the
+// command line
+//-----------------------------------------------------------------------------
+void options_parse( int argc, char **argv ) {
+    int i;
+
+    options.sphere_count = SPHERE_COUNT_DEFAULT;
+    options.seed = (unsigned int) time( NULL );
+    options.instancing = 1;
+    options.lod = 1;
+    options.lod_scale = 1.0f;
+    options.cull = 1;
+    options.pacing = PACE_VSYNC;
+    options.fps = PACE_FPS_DEFAULT;
+    options.width = 800;
+    options.height = 600;
+    options.bench = 0;
+    options.frame_log[0] = '\0';
+    options.trace[0] = '\0';
+    options.capture[0] = '\0';
+    options.record[0] = '\0';
+    options.replay[0] = '\0';
+    options.replay_fast = 0;
+    options.threads = (int) sysconf( _SC_NPROCESSORS_ONLN );
+    if( options.threads < 1 )
+        options.threads = 1;
+    options.sim_thread = 1;
+    options.shadow_size = OPTIONS_SHADOW_SIZE_DEFAULT;
+    options.reflection_scale = OPTIONS_REFLECTION_SCALE_DEFAULT;
+    options.renderer = RENDERER_CORE;
+    options.impostors = 0;
+    options.steps = 100000;
+
+    // The config file goes first so the command line can override it
+    for( i = 1; i < argc - 1; i++ ) {
+        if( !strcmp( argv[i], "--config" ) )
+            options_load( argv[i+1] );
+    }
+
+    for( i = 1; i < argc; i++ ) {
+        const char *arg = argv[i];
+
+        if( !strcmp( arg, "-n" ) )
+            arg = "--spheres";
+        if( strncmp( arg, "--", 2 ) != 0 || i + 1 >= argc )
+            usage( argv[0] );
+
+        if( !strcmp( arg, "--config" ) ) {
+            i++;
+            continue;
+        }
+        if( !options_set( arg + 2, argv[i+1] ) )
+            usage( argv[0] );
+        i++;
+    }
+}
@@ -0,0 +1,84 @@
+// options.h
+// Startup options. Defaults can be overridden by a config file, and the
+// config file by the command line:
+//
+//   -n, --spheres N     number of spheres in the game
+//   --seed N            random seed (default: the clock)
+//   --config FILE       read options from FILE
+//   --instancing 0|1    draw spheres with instancing when GL allows it
+//   --lod 0|1           pick sphere detail by distance
+//   --lod-scale F       multiplies the level of detail thresholds
+//   --cull 0|1          skip spheres outside the view of each pass
+//   --frame-log FILE    write frame time stats to FILE on exit (.json or CSV)
+//   --trace FILE        write a Chrome trace of the render passes to FILE
+//   --pacing MODE       uncapped, fixed, vsync or demand, see pacing.h
+//   --fps N             frame rate for fixed and demand pacing
+//   --width N           window width, and the framebuffer width for --bench
+//   --height N          window height, and the framebuffer height for --bench
+//   --bench N           render N frames offscreen, report timing and quit
+//   --capture PATTERN   save every frame to files named by PATTERN, see capture.h
+//   --record FILE       record the seed and every input to FILE, see replay.h
+//   --replay FILE       play FILE's inputs back instead of taking input
+//   --replay-fast 0|1   replay one simulation step per frame, unpaced,
+//                       rather than in real time
+//   --threads N         threads for the per sphere work (default: one per CPU)
+//   --sim-thread 0|1    run the simulation on its own thread, see simthread.h
+//   --shadow-size N     shadow map texels along each side, see shadowmap.h;
+//                       0 projects the spheres onto the floor instead
+//   --reflection-scale F  reflection texture size as a fraction of the
+//                       window, see reflection.h; 0 draws the reflection
+//                       straight into the frame instead
+//   --renderer NAME     core draws the spheres and the floor with GLSL 3.30
+//                       shaders, see pipeline.h; legacy with fixed function
+//   --impostors 0|1     draw spheres as ray cast quads, see sphereinst.h;
+//                       needs the core renderer
+//   --steps N           headless build: simulation steps to run
+//
+// Config files hold one "name = value" pair per line using the long option
+// names without the dashes. Lines starting with '#' are ignored.
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#define OPTIONS_MAX_SPHERES 4000000
+#define OPTIONS_PATH_MAX 256
+#define OPTIONS_SHADOW_SIZE_DEFAULT 1024
+#define OPTIONS_SHADOW_SIZE_MAX 8192
+#define OPTIONS_REFLECTION_SCALE_DEFAULT 0.5f
+
+// What --renderer picks from
+enum {
+    RENDERER_LEGACY,
+    RENDERER_CORE
+};
+
+struct Options_t {
+    int sphere_count;
+    unsigned int seed;
+    int instancing;
+    int lod;
+    float lod_scale;
+    int cull;
+    int pacing;             // PACE_* mode
+    int fps;
+    int width, height;
+    int bench;              // frames to render offscreen, 0 to play
+    char frame_log[OPTIONS_PATH_MAX];   // empty: no frame log
+    char trace[OPTIONS_PATH_MAX];       // empty: no pass trace
+    char capture[OPTIONS_PATH_MAX];     // empty: no frame capture
+    char record[OPTIONS_PATH_MAX];      // empty: don't record
+    char replay[OPTIONS_PATH_MAX];      // empty: play live
+    int replay_fast;
+    int threads;
+    int sim_thread;
+    int shadow_size;        // 0: projected shadows
+    float reflection_scale; // 0: no reflection texture
+    int renderer;           // RENDERER_*
+    int impostors;
+    int steps;              // headless only: simulation steps to run
+};
+
+extern struct Options_t options;
+
+void options_parse( int argc, char **argv );
+
+#endif
@@ -0,0 +1,91 @@
+// pacing.c
+// Frame pacing. See pacing.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pacing.h"
+#include "frametime.h"
+
+const char *pace_mode_names[PACE_MODES] = {
+    "uncapped", "fixed", "vsync", "demand"
+};
+
+static int pace_mode = PACE_VSYNC;
+static double period_ms = 1000.0 / PACE_FPS_DEFAULT;
+static double deadline_ms = -1.0;
+static int dirty = 1;
+
+//-----------------------------------------------------------------------------
+// Picks the pacing mode and, for fixed and demand, the target frame rate
+//-----------------------------------------------------------------------------
+void pace_init( int mode, int fps ) {
+    pace_mode = mode;
+    period_ms = 1000.0 / fps;
+    deadline_ms = -1.0;
+    dirty = 1;
+}
+
+//-----------------------------------------------------------------------------
+// Something visible changed (input, window events); demand mode draws the
+// next frame
+//-----------------------------------------------------------------------------
+void pace_mark_dirty( void ) {
+    dirty = 1;
+}
+
+//-----------------------------------------------------------------------------
+// Returns TRUE (1) if a frame should be drawn now. animating is TRUE while
+// the scene changes on its own. Only demand mode ever says no.
+//-----------------------------------------------------------------------------
+int pace_should_render( int animating ) {
+    int render;
+
+    if( pace_mode != PACE_ON_DEMAND )
+        return 1;
+
+    render = dirty || animating;
+    dirty = 0;
+
+    // Start a fresh schedule after sitting idle
+    if( !render )
+        deadline_ms = -1.0;
+    return render;
+}
+
+//-----------------------------------------------------------------------------
+// Blocks until the next frame is due. Sleeps for most of the wait, since
+// the scheduler can wake us late, and spins through the last PACE_SPIN_MS.
+//-----------------------------------------------------------------------------
+void pace_wait( void ) {
+    double now, left;
+    struct timespec ts;
+
+    if( pace_mode != PACE_FIXED && pace_mode != PACE_ON_DEMAND )
+        return;
+
+    now = frametime_now();
+    if( deadline_ms < 0.0 ) {
+        deadline_ms = now;
+        return;
+    }
+
+    deadline_ms += period_ms;
+
+    // Running more than a frame behind: don't rush out a burst of frames to
+    // catch up, just start over from now
+    if( now > deadline_ms + period_ms ) {
+        deadline_ms = now;
+        return;
+    }
+
+    left = deadline_ms - now - PACE_SPIN_MS;
+    if( left > 0.0 ) {
+        ts.tv_sec = (time_t) ( left / 1000.0 );
+        ts.tv_nsec = (long) ( ( left - ts.tv_sec * 1000.0 ) * 1000000.0 );
+        nanosleep( &ts, NULL );
+    }
+
+    while( frametime_now() < deadline_ms )
+        ;
+}
@@ -0,0 +1,33 @@
+// pacing.h
+// Frame pacing. Decides when the next frame gets drawn:
+//
+//   uncapped    as fast as possible
+//   fixed       at a target rate, waiting out the rest of each frame by
+//               sleeping and then spinning for the last PACE_SPIN_MS
+//   vsync       as fast as the buffer swap lets us (swap interval 1)
+//   demand      only when something changed, at most at the target rate
+//
+// Nothing in here touches GL or GLUT; the caller sets the swap interval
+// and posts the redisplays.
+#ifndef PACING_H
+#define PACING_H
+
+enum {
+    PACE_UNCAPPED,
+    PACE_FIXED,
+    PACE_VSYNC,
+    PACE_ON_DEMAND,
+    PACE_MODES
+};
+
+#define PACE_FPS_DEFAULT 60
+#define PACE_SPIN_MS 1.5    // sleeping is only trusted up to this close
+
+extern const char *pace_mode_names[PACE_MODES];
+
+void pace_init( int mode, int fps );
+void pace_mark_dirty( void );
+int pace_should_render( int animating );
+void pace_wait( void );
+
+#endif
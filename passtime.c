@@ -0,0 +1,234 @@
+// passtime.c
+// Per pass CPU and GPU timing. See passtime.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GL/glut.h>
+#include <GL/glext.h>
+
+#include "passtime.h"
+#include "frametime.h"
+#include "shader.h"
+
+const char *passtime_names[PASS_COUNT] = {
+    "player", "selection", "prepare", "shadow map", "stencil floor", "reflection",
+    "floor", "spheres", "shadows", "light", "hud", "capture"
+};
+
+// Chrome trace thread ids
+#define TRACE_TID_CPU 1
+#define TRACE_TID_GPU 2
+
+// The frame being drawn and the PASSTIME_LATENCY before it each have a set
+// of queries
+#define PASSTIME_SLOTS ( PASSTIME_LATENCY + 1 )
+
+static int gpu_timers = 0;
+
+// begin and end timestamp queries per pass, for each frame in flight
+static GLuint queries[PASSTIME_SLOTS][PASS_COUNT][2];
+static int issued[PASSTIME_SLOTS][PASS_COUNT];
+static int slot = 0;
+static int gpu_dropped = 0;     // frames whose results weren't in in time
+
+static double cpu_begin[PASS_COUNT];
+static int open_pass = -1;
+
+// window sums, published to the averages once full
+static double cpu_sum[PASS_COUNT], gpu_sum[PASS_COUNT];
+static int cpu_frames = 0, gpu_frames = 0;
+static double cpu_avg[PASS_COUNT], gpu_avg[PASS_COUNT];
+static int have_gpu_avg = 0;
+
+// trace output, timestamps are microseconds since passtime_init()
+static FILE *trace = NULL;
+static int trace_events = 0;
+static double trace_base_ms = 0.0;
+static GLint64 gpu_base_ns = 0;
+static double frame_begin_ms = -1.0;
+
+//-----------------------------------------------------------------------------
+// Sets up the timer queries if the GL has them. Needs a current context.
+//-----------------------------------------------------------------------------
+void passtime_init( void ) {
+    const char *ext = (const char*) glGetString( GL_EXTENSIONS );
+
+    gpu_timers = gl_version_at_least( 3, 3 ) ||
+                 ( ext && strstr( ext, "GL_ARB_timer_query" ) );
+    if( gpu_timers ) {
+        glGenQueries( PASSTIME_SLOTS * PASS_COUNT * 2, &queries[0][0][0] );
+
+        // Line the GPU clock up with ours so both land on one trace
+        glGetInteger64v( GL_TIMESTAMP, &gpu_base_ns );
+    }
+    trace_base_ms = frametime_now();
+}
+
+//-----------------------------------------------------------------------------
+// Appends one complete ("X") event to the trace
+//-----------------------------------------------------------------------------
+static void trace_event( const char *name, int tid, double start_us, double dur_us ) {
+    if( !trace )
+        return;
+    fprintf( trace, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                    "\"ts\":%.3f,\"dur\":%.3f}",
+             trace_events++ ? ",\n" : "", name, tid, start_us, dur_us );
+}
+
+//-----------------------------------------------------------------------------
+// Starts writing a Chrome trace to path. Returns FALSE (0) on failure.
+//-----------------------------------------------------------------------------
+int passtime_trace_open( const char *path ) {
+    trace = fopen( path, "w" );
+    if( !trace ) {
+        printf( "tron: can't write trace %s\n", path );
+        return 0;
+    }
+
+    fprintf( trace, "{\"traceEvents\":[\n" );
+    fprintf( trace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                    "\"args\":{\"name\":\"CPU\"}},\n", TRACE_TID_CPU );
+    fprintf( trace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                    "\"args\":{\"name\":\"GPU\"}}", TRACE_TID_GPU );
+    trace_events = 2;
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Finishes the trace file. GPU events still in flight are lost.
+//-----------------------------------------------------------------------------
+void passtime_trace_close( void ) {
+    if( !trace )
+        return;
+    fprintf( trace, "\n]}\n" );
+    fclose( trace );
+    trace = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Starts timing a pass
+//-----------------------------------------------------------------------------
+void passtime_begin( int pass ) {
+    open_pass = pass;
+    cpu_begin[pass] = frametime_now();
+    if( gpu_timers )
+        glQueryCounter( queries[slot][pass][0], GL_TIMESTAMP );
+}
+
+//-----------------------------------------------------------------------------
+// Stops timing a pass
+//-----------------------------------------------------------------------------
+void passtime_end( int pass ) {
+    double now = frametime_now();
+
+    if( pass != open_pass ) {
+        printf( "tron: pass %s ended without being started\n", passtime_names[pass] );
+        return;
+    }
+    open_pass = -1;
+
+    if( gpu_timers ) {
+        glQueryCounter( queries[slot][pass][1], GL_TIMESTAMP );
+        issued[slot][pass] = 1;
+    }
+
+    cpu_sum[pass] += now - cpu_begin[pass];
+    trace_event( passtime_names[pass], TRACE_TID_CPU,
+                 ( cpu_begin[pass] - trace_base_ms ) * 1000.0,
+                 ( now - cpu_begin[pass] ) * 1000.0 );
+}
+
+//-----------------------------------------------------------------------------
+// Reads back the oldest frame of queries. A frame whose results aren't in
+// yet is dropped and counted rather than waited on.
+//-----------------------------------------------------------------------------
+static void collect_gpu( int s ) {
+    GLuint available = 0;
+    int pass, any = 0;
+
+    for( pass = PASS_COUNT - 1; pass >= 0; pass-- ) {
+        if( issued[s][pass] ) {
+            // results come back in order, so the last pass decides
+            glGetQueryObjectuiv( queries[s][pass][1], GL_QUERY_RESULT_AVAILABLE, &available );
+            if( !available )
+                gpu_dropped++;
+            break;
+        }
+    }
+
+    for( pass = 0; pass < PASS_COUNT; pass++ ) {
+        GLuint64 begin, end;
+
+        if( !issued[s][pass] )
+            continue;
+        issued[s][pass] = 0;
+        if( !available )
+            continue;
+
+        glGetQueryObjectui64v( queries[s][pass][0], GL_QUERY_RESULT, &begin );
+        glGetQueryObjectui64v( queries[s][pass][1], GL_QUERY_RESULT, &end );
+        gpu_sum[pass] += ( end - begin ) / 1000000.0;
+        trace_event( passtime_names[pass], TRACE_TID_GPU,
+                     ( (GLint64) begin - gpu_base_ns ) / 1000.0,
+                     ( end - begin ) / 1000.0 );
+        any = 1;
+    }
+
+    if( any && ++gpu_frames >= PASSTIME_WINDOW ) {
+        for( pass = 0; pass < PASS_COUNT; pass++ ) {
+            gpu_avg[pass] = gpu_sum[pass] / gpu_frames;
+            gpu_sum[pass] = 0.0;
+        }
+        gpu_frames = 0;
+        have_gpu_avg = 1;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Marks the end of a frame: updates the averages and moves on to the next
+// set of queries, reading back the frame PASSTIME_LATENCY before this one
+// that last used them
+//-----------------------------------------------------------------------------
+void passtime_frame( void ) {
+    double now = frametime_now();
+    int pass;
+
+    if( frame_begin_ms >= 0.0 ) {
+        trace_event( "frame", TRACE_TID_CPU, ( frame_begin_ms - trace_base_ms ) * 1000.0,
+                     ( now - frame_begin_ms ) * 1000.0 );
+    }
+    frame_begin_ms = now;
+
+    if( ++cpu_frames >= PASSTIME_WINDOW ) {
+        for( pass = 0; pass < PASS_COUNT; pass++ ) {
+            cpu_avg[pass] = cpu_sum[pass] / cpu_frames;
+            cpu_sum[pass] = 0.0;
+        }
+        cpu_frames = 0;
+    }
+
+    if( gpu_timers ) {
+        slot = ( slot + 1 ) % PASSTIME_SLOTS;
+        collect_gpu( slot );
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Average pass times in milliseconds. Returns FALSE (0) when there are no
+// GPU times (yet), in which case gpu_ms is left alone.
+//-----------------------------------------------------------------------------
+int passtime_average( int pass, double* cpu_ms, double* gpu_ms ) {
+    *cpu_ms = cpu_avg[pass];
+    if( !have_gpu_avg )
+        return 0;
+    *gpu_ms = gpu_avg[pass];
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Frames of GPU times dropped so far because they weren't in PASSTIME_LATENCY
+// frames later
+//-----------------------------------------------------------------------------
+int passtime_dropped( void ) {
+    return gpu_dropped;
+}
@@ -0,0 +1,46 @@
+// passtime.h
+// Per pass timing for render(). Each pass is bracketed with passtime_begin()
+// and passtime_end(), which take a CPU timestamp and, when the GL has timer
+// queries (3.3 or ARB_timer_query), a GPU timestamp. GPU results are read
+// back PASSTIME_LATENCY frames later so the queries never stall the
+// pipeline; a frame whose results still aren't in by then is dropped, and
+// counted by passtime_dropped().
+//
+// Averages over the last PASSTIME_WINDOW frames feed the HUD overlay, and
+// every pass can also be written out as a Chrome trace_event JSON file
+// (load it in chrome://tracing or Perfetto).
+#ifndef PASSTIME_H
+#define PASSTIME_H
+
+// Passes in the order render() runs them. Passes must not nest.
+enum {
+    PASS_PLAYER,            // the bike
+    PASS_SELECTION,         // crosshair picking prepass
+    PASS_PREPARE,           // distances, level of detail, culling, instances
+    PASS_SHADOW_MAP,        // shadow casters' depth from the light
+    PASS_STENCIL_FLOOR,     // floor into the stencil buffer
+    PASS_REFLECTION,        // mirrored spheres
+    PASS_FLOOR,             // floor bottom and blended top
+    PASS_SPHERES,           // spheres and their highlight
+    PASS_SHADOWS,           // shadows on the floor
+    PASS_LIGHT,             // light marker
+    PASS_HUD,               // crosshair, text and this overlay
+    PASS_CAPTURE,           // frame readback for --capture
+    PASS_COUNT
+};
+
+#define PASSTIME_LATENCY 4      // frames before GPU times are read back
+#define PASSTIME_WINDOW 60      // frames averaged for the overlay
+
+extern const char *passtime_names[PASS_COUNT];
+
+void passtime_init( void );
+int passtime_trace_open( const char *path );
+void passtime_trace_close( void );
+void passtime_begin( int pass );
+void passtime_end( int pass );
+void passtime_frame( void );
+int passtime_average( int pass, double* cpu_ms, double* gpu_ms );
+int passtime_dropped( void );
+
+#endif
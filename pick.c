@@ -0,0 +1,238 @@
+// pick.c
+// CPU ray-sphere picking. See pick.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "pick.h"
+#include "matrix.h"
+#include "view.h"
+#include "simthread.h"
+#include "jobs.h"
+
+// Spheres per picking job
+#define PICK_CHUNK JOBS_SPHERE_GRAIN
+
+// nearest hit per chunk
+static int *chunk_nearest = NULL;
+static float *chunk_best = NULL;
+static int chunk_capacity = 0;
+
+//-----------------------------------------------------------------------------
+// Builds a world space ray from the camera through a point given in
+// normalized device coordinates (-1..1, 0,0 is the crosshair).
+//-----------------------------------------------------------------------------
+void pick_ray( const struct ThirdPersonCamera_t* cam, float ndc_x, float ndc_y,
+               float aspect, struct Ray_t* ray ) {
+    float view[16], inv[16];
+    float tan_half = tan( PICK_FOVY * 3.141592654f / 360.0f );
+    struct Vector3 eye = { 0.0f, 0.0f, 0.0f };
+    struct Vector3 dir;
+    float len;
+
+    camera_view_matrix( cam, view );
+    mat4_invert( inv, view );
+
+    // Direction in eye space, at depth 1 along -z
+    dir.x = ndc_x * tan_half * aspect;
+    dir.y = ndc_y * tan_half;
+    dir.z = -1.0f;
+    len = sqrt( dir.x*dir.x + dir.y*dir.y + dir.z*dir.z );
+
+    mat4_transform_point( inv, &eye, &ray->origin );
+    mat4_transform_dir( inv, &dir, &ray->dir );
+    ray->dir.x /= len;
+    ray->dir.y /= len;
+    ray->dir.z /= len;
+
+    // Clip to the same near and far planes the selection pass used
+    ray->tmin = PICK_NEAR * len;
+    ray->tmax = PICK_FAR * len;
+}
+
+//-----------------------------------------------------------------------------
+// Scalar ray-sphere test. Returns TRUE (1) and the entry distance on a hit.
+//-----------------------------------------------------------------------------
+static int ray_sphere( const struct Ray_t* ray, float cx, float cy, float cz,
+                       float r, float* t_out ) {
+    float ocx = cx - ray->origin.x;
+    float ocy = cy - ray->origin.y;
+    float ocz = cz - ray->origin.z;
+    float b = ocx * ray->dir.x + ocy * ray->dir.y + ocz * ray->dir.z;
+    float c = ocx*ocx + ocy*ocy + ocz*ocz - r*r;
+    float disc = b*b - c;
+    float sq, t;
+
+    if( r <= 0.0f || disc < 0.0f )
+        return 0;
+
+    // Take the near intersection unless we're inside the sphere
+    sq = sqrt( disc );
+    t = b - sq;
+    if( t < ray->tmin )
+        t = b + sq;
+    if( t < ray->tmin || t > ray->tmax )
+        return 0;
+
+    *t_out = t;
+    return 1;
+}
+
+#ifdef __SSE__
+//-----------------------------------------------------------------------------
+// Tests four spheres at once. Fills t[] and returns a bitmask of the lanes
+// that hit.
+//-----------------------------------------------------------------------------
+static int ray_sphere4( const struct Ray_t* ray, __m128 cx, __m128 cy, __m128 cz,
+                        __m128 r, float t[4] ) {
+    __m128 ocx = _mm_sub_ps( cx, _mm_set1_ps( ray->origin.x ) );
+    __m128 ocy = _mm_sub_ps( cy, _mm_set1_ps( ray->origin.y ) );
+    __m128 ocz = _mm_sub_ps( cz, _mm_set1_ps( ray->origin.z ) );
+    __m128 tmin = _mm_set1_ps( ray->tmin );
+    __m128 tmax = _mm_set1_ps( ray->tmax );
+    __m128 b, c, disc, sq, tnear, tfar, tsel, use_near, hit;
+
+    b = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ocx, _mm_set1_ps( ray->dir.x ) ),
+                                _mm_mul_ps( ocy, _mm_set1_ps( ray->dir.y ) ) ),
+                    _mm_mul_ps( ocz, _mm_set1_ps( ray->dir.z ) ) );
+    c = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( ocx, ocx ), _mm_mul_ps( ocy, ocy ) ),
+                                _mm_mul_ps( ocz, ocz ) ),
+                    _mm_mul_ps( r, r ) );
+    disc = _mm_sub_ps( _mm_mul_ps( b, b ), c );
+
+    sq = _mm_sqrt_ps( _mm_max_ps( disc, _mm_setzero_ps() ) );
+    tnear = _mm_sub_ps( b, sq );
+    tfar = _mm_add_ps( b, sq );
+    use_near = _mm_cmpge_ps( tnear, tmin );
+    tsel = _mm_or_ps( _mm_and_ps( use_near, tnear ), _mm_andnot_ps( use_near, tfar ) );
+
+    hit = _mm_and_ps( _mm_cmpge_ps( disc, _mm_setzero_ps() ),
+                      _mm_cmpgt_ps( r, _mm_setzero_ps() ) );
+    hit = _mm_and_ps( hit, _mm_cmpge_ps( tsel, tmin ) );
+    hit = _mm_and_ps( hit, _mm_cmple_ps( tsel, tmax ) );
+
+    _mm_storeu_ps( t, tsel );
+    return _mm_movemask_ps( hit );
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Finds the closest of spheres [begin, end) along the ray. Gives back its
+// index, or -1 if the ray misses them all, and the ray parameter of the hit.
+//-----------------------------------------------------------------------------
+static void nearest_range( const struct Ray_t* ray, int begin, int end,
+                           int* nearest_out, float* best_out ) {
+    int i = begin, nearest = -1;
+    float best = ray->tmax, t;
+
+#ifdef __SSE__
+    // The arrays are padded and aligned and ranges split on batches, so run
+    // straight to the end of the range. The padding has size 0 and never
+    // hits.
+    for( ; i < end; i += 4 ) {
+        float t4[4];
+        int mask, lane;
+
+        // Spheres are drawn mirrored in x and z, see spheres_render()
+        mask = ray_sphere4( ray,
+                   _mm_xor_ps( _mm_load_ps( view.spheres.x + i ), _mm_set1_ps( -0.0f ) ),
+                   _mm_load_ps( view.spheres.y + i ),
+                   _mm_xor_ps( _mm_load_ps( view.spheres.z + i ), _mm_set1_ps( -0.0f ) ),
+                   _mm_load_ps( view.spheres.size + i ),
+                   t4 );
+
+        for( lane = 0; mask; lane++, mask >>= 1 ) {
+            if( ( mask & 1 ) && t4[lane] < best ) {
+                best = t4[lane];
+                nearest = i + lane;
+            }
+        }
+    }
+#endif
+
+    // Scalar path for builds without SSE
+    for( ; i < end && i < view.spheres.count; i++ ) {
+        if( ray_sphere( ray, -view.spheres.x[i], view.spheres.y[i], -view.spheres.z[i],
+                        view.spheres.size[i], &t ) && t < best ) {
+            best = t;
+            nearest = i;
+        }
+    }
+
+    *nearest_out = nearest;
+    *best_out = best;
+}
+
+//-----------------------------------------------------------------------------
+// Finds the nearest hit in chunks [begin, end) of PICK_CHUNK spheres, a job
+// for pick_nearest_sphere()
+//-----------------------------------------------------------------------------
+static void nearest_chunks( void* arg, int begin, int end, int worker ) {
+    const struct Ray_t* ray = arg;
+    int c;
+
+    for( c = begin; c < end; c++ ) {
+        int first = c * PICK_CHUNK;
+        int last = first + PICK_CHUNK < view.spheres.capacity ? first + PICK_CHUNK : view.spheres.capacity;
+
+        nearest_range( ray, first, last, &chunk_nearest[c], &chunk_best[c] );
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Finds the closest sphere along the ray. Returns its index, or -1 if the ray
+// misses everything. Chunks are searched in parallel and combined in order,
+// so ties go to the lowest index just like a serial scan.
+//-----------------------------------------------------------------------------
+int pick_nearest_sphere( const struct Ray_t* ray, float* t_hit ) {
+    int chunks = ( view.spheres.capacity + PICK_CHUNK - 1 ) / PICK_CHUNK;
+    int nearest = -1, c;
+    float best = ray->tmax;
+
+    if( chunk_capacity < chunks ) {
+        free( chunk_nearest );
+        free( chunk_best );
+        chunk_capacity = chunks;
+        chunk_nearest = malloc( sizeof( int ) * chunks );
+        chunk_best = malloc( sizeof( float ) * chunks );
+        if( !chunk_nearest || !chunk_best ) {
+            printf( "tron: Sorry, out of memory for picking.\n" );
+            exit( 1 );
+        }
+    }
+
+    jobs_parallel_for( chunks, 1, nearest_chunks, (void*) ray );
+
+    for( c = 0; c < chunks; c++ ) {
+        if( chunk_nearest[c] >= 0 && chunk_best[c] < best ) {
+            best = chunk_best[c];
+            nearest = chunk_nearest[c];
+        }
+    }
+
+    if( nearest >= 0 && t_hit )
+        *t_hit = best;
+
+    return nearest;
+}
+
+//-----------------------------------------------------------------------------
+// Picks the sphere under the crosshair and marks it selected. Outside of
+// preselect mode the selection is also shot. Returns the index or -1.
+//-----------------------------------------------------------------------------
+int pick_crosshair( float aspect, int preselect ) {
+    struct Ray_t ray;
+    int hit;
+
+    pick_ray( &view.camera, 0.0f, 0.0f, aspect, &ray );
+    hit = pick_nearest_sphere( &ray, NULL );
+    view_select( hit );
+
+    if( !preselect && hit >= 0 )
+        input_kill( hit );
+
+    return hit;
+}
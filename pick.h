@@ -0,0 +1,29 @@
+// pick.h
+// Analytic sphere picking. Casts a ray from the camera through a point on
+// the screen and intersects it with the sphere bounds on the CPU, replacing
+// the old GL_SELECT render pass.
+#ifndef PICK_H
+#define PICK_H
+
+#include "sim.h"
+
+// Projection the crosshair is picked with
+#define PICK_FOVY 45.0f
+#define PICK_NEAR 0.1f
+#define PICK_FAR 500.0f
+
+//-----------------------------------------------------------------------------
+// Ray in world space. dir is unit length, hits are accepted in [tmin, tmax].
+//-----------------------------------------------------------------------------
+struct Ray_t {
+    struct Vector3 origin;
+    struct Vector3 dir;
+    float tmin, tmax;
+};
+
+void pick_ray( const struct ThirdPersonCamera_t* cam, float ndc_x, float ndc_y,
+               float aspect, struct Ray_t* ray );
+int pick_nearest_sphere( const struct Ray_t* ray, float* t_hit );
+int pick_crosshair( float aspect, int preselect );
+
+#endif
@@ -0,0 +1,165 @@
+// pipeline.c
+// Uniform blocks for the shader render path. See pipeline.h.
+#include <stdio.h>
+#include <string.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "pipeline.h"
+#include "shader.h"
+#include "matrix.h"
+#include "sphereinst.h"
+#include "floor.h"
+
+int pipeline_core = 0;
+struct Pipeline_t pipeline;
+
+//-----------------------------------------------------------------------------
+// Makes one uniform buffer of size bytes and binds it to its binding point
+//-----------------------------------------------------------------------------
+static void block_create( int binding, GLsizeiptr size, const void* data ) {
+    glGenBuffers( 1, &pipeline.buffers[binding] );
+    glBindBuffer( GL_UNIFORM_BUFFER, pipeline.buffers[binding] );
+    glBufferData( GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW );
+    glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+    glBindBufferBase( GL_UNIFORM_BUFFER, binding, pipeline.buffers[binding] );
+}
+
+//-----------------------------------------------------------------------------
+// Writes size bytes of data at the start of a block's buffer
+//-----------------------------------------------------------------------------
+static void block_update( int binding, GLsizeiptr size, const void* data ) {
+    glBindBuffer( GL_UNIFORM_BUFFER, pipeline.buffers[binding] );
+    glBufferSubData( GL_UNIFORM_BUFFER, 0, size, data );
+    glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Sets up the blocks and the programs that read them. The light's colors
+// and the material are taken from the fixed function state as init() left
+// it, so both paths light the spheres the same. Returns FALSE (0) and
+// leaves pipeline_core off if the driver can't do it.
+//-----------------------------------------------------------------------------
+int pipeline_init( void ) {
+    struct PipelineMaterial_t material;
+
+    pipeline_core = 0;
+    memset( &pipeline, 0, sizeof( pipeline ) );
+
+    if( !gl_version_at_least( 3, 3 ) || !sphere_instancing ) {
+        printf( "tron: GL 3.3 or sphere instancing not available, using the fixed function renderer.\n" );
+        return 0;
+    }
+
+    glGetLightfv( GL_LIGHT0, GL_AMBIENT, pipeline.light.ambient );
+    glGetLightfv( GL_LIGHT0, GL_DIFFUSE, pipeline.light.diffuse );
+    glGetLightfv( GL_LIGHT0, GL_SPECULAR, pipeline.light.specular );
+    glGetFloatv( GL_LIGHT_MODEL_AMBIENT, pipeline.light.scene_ambient );
+
+    memset( &material, 0, sizeof( material ) );
+    glGetMaterialfv( GL_FRONT, GL_EMISSION, material.emission );
+    glGetMaterialfv( GL_FRONT, GL_AMBIENT, material.ambient );
+    glGetMaterialfv( GL_FRONT, GL_DIFFUSE, material.diffuse );
+    glGetMaterialfv( GL_FRONT, GL_SPECULAR, material.specular );
+    glGetMaterialfv( GL_FRONT, GL_SHININESS, &material.shininess );
+
+    mat4_identity( pipeline.camera.projection );
+    mat4_identity( pipeline.camera.view );
+    mat4_identity( pipeline.model );
+    mat4_identity( pipeline.modelview );
+    pipeline.color[0] = pipeline.color[1] = pipeline.color[2] = pipeline.color[3] = 1.0f;
+
+    block_create( PIPELINE_CAMERA_BINDING, sizeof( pipeline.camera ), &pipeline.camera );
+    block_create( PIPELINE_LIGHT_BINDING, sizeof( pipeline.light ), &pipeline.light );
+    block_create( PIPELINE_MATERIAL_BINDING, sizeof( material ), &material );
+
+    if( !sphere_instancing_core_init() || !floor_core_init() ) {
+        pipeline_shutdown();
+        return 0;
+    }
+
+    pipeline_core = 1;
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Points a program's blocks, whichever of them it uses, at the buffers
+//-----------------------------------------------------------------------------
+void pipeline_program( GLuint program ) {
+    static const char *names[3] = { "Camera", "Light", "Material" };
+    GLuint index;
+    int b;
+
+    for( b = 0; b < 3; b++ ) {
+        index = glGetUniformBlockIndex( program, names[b] );
+        if( index != GL_INVALID_INDEX )
+            glUniformBlockBinding( program, index, b );
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Sets the matrices and viewport the draws that follow go through. The
+// model is kept, so its modelview is worked out again.
+//-----------------------------------------------------------------------------
+void pipeline_camera( const float projection[16], const float view[16],
+                      const GLint viewport[4] ) {
+    int k;
+
+    mat4_copy( pipeline.camera.projection, projection );
+    mat4_copy( pipeline.camera.view, view );
+    for( k = 0; k < 4; k++ )
+        pipeline.camera.viewport[k] = (GLfloat) viewport[k];
+    mat4_multiply( pipeline.modelview, pipeline.camera.view, pipeline.model );
+
+    if( pipeline_core )
+        block_update( PIPELINE_CAMERA_BINDING, sizeof( pipeline.camera ), &pipeline.camera );
+}
+
+//-----------------------------------------------------------------------------
+// Moves the light, in world space
+//-----------------------------------------------------------------------------
+void pipeline_light_position( const float position[4] ) {
+    memcpy( pipeline.light.position, position, sizeof( pipeline.light.position ) );
+    if( pipeline_core )
+        block_update( PIPELINE_LIGHT_BINDING, sizeof( pipeline.light.position ),
+                      pipeline.light.position );
+}
+
+//-----------------------------------------------------------------------------
+// Sets the model transform of the draws that follow; NULL for none
+//-----------------------------------------------------------------------------
+void pipeline_model( const float model[16] ) {
+    if( model )
+        mat4_copy( pipeline.model, model );
+    else
+        mat4_identity( pipeline.model );
+    mat4_multiply( pipeline.modelview, pipeline.camera.view, pipeline.model );
+}
+
+//-----------------------------------------------------------------------------
+// Sets the color of the unlit draws that follow. The fixed function color
+// is kept in step, so either path draws the same.
+//-----------------------------------------------------------------------------
+void pipeline_color( float r, float g, float b, float a ) {
+    pipeline.color[0] = r;
+    pipeline.color[1] = g;
+    pipeline.color[2] = b;
+    pipeline.color[3] = a;
+    glColor4f( r, g, b, a );
+}
+
+//-----------------------------------------------------------------------------
+// Releases the buffers and the programs
+//-----------------------------------------------------------------------------
+void pipeline_shutdown( void ) {
+    int b;
+
+    sphere_instancing_core_shutdown();
+    floor_core_shutdown();
+    for( b = 0; b < 3; b++ ) {
+        if( pipeline.buffers[b] )
+            glDeleteBuffers( 1, &pipeline.buffers[b] );
+        pipeline.buffers[b] = 0;
+    }
+    pipeline_core = 0;
+}
@@ -0,0 +1,100 @@
+// pipeline.h
+// The shader render path. The spheres (sphereinst.c) and the floor
+// (floor.c) are drawn with GLSL 3.30 core programs that read the fixed
+// function state they used to get from GL out of three uniform blocks:
+//
+//   Camera      projection and view matrices, built on the CPU (matrix.h),
+//               and the viewport
+//   Light       GL_LIGHT0 in world space: position and colors
+//   Material    the spheres' material
+//
+// Each draw adds only its model matrix and, when unlit, its color. The
+// light stays in world space and is turned into eye space with the model
+// and view of each draw, so the reflection is the same draw under the
+// mirror and nothing has to be given to GL again for it.
+//
+// Picked at startup with --renderer (options.h). Needs GL 3.3 and sphere
+// instancing; without them the fixed function path draws everything as
+// before. This is a partial port: the bike, the light marker and the HUD
+// are still fixed function either way, so the context stays a
+// compatibility one and the GL matrix stack is still kept up for them.
+// Nothing on the shader path reads it back, though; culling, the floor and
+// the reflection's cache take their matrices from here.
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <GL/glut.h>
+
+// Uniform buffer binding points, one per block
+#define PIPELINE_CAMERA_BINDING 0
+#define PIPELINE_LIGHT_BINDING 1
+#define PIPELINE_MATERIAL_BINDING 2
+
+// The blocks as every program declares them, for pasting into shader source
+#define PIPELINE_BLOCKS_GLSL \
+    "layout(std140) uniform Camera {\n" \
+    "    mat4 projection;\n" \
+    "    mat4 view;\n" \
+    "    vec4 viewport;\n" \
+    "} camera;\n" \
+    "layout(std140) uniform Light {\n" \
+    "    vec4 position;\n" \
+    "    vec4 ambient;\n" \
+    "    vec4 diffuse;\n" \
+    "    vec4 specular;\n" \
+    "    vec4 scene_ambient;\n" \
+    "} light;\n" \
+    "layout(std140) uniform Material {\n" \
+    "    vec4 emission;\n" \
+    "    vec4 ambient;\n" \
+    "    vec4 diffuse;\n" \
+    "    vec4 specular;\n" \
+    "    float shininess;\n" \
+    "} material;\n"
+
+// std140 layouts of the blocks
+struct PipelineCamera_t {
+    GLfloat projection[16];
+    GLfloat view[16];
+    GLfloat viewport[4];
+};
+
+struct PipelineLight_t {
+    GLfloat position[4];        // world space, w 0 for directional
+    GLfloat ambient[4];
+    GLfloat diffuse[4];
+    GLfloat specular[4];
+    GLfloat scene_ambient[4];   // the light model's
+};
+
+struct PipelineMaterial_t {
+    GLfloat emission[4];
+    GLfloat ambient[4];
+    GLfloat diffuse[4];
+    GLfloat specular[4];
+    GLfloat shininess;
+    GLfloat pad[3];
+};
+
+struct Pipeline_t {
+    GLuint buffers[3];          // one per binding point
+    struct PipelineCamera_t camera;
+    struct PipelineLight_t light;
+    float model[16];            // model transform of the draws that follow
+    float modelview[16];        // camera.view * model
+    float color[4];             // color of the unlit draws that follow
+};
+
+extern int pipeline_core;       // TRUE once pipeline_init succeeded
+extern struct Pipeline_t pipeline;
+
+int pipeline_init( void );
+void pipeline_program( GLuint program );
+void pipeline_camera( const float projection[16], const float view[16],
+                      const GLint viewport[4] );
+void pipeline_light_position( const float position[4] );
+void pipeline_model( const float model[16] );
+void pipeline_color( float r, float g, float b, float a );
+void pipeline_shutdown( void );
+
+#endif
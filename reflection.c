@@ -0,0 +1,286 @@
+// reflection.c
+// Cached, reduced resolution floor reflection. See reflection.h.
+#include <stdio.h>
+#include <string.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "reflection.h"
+#include "shader.h"
+#include "glstate.h"
+#include "matrix.h"
+#include "cull.h"
+#include "renderqueue.h"
+#include "shadowmap.h"
+#include "view.h"
+#include "pipeline.h"
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+int reflection_texturing = 0;
+struct Reflection_t reflection;
+
+//-----------------------------------------------------------------------------
+// Creates the framebuffer; the texture and depth buffer get their size on
+// the first frame. Returns FALSE (0) and leaves reflection_texturing off
+// if scale is 0 or the driver can't do it.
+//-----------------------------------------------------------------------------
+int reflection_init( float scale ) {
+    reflection_texturing = 0;
+    if( scale <= 0.0f )
+        return 0;
+
+    if( !gl_version_at_least( 3, 0 ) ) {
+        printf( "tron: GL 3.0 not available, drawing the reflection every frame.\n" );
+        return 0;
+    }
+
+    memset( &reflection, 0, sizeof( reflection ) );
+    reflection.scale = scale;
+    glGenFramebuffers( 1, &reflection.framebuffer );
+    glGenTextures( 1, &reflection.texture );
+    glGenRenderbuffers( 1, &reflection.depth );
+
+    reflection_texturing = 1;
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// (Re)allocates the texture and depth buffer at width by height. Returns
+// FALSE (0) if the framebuffer can't be completed; the reflection is drawn
+// straight into the frame from then on.
+//-----------------------------------------------------------------------------
+static int reflection_resize( int width, int height ) {
+    GLint saved_texture;
+    GLenum status;
+
+    glGetIntegerv( GL_TEXTURE_BINDING_2D, &saved_texture );
+    glBindTexture( GL_TEXTURE_2D, reflection.texture );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+    glBindTexture( GL_TEXTURE_2D, saved_texture );
+
+    glBindRenderbuffer( GL_RENDERBUFFER, reflection.depth );
+    glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height );
+    glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+    glBindFramebuffer( GL_FRAMEBUFFER, reflection.framebuffer );
+    glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                            reflection.texture, 0 );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+                               reflection.depth );
+    status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+    glBindFramebuffer( GL_FRAMEBUFFER, reflection.saved_framebuffer );
+
+    if( status != GL_FRAMEBUFFER_COMPLETE ) {
+        printf( "tron: reflection framebuffer incomplete (0x%x), drawing the reflection every frame.\n",
+                status );
+        reflection_shutdown();
+        return 0;
+    }
+
+    reflection.width = width;
+    reflection.height = height;
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// FNV-1a over n bytes, carrying on from h
+//-----------------------------------------------------------------------------
+static unsigned int hash_bytes( unsigned int h, const void* data, size_t n ) {
+    const unsigned char* p = data;
+
+    while( n-- ) {
+        h ^= *p++;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+//-----------------------------------------------------------------------------
+// Hashes which spheres a pass draws and everything about them that shows
+//-----------------------------------------------------------------------------
+static unsigned int hash_queue( unsigned int h, int list ) {
+    const struct RenderQueue_t* q = &render_queues[list];
+    int n, i;
+
+    for( n = 0; n < q->count; n++ ) {
+        i = q->items[n].sphere;
+        h = hash_bytes( h, &i, sizeof( i ) );
+        h = hash_bytes( h, &view.spheres.y[i], sizeof( float ) );
+        h = hash_bytes( h, &view.spheres.size[i], sizeof( float ) );
+        h = hash_bytes( h, &view.spheres.lod[i], 1 );
+    }
+    return h;
+}
+
+//-----------------------------------------------------------------------------
+// Starts drawing the reflection with the current, mirrored, modelview and
+// the light at light; the shader pipeline's camera and model when it's on. Returns FALSE (0) if the texture from an earlier
+// frame still shows exactly this; skip drawing and reflection_end() then.
+// Otherwise the texture is bound for drawing, cleared, until
+// reflection_end(). If the texture can't be had reflection_texturing goes
+// off and the reflection is drawn straight into the frame. Needs this
+// frame's render queues.
+//-----------------------------------------------------------------------------
+int reflection_begin( const float light[4] ) {
+    float modelview[16], projection[16];
+    GLint viewport[4];
+    unsigned int h;
+    int width, height, k;
+
+    if( pipeline_core ) {
+        mat4_copy( modelview, pipeline.modelview );
+        mat4_copy( projection, pipeline.camera.projection );
+        for( k = 0; k < 4; k++ )
+            viewport[k] = (GLint) pipeline.camera.viewport[k];
+    } else {
+        glGetFloatv( GL_MODELVIEW_MATRIX, modelview );
+        glGetFloatv( GL_PROJECTION_MATRIX, projection );
+        glGetIntegerv( GL_VIEWPORT, viewport );
+    }
+
+    h = hash_queue( FNV_OFFSET, CULL_REFLECTION );
+    if( shadow_mapping ) {
+        h = hash_bytes( h, shadow_map.texture_matrix, sizeof( shadow_map.texture_matrix ) );
+        h = hash_queue( h, CULL_SHADOW );
+    }
+
+    reflection.reused = reflection.valid && h == reflection.spheres &&
+        !memcmp( modelview, reflection.modelview, sizeof( modelview ) ) &&
+        !memcmp( projection, reflection.projection, sizeof( projection ) ) &&
+        !memcmp( light, reflection.light, sizeof( reflection.light ) ) &&
+        !memcmp( viewport, reflection.viewport, sizeof( viewport ) );
+    if( reflection.reused )
+        return 0;
+
+    glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &reflection.saved_framebuffer );
+
+    width = (int) ( viewport[2] * reflection.scale );
+    height = (int) ( viewport[3] * reflection.scale );
+    if( width < 1 )
+        width = 1;
+    if( height < 1 )
+        height = 1;
+    if( ( width != reflection.width || height != reflection.height ) &&
+        !reflection_resize( width, height ) )
+        return 1;
+
+    reflection.valid = 1;
+    reflection.spheres = h;
+    memcpy( reflection.modelview, modelview, sizeof( modelview ) );
+    memcpy( reflection.projection, projection, sizeof( projection ) );
+    memcpy( reflection.light, light, sizeof( reflection.light ) );
+    memcpy( reflection.viewport, viewport, sizeof( viewport ) );
+    memcpy( reflection.saved_viewport, viewport, sizeof( viewport ) );
+
+    glBindFramebuffer( GL_FRAMEBUFFER, reflection.framebuffer );
+    glViewport( 0, 0, width, height );
+    glstate_disable( GL_STENCIL_TEST );
+    glstate_depth_mask( GL_TRUE );
+    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Back to the frame
+//-----------------------------------------------------------------------------
+void reflection_end( void ) {
+    glBindFramebuffer( GL_FRAMEBUFFER, reflection.saved_framebuffer );
+    glViewport( reflection.saved_viewport[0], reflection.saved_viewport[1],
+                reflection.saved_viewport[2], reflection.saved_viewport[3] );
+    glstate_enable( GL_STENCIL_TEST );
+}
+
+//-----------------------------------------------------------------------------
+// Sets texture unit GL_TEXTURE0 + unit up to lay the reflection under the
+// floor drawn with the units before it: their color over the reflection
+// by their alpha, as the floor's top used to be blended over the
+// reflection drawn into the frame. The reflection is placed by where each
+// pixel lands on screen. Leaves unit 0 active.
+//-----------------------------------------------------------------------------
+void reflection_blend_begin( int unit ) {
+    static const float bias[16] = {
+        0.5f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.5f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.5f, 0.0f,
+        0.5f, 0.5f, 0.5f, 1.0f
+    };
+    static const GLenum coords[4] = { GL_S, GL_T, GL_R, GL_Q };
+    static const GLenum gens[4] = {
+        GL_TEXTURE_GEN_S, GL_TEXTURE_GEN_T, GL_TEXTURE_GEN_R, GL_TEXTURE_GEN_Q
+    };
+    float m[16], projection[16];
+    GLfloat plane[4];
+    int k;
+
+    glGetFloatv( GL_PROJECTION_MATRIX, projection );
+    mat4_multiply( m, bias, projection );
+
+    glActiveTexture( GL_TEXTURE0 + unit );
+
+    // Eye planes are taken through the modelview current when they're set,
+    // so with none they're eye space as given
+    glPushMatrix();
+    glLoadIdentity();
+    for( k = 0; k < 4; k++ ) {
+        plane[0] = m[k];
+        plane[1] = m[4 + k];
+        plane[2] = m[8 + k];
+        plane[3] = m[12 + k];
+        glTexGeni( coords[k], GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR );
+        glTexGenfv( coords[k], GL_EYE_PLANE, plane );
+        glEnable( gens[k] );
+    }
+    glPopMatrix();
+
+    glBindTexture( GL_TEXTURE_2D, reflection.texture );
+    glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE );
+    glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_INTERPOLATE );
+    glTexEnvi( GL_TEXTURE_ENV, GL_SRC0_RGB, GL_PREVIOUS );
+    glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_RGB, GL_SRC_COLOR );
+    glTexEnvi( GL_TEXTURE_ENV, GL_SRC1_RGB, GL_TEXTURE );
+    glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND1_RGB, GL_SRC_COLOR );
+    glTexEnvi( GL_TEXTURE_ENV, GL_SRC2_RGB, GL_PREVIOUS );
+    glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND2_RGB, GL_SRC_ALPHA );
+    glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_REPLACE );
+    glTexEnvi( GL_TEXTURE_ENV, GL_SRC0_ALPHA, GL_PREVIOUS );
+    glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_SRC_ALPHA );
+
+    // glstate only follows unit 0
+    glEnable( GL_TEXTURE_2D );
+    glActiveTexture( GL_TEXTURE0 );
+}
+
+//-----------------------------------------------------------------------------
+// Turns the unit reflection_blend_begin() set up back off
+//-----------------------------------------------------------------------------
+void reflection_blend_end( int unit ) {
+    glActiveTexture( GL_TEXTURE0 + unit );
+    glDisable( GL_TEXTURE_GEN_S );
+    glDisable( GL_TEXTURE_GEN_T );
+    glDisable( GL_TEXTURE_GEN_R );
+    glDisable( GL_TEXTURE_GEN_Q );
+    glDisable( GL_TEXTURE_2D );
+    glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+    glActiveTexture( GL_TEXTURE0 );
+}
+
+//-----------------------------------------------------------------------------
+// Releases the texture, depth buffer and framebuffer
+//-----------------------------------------------------------------------------
+void reflection_shutdown( void ) {
+    if( reflection.framebuffer )
+        glDeleteFramebuffers( 1, &reflection.framebuffer );
+    if( reflection.texture )
+        glDeleteTextures( 1, &reflection.texture );
+    if( reflection.depth )
+        glDeleteRenderbuffers( 1, &reflection.depth );
+    memset( &reflection, 0, sizeof( reflection ) );
+    reflection_texturing = 0;
+}
@@ -0,0 +1,50 @@
+// reflection.h
+// The spheres' reflection in the floor, rendered into a texture at a
+// fraction of the screen's size and mixed in on a second texture unit as
+// the floor is drawn. The texture is kept from frame to frame: it's only
+// drawn again when the mirrored camera, the projection, the light or the
+// reflected spheres (which ones, where, how big and at what detail) have
+// changed since it was. The spheres' shadows count too when there's a shadow map,
+// since the reflection shows them.
+//
+// The floor looks the texture up by where it lands on screen, through
+// projective texture coordinates generated from the projection, so the
+// texture lines up with the frame whatever its resolution.
+//
+// Needs GL 3.0 for framebuffer objects. When that's missing, or the scale
+// is 0, the reflection is drawn straight into the frame every time.
+#ifndef REFLECTION_H
+#define REFLECTION_H
+
+#include <GL/glut.h>
+
+struct Reflection_t {
+    float scale;                // of the viewport's size
+    int width, height;          // texture size, 0 until first drawn
+    GLuint texture;             // color
+    GLuint depth;               // renderbuffer
+    GLuint framebuffer;
+    int valid;                  // texture holds the frame described below
+
+    // what the texture was drawn with
+    float modelview[16], projection[16];
+    float light[4];
+    GLint viewport[4];
+    unsigned int spheres;       // hash of the reflected spheres
+
+    int reused;                 // TRUE if this frame kept the last texture
+    GLint saved_framebuffer;
+    GLint saved_viewport[4];
+};
+
+extern int reflection_texturing;    // TRUE once reflection_init succeeded
+extern struct Reflection_t reflection;
+
+int reflection_init( float scale );
+int reflection_begin( const float light[4] );
+void reflection_end( void );
+void reflection_blend_begin( int unit );
+void reflection_blend_end( int unit );
+void reflection_shutdown( void );
+
+#endif
@@ -0,0 +1,227 @@
+// renderqueue.c
+// Sorted draw queues for the sphere passes. See renderqueue.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "renderqueue.h"
+#include "view.h"
+#include "lod.h"
+
+#if LOD_LEVELS > 4
+#error "render queue keys only have room for 4 levels of detail"
+#endif
+
+#define RADIX_BUCKETS ( 1 << RQ_RADIX_BITS )
+
+struct RenderQueue_t render_queues[CULL_LISTS];
+
+//-----------------------------------------------------------------------------
+// Turns a distance into depth key bits. Non-negative floats order the same
+// as their bit patterns, so the top bits of the pattern will do.
+//-----------------------------------------------------------------------------
+static unsigned int depth_bits( float d ) {
+    unsigned int bits;
+
+    if( !( d > 0.0f ) )
+        return 0;
+    memcpy( &bits, &d, sizeof( bits ) );
+    return bits >> 2;
+}
+
+static unsigned int make_key( int group, int level, unsigned int depth ) {
+    return ( (unsigned int) group << RQ_GROUP_SHIFT ) |
+           ( (unsigned int) level << RQ_LEVEL_SHIFT ) | ( depth & RQ_DEPTH_MASK );
+}
+
+//-----------------------------------------------------------------------------
+// Sorts items by key, keeping the order of equal keys. Gives up once it has
+// moved items more than max_moves places in total and returns FALSE (0);
+// the items are still all there, just not sorted yet.
+//-----------------------------------------------------------------------------
+static int insertion_sort( struct RenderItem_t* items, int count, long max_moves ) {
+    long moves = 0;
+    int i, j;
+
+    for( i = 1; i < count; i++ ) {
+        struct RenderItem_t item = items[i];
+
+        for( j = i; j > 0 && items[j - 1].key > item.key; j-- )
+            items[j] = items[j - 1];
+        items[j] = item;
+
+        moves += i - j;
+        if( moves > max_moves )
+            return 0;
+    }
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Least significant digit first radix sort on the whole key, through
+// scratch. Digits every item shares are skipped. Stable. Returns where the
+// sorted items ended up, items or scratch.
+//-----------------------------------------------------------------------------
+static struct RenderItem_t* radix_sort( struct RenderItem_t* items, struct RenderItem_t* scratch,
+                                       int count ) {
+    static int bucket[RADIX_BUCKETS];
+    struct RenderItem_t *from = items, *to = scratch, *swap;
+    int shift, i, b, sum, n;
+
+    for( shift = 0; shift < 32; shift += RQ_RADIX_BITS ) {
+        memset( bucket, 0, sizeof( bucket ) );
+        for( i = 0; i < count; i++ )
+            bucket[( from[i].key >> shift ) & ( RADIX_BUCKETS - 1 )]++;
+        if( bucket[( from[0].key >> shift ) & ( RADIX_BUCKETS - 1 )] == count )
+            continue;
+
+        sum = 0;
+        for( b = 0; b < RADIX_BUCKETS; b++ ) {
+            n = bucket[b];
+            bucket[b] = sum;
+            sum += n;
+        }
+        for( i = 0; i < count; i++ )
+            to[bucket[( from[i].key >> shift ) & ( RADIX_BUCKETS - 1 )]++] = from[i];
+
+        swap = from;
+        from = to;
+        to = swap;
+    }
+    return from;
+}
+
+//-----------------------------------------------------------------------------
+// Makes room for count items and a mark per sphere
+//-----------------------------------------------------------------------------
+static void queue_reserve( struct RenderQueue_t* q, int count ) {
+    if( q->capacity < count ) {
+        struct RenderItem_t* old = q->items;
+
+        q->capacity = count;
+        q->items = malloc( sizeof( struct RenderItem_t ) * count );
+        free( q->scratch );
+        q->scratch = malloc( sizeof( struct RenderItem_t ) * count );
+        if( !q->items || !q->scratch ) {
+            printf( "tron: Sorry, out of memory for the render queue.\n" );
+            exit( 1 );
+        }
+
+        // Last frame's order is the starting point for this one
+        if( old )
+            memcpy( q->items, old, sizeof( struct RenderItem_t ) * q->first[RQ_SHELL] );
+        free( old );
+    }
+
+    if( q->mark_capacity < view.spheres.capacity ) {
+        free( q->mark );
+        q->mark_capacity = view.spheres.capacity;
+        q->mark = calloc( q->mark_capacity, sizeof( unsigned int ) );
+        if( !q->mark ) {
+            printf( "tron: Sorry, out of memory for the render queue.\n" );
+            exit( 1 );
+        }
+        q->first[RQ_SHELL] = 0;
+        q->frame = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Queues the spheres of a visible list and sorts them, with highlight
+// shells for the selected ones if shells is TRUE. Needs this frame's
+// distances and levels of detail.
+//-----------------------------------------------------------------------------
+void render_queue_build( int list, int shells ) {
+    const struct VisibleList_t* v = &cull_visible[list];
+    struct RenderQueue_t* q = &render_queues[list];
+    struct RenderItem_t *next, *sorted;
+    int n, i, g, count;
+
+    // Every sphere can need a shell as well
+    queue_reserve( q, v->count * 2 );
+
+    // A sphere's mark is the frame number while it's visible and not queued
+    // yet. Frame 0 is never used, so cleared marks never match.
+    if( ++q->frame == 0 ) {
+        memset( q->mark, 0, sizeof( unsigned int ) * q->mark_capacity );
+        q->frame = 1;
+    }
+    for( n = 0; n < v->count; n++ )
+        q->mark[v->index[n]] = q->frame;
+
+    // Spheres still visible go in last frame's order, the ones that just
+    // came into view after them
+    next = q->scratch;
+    count = 0;
+    for( n = 0; n < q->first[RQ_SHELL]; n++ ) {
+        i = q->items[n].sphere;
+        if( q->mark[i] == q->frame ) {
+            q->mark[i] = 0;
+            next[count++].sphere = i;
+        }
+    }
+    for( n = 0; n < v->count; n++ ) {
+        i = v->index[n];
+        if( q->mark[i] == q->frame ) {
+            q->mark[i] = 0;
+            next[count++].sphere = i;
+        }
+    }
+
+    for( n = 0; n < count; n++ ) {
+        i = next[n].sphere;
+        next[n].key = make_key( RQ_OPAQUE, view.spheres.lod[i],
+                                depth_bits( view.spheres.distance[i] ) );
+    }
+
+    if( shells ) {
+        for( n = 0; n < v->count; n++ ) {
+            i = v->index[n];
+            if( view.spheres.state[i] & SPHERE_SELECTED ) {
+                next[count].key = make_key( RQ_SHELL, 0,
+                    RQ_DEPTH_MASK - depth_bits( view.spheres.distance[i] ) );
+                next[count].sphere = i;
+                count++;
+            }
+        }
+    }
+
+    q->scratch = q->items;
+    q->items = next;
+    q->count = count;
+
+    q->radix = 0;
+    if( !insertion_sort( q->items, count,
+                         count <= RQ_INSERTION_MAX ? (long) count * count
+                                                   : (long) count * RQ_INSERTION_MOVES ) ) {
+        sorted = radix_sort( q->items, q->scratch, count );
+        if( sorted != q->items ) {
+            q->scratch = q->items;
+            q->items = sorted;
+        }
+        q->radix = 1;
+    }
+
+    // Group boundaries
+    n = 0;
+    for( g = 0; g < RQ_GROUPS; g++ ) {
+        while( n < q->count && RQ_KEY_GROUP( q->items[n].key ) < g )
+            n++;
+        q->first[g] = n;
+    }
+    q->first[RQ_GROUPS] = q->count;
+}
+
+//-----------------------------------------------------------------------------
+// Frees the queues
+//-----------------------------------------------------------------------------
+void render_queue_shutdown( void ) {
+    int list;
+
+    for( list = 0; list < CULL_LISTS; list++ ) {
+        free( render_queues[list].items );
+        free( render_queues[list].scratch );
+        free( render_queues[list].mark );
+    }
+    memset( render_queues, 0, sizeof( render_queues ) );
+}
@@ -0,0 +1,69 @@
+// renderqueue.h
+// Draw order for the sphere passes, one queue per visible list (see
+// cull.h). Every visible sphere is queued as an opaque item, and in the
+// main pass every selected one again as a translucent highlight shell.
+// Items are sorted on a key made of, from the top bit down:
+//
+//   group (1 bit)   opaque spheres first, then the shells
+//   level (2 bits)  opaque only: the level of detail mesh, so each is bound
+//                   once
+//   depth (29 bits) opaque front to back, so early depth testing throws
+//                   away the fragments of spheres behind; shells back to
+//                   front, as blending needs
+//
+// so the draw code sets each group's state once, at the group boundary,
+// instead of around every sphere that needs it. Levels follow distance, so
+// the opaque spheres come out close to front to back overall too.
+//
+// The camera moves a little each frame, so each queue starts from last
+// frame's order and an insertion sort finishes it off in about linear
+// time. When too much has changed for that (a fast turn, a lot of spheres
+// coming into view) it gives up and a radix sort on the keys takes over.
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include "cull.h"
+
+// Item groups, in draw order
+enum {
+    RQ_OPAQUE,
+    RQ_SHELL,
+    RQ_GROUPS
+};
+
+#define RQ_GROUP_SHIFT 31
+#define RQ_LEVEL_SHIFT 29
+#define RQ_DEPTH_MASK 0x1fffffffu
+
+#define RQ_KEY_GROUP( key ) ( (int) ( (key) >> RQ_GROUP_SHIFT ) )
+
+// Insertion sort always does for queues this short; longer ones switch to
+// the radix sort once it has moved items this many places per item
+#define RQ_INSERTION_MAX 64
+#define RQ_INSERTION_MOVES 8
+
+#define RQ_RADIX_BITS 11
+
+struct RenderItem_t {
+    unsigned int key;
+    int sphere;
+};
+
+struct RenderQueue_t {
+    struct RenderItem_t *items;
+    struct RenderItem_t *scratch;   // the next frame's items are built here
+    int count;
+    int capacity;
+    int first[RQ_GROUPS + 1];   // where each group starts; first[RQ_GROUPS] == count
+    unsigned int *mark;         // per sphere, see render_queue_build()
+    int mark_capacity;
+    unsigned int frame;
+    int radix;                  // TRUE if the last sort fell back to radix
+};
+
+extern struct RenderQueue_t render_queues[CULL_LISTS];
+
+void render_queue_build( int list, int shells );
+void render_queue_shutdown( void );
+
+#endif
@@ -0,0 +1,280 @@
+// replay.c
+// Input recording and replay. See replay.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+#include "sim.h"
+#include "options.h"
+
+static const char replay_magic[4] = { 'L', 'B', 'R', 'P' };
+
+enum {
+    MODE_OFF,
+    MODE_RECORDING,
+    MODE_PLAYING
+};
+
+static int mode = MODE_OFF;
+static unsigned int step = 0;           // sim steps since the start
+
+// recording
+static FILE *out = NULL;
+static unsigned int last_step = 0;      // step of the last record written
+
+// playing: the whole file, read up front
+static unsigned char *data = NULL;
+static size_t data_size = 0, cursor = 0;
+static unsigned int next_step = 0;      // step the record at cursor is due
+static int finished = 0;
+
+//-----------------------------------------------------------------------------
+// Little endian and variable length integers
+//-----------------------------------------------------------------------------
+static void put_u32( unsigned int v ) {
+    fputc( v & 0xff, out );
+    fputc( ( v >> 8 ) & 0xff, out );
+    fputc( ( v >> 16 ) & 0xff, out );
+    fputc( ( v >> 24 ) & 0xff, out );
+}
+
+static void put_varint( unsigned int v ) {
+    while( v >= 0x80 ) {
+        fputc( ( v & 0x7f ) | 0x80, out );
+        v >>= 7;
+    }
+    fputc( v, out );
+}
+
+static void put_signed( int v ) {
+    put_varint( ( (unsigned int) v << 1 ) ^ (unsigned int) ( v >> 31 ) );
+}
+
+static unsigned int get_u32( size_t at ) {
+    return data[at] | ( data[at + 1] << 8 ) | ( data[at + 2] << 16 ) |
+           ( (unsigned int) data[at + 3] << 24 );
+}
+
+// Bails out on a truncated file rather than replaying half a record
+static int get_byte( void ) {
+    if( cursor >= data_size ) {
+        printf( "tron: replay file is truncated\n" );
+        exit( 1 );
+    }
+    return data[cursor++];
+}
+
+static unsigned int get_varint( void ) {
+    unsigned int v = 0;
+    int shift = 0, b;
+
+    do {
+        b = get_byte();
+        v |= (unsigned int) ( b & 0x7f ) << shift;
+        shift += 7;
+    } while( ( b & 0x80 ) && shift < 35 );
+    return v;
+}
+
+static int get_signed( void ) {
+    unsigned int v = get_varint();
+    return (int) ( v >> 1 ) ^ -(int) ( v & 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Notices when the next record is the end one and due, so drivers stop
+// after exactly as many steps as were recorded
+//-----------------------------------------------------------------------------
+static void check_end( void ) {
+    if( cursor < data_size && next_step == step && data[cursor] == REPLAY_END )
+        finished = 1;
+}
+
+//-----------------------------------------------------------------------------
+// Starts a record stamped with the current step
+//-----------------------------------------------------------------------------
+static void put_record( int kind ) {
+    put_varint( step - last_step );
+    fputc( kind, out );
+    last_step = step;
+}
+
+//-----------------------------------------------------------------------------
+// Opens options.record for writing and stores the game's seed and size
+//-----------------------------------------------------------------------------
+static void start_recording( void ) {
+    out = fopen( options.record, "wb" );
+    if( out == NULL ) {
+        printf( "tron: can't write replay file '%s'\n", options.record );
+        exit( 1 );
+    }
+    fwrite( replay_magic, 1, sizeof( replay_magic ), out );
+    put_u32( REPLAY_VERSION );
+    put_u32( options.seed );
+    put_u32( options.sphere_count );
+    mode = MODE_RECORDING;
+}
+
+//-----------------------------------------------------------------------------
+// Reads options.replay and replaces the seed and sphere count options with
+// the recorded ones
+//-----------------------------------------------------------------------------
+static void start_playing( void ) {
+    FILE *fp = fopen( options.replay, "rb" );
+    long size;
+
+    if( fp == NULL ) {
+        printf( "tron: can't open replay file '%s'\n", options.replay );
+        exit( 1 );
+    }
+    fseek( fp, 0, SEEK_END );
+    size = ftell( fp );
+    fseek( fp, 0, SEEK_SET );
+
+    data = malloc( size > 0 ? size : 1 );
+    if( data == NULL || size < 16 || fread( data, 1, size, fp ) != (size_t) size ||
+        memcmp( data, replay_magic, sizeof( replay_magic ) ) ) {
+        printf( "tron: '%s' is not a replay file\n", options.replay );
+        exit( 1 );
+    }
+    fclose( fp );
+    if( get_u32( 4 ) != REPLAY_VERSION ) {
+        printf( "tron: '%s' is replay version %u, I read version %d\n",
+                options.replay, get_u32( 4 ), REPLAY_VERSION );
+        exit( 1 );
+    }
+
+    options.seed = get_u32( 8 );
+    options.sphere_count = get_u32( 12 );
+    if( options.sphere_count < 1 || options.sphere_count > OPTIONS_MAX_SPHERES ) {
+        printf( "tron: '%s' has a bad sphere count\n", options.replay );
+        exit( 1 );
+    }
+    data_size = size;
+    cursor = 16;
+    next_step = get_varint();
+    mode = MODE_PLAYING;
+    check_end();
+}
+
+//-----------------------------------------------------------------------------
+// Starts recording or playing back as the options ask. Call before
+// sim_init(), since playing back changes the seed and sphere count.
+//-----------------------------------------------------------------------------
+void replay_init( void ) {
+    if( options.record[0] && options.replay[0] ) {
+        printf( "tron: can't record and replay at the same time\n" );
+        exit( 1 );
+    }
+    step = last_step = 0;
+    finished = 0;
+    if( options.record[0] )
+        start_recording();
+    else if( options.replay[0] )
+        start_playing();
+}
+
+//-----------------------------------------------------------------------------
+// Player inputs. Applied and recorded, or dropped while playing back.
+//-----------------------------------------------------------------------------
+void replay_key( unsigned char k ) {
+    if( mode == MODE_PLAYING )
+        return;
+    if( mode == MODE_RECORDING ) {
+        put_record( REPLAY_KEY );
+        fputc( k, out );
+    }
+    sim_key( k );
+}
+
+void replay_motion( int x, int y ) {
+    if( mode == MODE_PLAYING )
+        return;
+    if( mode == MODE_RECORDING ) {
+        put_record( REPLAY_MOTION );
+        put_signed( x );
+        put_signed( y );
+    }
+    sim_motion( x, y );
+}
+
+void replay_kill( int sphere ) {
+    if( mode == MODE_PLAYING )
+        return;
+    if( mode == MODE_RECORDING ) {
+        put_record( REPLAY_KILL );
+        put_varint( sphere );
+    }
+    kill_sphere( sphere );
+}
+
+//-----------------------------------------------------------------------------
+// Applies every recorded input due before this step and counts the step
+//-----------------------------------------------------------------------------
+void replay_step( void ) {
+    int kind, x, y;
+    unsigned int sphere;
+
+    while( mode == MODE_PLAYING && !finished && next_step == step ) {
+        kind = get_byte();
+        switch( kind ) {
+        case REPLAY_KEY:
+            sim_key( get_byte() );
+            break;
+        case REPLAY_MOTION:
+            x = get_signed();
+            y = get_signed();
+            sim_motion( x, y );
+            break;
+        case REPLAY_KILL:
+            sphere = get_varint();
+            if( sphere >= (unsigned int) spheres.count ) {
+                printf( "tron: replay kills sphere %u of %d\n", sphere, spheres.count );
+                exit( 1 );
+            }
+            kill_sphere( sphere );
+            break;
+        case REPLAY_END:
+            finished = 1;
+            return;
+        default:
+            printf( "tron: bad replay record %d at byte %lu\n", kind, (unsigned long) cursor - 1 );
+            exit( 1 );
+        }
+        next_step += get_varint();
+    }
+    step++;
+    check_end();
+}
+
+//-----------------------------------------------------------------------------
+// TRUE (1) while a recording is being played back, even once it's done
+//-----------------------------------------------------------------------------
+int replay_playing( void ) {
+    return mode == MODE_PLAYING;
+}
+
+//-----------------------------------------------------------------------------
+// TRUE (1) once a replay has reached the step the recording ended at
+//-----------------------------------------------------------------------------
+int replay_done( void ) {
+    return mode == MODE_PLAYING && finished;
+}
+
+//-----------------------------------------------------------------------------
+// Ends the recording, or lets go of the replay
+//-----------------------------------------------------------------------------
+void replay_close( void ) {
+    if( mode == MODE_RECORDING ) {
+        put_record( REPLAY_END );
+        if( fclose( out ) != 0 )
+            printf( "tron: error writing replay file '%s'\n", options.record );
+        out = NULL;
+        printf( "replay: recorded %u steps to %s\n", step, options.record );
+    } else if( mode == MODE_PLAYING ) {
+        free( data );
+        data = NULL;
+    }
+    mode = MODE_OFF;
+}
@@ -0,0 +1,42 @@
+// replay.h
+// Input recording and replay. Every player input that changes the game
+// (movement keys, mouse motion, shots) goes through replay_key(),
+// replay_motion() and replay_kill() rather than straight to the
+// simulation. While recording they are applied and logged; while playing
+// a log back they are ignored and the logged ones are applied instead.
+//
+// Inputs are stamped with the number of simulation steps taken before
+// them, not wall time, and replay_step() (called at the top of every
+// sim_step()) applies the ones due. Together with the seed and sphere
+// count stored in the file header this reproduces the recorded game
+// exactly, whatever the frame rate and however the steps are driven.
+//
+// File format, integers little endian:
+//   "LBRP", u32 version, u32 seed, u32 sphere count
+//   then records: varint steps since the previous record, u8 kind, payload
+//     REPLAY_KEY     u8 key
+//     REPLAY_MOTION  zigzag varint x, zigzag varint y
+//     REPLAY_KILL    varint sphere
+//     REPLAY_END     nothing; the run is over after this step
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#define REPLAY_VERSION 1
+
+enum {
+    REPLAY_KEY,
+    REPLAY_MOTION,
+    REPLAY_KILL,
+    REPLAY_END
+};
+
+void replay_init( void );
+void replay_key( unsigned char k );
+void replay_motion( int x, int y );
+void replay_kill( int sphere );
+void replay_step( void );
+int replay_playing( void );
+int replay_done( void );
+void replay_close( void );
+
+#endif
@@ -0,0 +1,80 @@
+// shader.c
+// GLSL program helpers. See shader.h.
+#include <stdio.h>
+
+#include "shader.h"
+
+//-----------------------------------------------------------------------------
+// Does the current context report at least this GL version?
+//-----------------------------------------------------------------------------
+int gl_version_at_least( int major, int minor ) {
+    const char *version = (const char*) glGetString( GL_VERSION );
+    int have_major = 0, have_minor = 0;
+
+    if( !version || sscanf( version, "%d.%d", &have_major, &have_minor ) != 2 )
+        return 0;
+
+    return have_major > major || ( have_major == major && have_minor >= minor );
+}
+
+//-----------------------------------------------------------------------------
+// Compiles one shader stage. Prints the info log and returns 0 on failure.
+//-----------------------------------------------------------------------------
+static GLuint shader_compile( const char *name, GLenum type, const char *src ) {
+    GLuint shader = glCreateShader( type );
+    GLint ok = 0;
+    char log[1024];
+
+    glShaderSource( shader, 1, &src, NULL );
+    glCompileShader( shader );
+    glGetShaderiv( shader, GL_COMPILE_STATUS, &ok );
+    if( !ok ) {
+        glGetShaderInfoLog( shader, sizeof( log ), NULL, log );
+        printf( "tron: %s %s shader failed to compile:\n%s\n", name,
+                type == GL_VERTEX_SHADER ? "vertex" : "fragment", log );
+        glDeleteShader( shader );
+        return 0;
+    }
+    return shader;
+}
+
+//-----------------------------------------------------------------------------
+// Builds a program from vertex and fragment source. attribs is a NULL
+// terminated list of vertex attribute names bound to locations 0, 1, ...
+// Returns 0 (and prints why) if anything fails so callers can fall back.
+//-----------------------------------------------------------------------------
+GLuint shader_build( const char *name, const char *vs_src, const char *fs_src,
+                     const char **attribs ) {
+    GLuint vs, fs, program;
+    GLint ok = 0;
+    char log[1024];
+    int i;
+
+    vs = shader_compile( name, GL_VERTEX_SHADER, vs_src );
+    fs = shader_compile( name, GL_FRAGMENT_SHADER, fs_src );
+    if( !vs || !fs ) {
+        if( vs ) glDeleteShader( vs );
+        if( fs ) glDeleteShader( fs );
+        return 0;
+    }
+
+    program = glCreateProgram();
+    glAttachShader( program, vs );
+    glAttachShader( program, fs );
+    for( i = 0; attribs && attribs[i]; i++ )
+        glBindAttribLocation( program, i, attribs[i] );
+    glLinkProgram( program );
+
+    // The program keeps what it needs
+    glDeleteShader( vs );
+    glDeleteShader( fs );
+
+    glGetProgramiv( program, GL_LINK_STATUS, &ok );
+    if( !ok ) {
+        glGetProgramInfoLog( program, sizeof( log ), NULL, log );
+        printf( "tron: %s shader failed to link:\n%s\n", name, log );
+        glDeleteProgram( program );
+        return 0;
+    }
+    return program;
+}
@@ -0,0 +1,12 @@
+// shader.h
+// GLSL program helpers shared by the shader based render paths.
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <GL/glut.h>
+
+int gl_version_at_least( int major, int minor );
+GLuint shader_build( const char *name, const char *vs_src, const char *fs_src,
+                     const char **attribs );
+
+#endif
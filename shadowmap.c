@@ -0,0 +1,354 @@
+// shadowmap.c
+// Depth map shadows from GL_LIGHT0. See shadowmap.h.
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "shadowmap.h"
+#include "shader.h"
+#include "glstate.h"
+#include "matrix.h"
+#include "cull.h"
+#include "view.h"
+#include "floor.h"
+
+int shadow_mapping = 0;
+struct ShadowMap_t shadow_map;
+
+// Fitted bounds in light space
+enum {
+    MIN_X, MAX_X, MIN_Y, MAX_Y, MIN_Z, MAX_Z
+};
+
+//-----------------------------------------------------------------------------
+// Creates the depth texture and the framebuffer that renders into it.
+// Returns FALSE (0) and leaves shadow_mapping off if size is 0 or the
+// driver can't do it.
+//-----------------------------------------------------------------------------
+int shadow_map_init( int size ) {
+    static const GLfloat border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    GLint max_size, saved_texture, saved_framebuffer;
+    GLenum status;
+
+    shadow_mapping = 0;
+    if( size <= 0 )
+        return 0;
+
+    if( !gl_version_at_least( 3, 0 ) ) {
+        printf( "tron: GL 3.0 not available, projecting shadows onto the floor.\n" );
+        return 0;
+    }
+
+    glGetIntegerv( GL_MAX_TEXTURE_SIZE, &max_size );
+    if( size > max_size ) {
+        printf( "tron: shadow map size %d is past the GL's limit, using %d.\n", size, max_size );
+        size = max_size;
+    }
+
+    memset( &shadow_map, 0, sizeof( shadow_map ) );
+    shadow_map.size = size;
+
+    glGetIntegerv( GL_TEXTURE_BINDING_2D, &saved_texture );
+    glGenTextures( 1, &shadow_map.texture );
+    glBindTexture( GL_TEXTURE_2D, shadow_map.texture );
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0,
+                  GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL );
+
+    // Linear filtering of a compared depth texture blends the four nearest
+    // results, which softens the edges a little. Outside the map is lit.
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER );
+    glTexParameterfv( GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL );
+
+    // The comparison lands in every channel, for the texture environment
+    // and the shaders alike
+    glTexParameteri( GL_TEXTURE_2D, GL_DEPTH_TEXTURE_MODE, GL_INTENSITY );
+    glBindTexture( GL_TEXTURE_2D, saved_texture );
+
+    // The offscreen renderer has its own framebuffer bound already
+    glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &saved_framebuffer );
+    glGenFramebuffers( 1, &shadow_map.framebuffer );
+    glBindFramebuffer( GL_FRAMEBUFFER, shadow_map.framebuffer );
+    glFramebufferTexture2D( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                            shadow_map.texture, 0 );
+    glDrawBuffer( GL_NONE );
+    glReadBuffer( GL_NONE );
+    status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+    glBindFramebuffer( GL_FRAMEBUFFER, saved_framebuffer );
+
+    if( status != GL_FRAMEBUFFER_COMPLETE ) {
+        printf( "tron: shadow map framebuffer incomplete (0x%x), projecting shadows onto the floor.\n",
+                status );
+        shadow_map_shutdown();
+        return 0;
+    }
+
+    shadow_mapping = 1;
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Grows bounds b to take in a sphere at light space (x, y, z)
+//-----------------------------------------------------------------------------
+static void bounds_extend( float b[6], float x, float y, float z, float radius ) {
+    if( x - radius < b[MIN_X] ) b[MIN_X] = x - radius;
+    if( x + radius > b[MAX_X] ) b[MAX_X] = x + radius;
+    if( y - radius < b[MIN_Y] ) b[MIN_Y] = y - radius;
+    if( y + radius > b[MAX_Y] ) b[MAX_Y] = y + radius;
+    if( z - radius < b[MIN_Z] ) b[MIN_Z] = z - radius;
+    if( z + radius > b[MAX_Z] ) b[MAX_Z] = z + radius;
+}
+
+//-----------------------------------------------------------------------------
+// Points the light's view along the light and fits its frustum around
+// this frame's receivers. light is GL_LIGHT0's position, w == 0. Needs the
+// visible lists from cull_passes(); afterwards the CULL_SHADOW list should
+// be culled again with shadow_map.clip.
+//-----------------------------------------------------------------------------
+void shadow_map_fit( const float light[4] ) {
+    static const float bias[16] = {
+        0.5f, 0.0f, 0.0f, 0.0f,
+        0.0f, 0.5f, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.5f, 0.0f,
+        0.5f, 0.5f, 0.5f, 1.0f
+    };
+    static const int receivers[2] = { CULL_MAIN, CULL_SHADOW };
+    float *v = shadow_map.view;
+    float d[3], r[3], u[3], b[6];
+    float len, x, y, z, t, floor_z;
+    int list, n, i, corner;
+
+    // d points at the light. The light's up is world up, unless the light
+    // is nearly overhead.
+    len = sqrt( light[0] * light[0] + light[1] * light[1] + light[2] * light[2] );
+    if( len <= 0.0f )
+        len = 1.0f;
+    d[0] = light[0] / len;
+    d[1] = light[1] / len;
+    d[2] = light[2] / len;
+
+    if( fabs( d[1] ) < 0.99f ) {
+        // r = up x d
+        r[0] = d[2];
+        r[1] = 0.0f;
+        r[2] = -d[0];
+    } else {
+        // r = d x z
+        r[0] = d[1];
+        r[1] = -d[0];
+        r[2] = 0.0f;
+    }
+    len = sqrt( r[0] * r[0] + r[1] * r[1] + r[2] * r[2] );
+    r[0] /= len;
+    r[1] /= len;
+    r[2] /= len;
+
+    // u = d x r
+    u[0] = d[1] * r[2] - d[2] * r[1];
+    u[1] = d[2] * r[0] - d[0] * r[2];
+    u[2] = d[0] * r[1] - d[1] * r[0];
+
+    // Rows r, u, d; looks down -d with no translation, the projection
+    // takes care of where
+    mat4_identity( v );
+    v[0] = r[0]; v[4] = r[1]; v[8] = r[2];
+    v[1] = u[0]; v[5] = u[1]; v[9] = u[2];
+    v[2] = d[0]; v[6] = d[1]; v[10] = d[2];
+
+    b[MIN_X] = b[MIN_Y] = b[MIN_Z] = 1e30f;
+    b[MAX_X] = b[MAX_Y] = b[MAX_Z] = -1e30f;
+
+    // Visible spheres, and the spheres whose shadow falls on the visible
+    // floor along with that shadow. Ortho projection along d keeps a
+    // sphere's shadow at its own light space x and y, only deeper.
+    for( list = 0; list < 2; list++ ) {
+        const struct VisibleList_t* vis = &cull_visible[receivers[list]];
+
+        for( n = 0; n < vis->count; n++ ) {
+            float cx, cy, cz, radius;
+
+            i = vis->index[n];
+            cx = -view.spheres.x[i];
+            cy = view.spheres.y[i];
+            cz = -view.spheres.z[i];
+            radius = view.spheres.size[i];
+
+            x = r[0] * cx + r[1] * cy + r[2] * cz;
+            y = u[0] * cx + u[1] * cy + u[2] * cz;
+            z = d[0] * cx + d[1] * cy + d[2] * cz;
+            bounds_extend( b, x, y, z, radius );
+
+            if( receivers[list] == CULL_SHADOW && d[1] > 0.0f ) {
+                t = ( cy - FLOOR_Y ) / d[1];
+                bounds_extend( b, x, y, z - t, radius );
+            }
+        }
+    }
+
+    if( b[MIN_X] > b[MAX_X] ) {
+        // Nothing to shadow; any small box will do
+        b[MIN_X] = b[MIN_Y] = b[MIN_Z] = -1.0f;
+        b[MAX_X] = b[MAX_Y] = b[MAX_Z] = 1.0f;
+    }
+
+    // The floor tilts away in light space, so its far corners can be
+    // deeper than any shadow
+    if( d[1] > 0.01f ) {
+        for( corner = 0; corner < 4; corner++ ) {
+            x = b[( corner & 1 ) ? MAX_X : MIN_X];
+            y = b[( corner & 2 ) ? MAX_Y : MIN_Y];
+            floor_z = ( FLOOR_Y - r[1] * x - u[1] * y ) / d[1];
+            if( floor_z < b[MIN_Z] )
+                b[MIN_Z] = floor_z;
+        }
+    }
+
+    // Anything up to SHADOW_MAP_REACH toward the light can cast. The eye
+    // looks down -z, so near and far are the negated z bounds.
+    mat4_ortho( shadow_map.projection,
+                b[MIN_X] - SHADOW_MAP_MARGIN, b[MAX_X] + SHADOW_MAP_MARGIN,
+                b[MIN_Y] - SHADOW_MAP_MARGIN, b[MAX_Y] + SHADOW_MAP_MARGIN,
+                -( b[MAX_Z] + SHADOW_MAP_REACH ), -( b[MIN_Z] - SHADOW_MAP_MARGIN ) );
+    mat4_multiply( shadow_map.clip, shadow_map.projection, shadow_map.view );
+    mat4_multiply( shadow_map.texture_matrix, bias, shadow_map.clip );
+}
+
+//-----------------------------------------------------------------------------
+// Starts drawing casters into the map. Draw them with their world
+// transform only; the light's matrices replace the camera's until
+// shadow_map_end().
+//-----------------------------------------------------------------------------
+void shadow_map_begin( void ) {
+    glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &shadow_map.saved_framebuffer );
+    glGetIntegerv( GL_VIEWPORT, shadow_map.saved_viewport );
+
+    glBindFramebuffer( GL_FRAMEBUFFER, shadow_map.framebuffer );
+    glViewport( 0, 0, shadow_map.size, shadow_map.size );
+    glstate_depth_mask( GL_TRUE );
+    glClear( GL_DEPTH_BUFFER_BIT );
+
+    glMatrixMode( GL_PROJECTION );
+    glPushMatrix();
+    glLoadMatrixf( shadow_map.projection );
+    glMatrixMode( GL_MODELVIEW );
+    glPushMatrix();
+    glLoadMatrixf( shadow_map.view );
+
+    // Depth only, and only the far side of each caster, so a sphere's lit
+    // side is never compared against itself
+    glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+    glstate_disable( GL_LIGHTING );
+    glstate_disable( GL_TEXTURE_2D );
+    glstate_disable( GL_BLEND );
+    glstate_disable( GL_STENCIL_TEST );
+    glstate_enable( GL_DEPTH_TEST );
+    glstate_enable( GL_POLYGON_OFFSET_FILL );
+    glPolygonOffset( 1.0f, 2.0f );
+    glCullFace( GL_FRONT );
+}
+
+//-----------------------------------------------------------------------------
+// Back to the camera and whatever framebuffer was drawn to before
+//-----------------------------------------------------------------------------
+void shadow_map_end( void ) {
+    glCullFace( GL_BACK );
+    glstate_disable( GL_POLYGON_OFFSET_FILL );
+    glPolygonOffset( 0.0f, 0.0f );
+    glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+    glstate_enable( GL_LIGHTING );
+
+    glMatrixMode( GL_PROJECTION );
+    glPopMatrix();
+    glMatrixMode( GL_MODELVIEW );
+    glPopMatrix();
+
+    glBindFramebuffer( GL_FRAMEBUFFER, shadow_map.saved_framebuffer );
+    glViewport( shadow_map.saved_viewport[0], shadow_map.saved_viewport[1],
+                shadow_map.saved_viewport[2], shadow_map.saved_viewport[3] );
+}
+
+//-----------------------------------------------------------------------------
+// Sets up to draw a receiver again as its shadow: 50% black where the map
+// says the light is blocked, nothing elsewhere. Call with the camera's view
+// current (no model transform), since that's what turns the eye linear
+// texture coordinates back into world space. Depth testing passes the same
+// surface drawn again.
+//-----------------------------------------------------------------------------
+void shadow_map_receive_begin( void ) {
+    static const GLenum coords[4] = { GL_S, GL_T, GL_R, GL_Q };
+    static const GLenum gens[4] = {
+        GL_TEXTURE_GEN_S, GL_TEXTURE_GEN_T, GL_TEXTURE_GEN_R, GL_TEXTURE_GEN_Q
+    };
+    const float *m = shadow_map.texture_matrix;
+    GLfloat plane[4];
+    int k;
+
+    glGetIntegerv( GL_TEXTURE_BINDING_2D, &shadow_map.saved_texture );
+    glBindTexture( GL_TEXTURE_2D, shadow_map.texture );
+
+    for( k = 0; k < 4; k++ ) {
+        plane[0] = m[k];
+        plane[1] = m[4 + k];
+        plane[2] = m[8 + k];
+        plane[3] = m[12 + k];
+        glTexGeni( coords[k], GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR );
+        glTexGenfv( coords[k], GL_EYE_PLANE, plane );
+        glEnable( gens[k] );
+    }
+
+    // Color straight from glColor, alpha scaled by how shadowed it is
+    glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE );
+    glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_REPLACE );
+    glTexEnvi( GL_TEXTURE_ENV, GL_SRC0_RGB, GL_PRIMARY_COLOR );
+    glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_RGB, GL_SRC_COLOR );
+    glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_MODULATE );
+    glTexEnvi( GL_TEXTURE_ENV, GL_SRC0_ALPHA, GL_PRIMARY_COLOR );
+    glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_SRC_ALPHA );
+    glTexEnvi( GL_TEXTURE_ENV, GL_SRC1_ALPHA, GL_TEXTURE );
+    glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND1_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+
+    glColor4f( 0.0f, 0.0f, 0.0f, 0.5f );
+    glstate_disable( GL_LIGHTING );
+    glstate_enable( GL_TEXTURE_2D );
+    glstate_enable( GL_BLEND );
+    glstate_blend_func( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+    glstate_depth_mask( GL_FALSE );
+    glDepthFunc( GL_LEQUAL );
+}
+
+//-----------------------------------------------------------------------------
+// Puts texturing, blending, lighting and depth testing back the way they
+// were
+//-----------------------------------------------------------------------------
+void shadow_map_receive_end( void ) {
+    glDisable( GL_TEXTURE_GEN_S );
+    glDisable( GL_TEXTURE_GEN_T );
+    glDisable( GL_TEXTURE_GEN_R );
+    glDisable( GL_TEXTURE_GEN_Q );
+    glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+    glBindTexture( GL_TEXTURE_2D, shadow_map.saved_texture );
+
+    glDepthFunc( GL_LESS );
+    glstate_depth_mask( GL_TRUE );
+    glstate_disable( GL_BLEND );
+    glstate_disable( GL_TEXTURE_2D );
+    glstate_enable( GL_LIGHTING );
+}
+
+//-----------------------------------------------------------------------------
+// Releases the texture and framebuffer
+//-----------------------------------------------------------------------------
+void shadow_map_shutdown( void ) {
+    if( shadow_map.framebuffer )
+        glDeleteFramebuffers( 1, &shadow_map.framebuffer );
+    if( shadow_map.texture )
+        glDeleteTextures( 1, &shadow_map.texture );
+    memset( &shadow_map, 0, sizeof( shadow_map ) );
+    shadow_mapping = 0;
+}
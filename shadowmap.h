@@ -0,0 +1,55 @@
+// shadowmap.h
+// Sphere shadows from a depth map rendered from GL_LIGHT0. The light is
+// directional, so the map is an orthographic view along the light
+// direction. Each frame the light's frustum is fitted to what can receive a
+// shadow on screen: the visible spheres, and the floor under the spheres
+// whose projected shadow is on screen (the CULL_SHADOW list as cull_passes()
+// builds it from the floor shadow matrix). It reaches back toward the light
+// far enough to take in anything that could be in the way; the shadow list
+// is then culled again against the fitted frustum and becomes the casters.
+//
+// Casters go in depth only, back faces only, with the instanced flat pass
+// when there is one. The floor takes its shadows in one extra blended quad,
+// the map compared through eye linear texture coordinates, and the
+// instanced spheres look the map up in their fragment shader.
+//
+// Needs GL 3.0 for framebuffer objects and depth texture comparison. When
+// that's missing, or the size is 0, the renderer keeps projecting the
+// spheres flat onto the floor.
+#ifndef SHADOWMAP_H
+#define SHADOWMAP_H
+
+#include <GL/glut.h>
+
+// How far toward the light, past the receivers, casters are looked for
+#define SHADOW_MAP_REACH 100.0f
+
+// Margin in light space around the fitted bounds, so the linear filtering
+// at the edge of the map never reaches the border
+#define SHADOW_MAP_MARGIN 1.0f
+
+struct ShadowMap_t {
+    int size;                   // texels along each side
+    GLuint texture;             // depth, compared on lookup
+    GLuint framebuffer;
+    float view[16];             // world to light space
+    float projection[16];       // light space to clip, fitted each frame
+    float clip[16];             // projection * view
+    float texture_matrix[16];   // world to shadow map texture coordinates
+    GLint saved_framebuffer;
+    GLint saved_viewport[4];
+    GLint saved_texture;
+};
+
+extern int shadow_mapping;      // TRUE once shadow_map_init succeeded
+extern struct ShadowMap_t shadow_map;
+
+int shadow_map_init( int size );
+void shadow_map_fit( const float light[4] );
+void shadow_map_begin( void );
+void shadow_map_end( void );
+void shadow_map_receive_begin( void );
+void shadow_map_receive_end( void );
+void shadow_map_shutdown( void );
+
+#endif
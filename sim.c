@@ -0,0 +1,414 @@
+// sim.c
+// Fixed-timestep game simulation. See sim.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sim.h"
+#include "events.h"
+#include "replay.h"
+#include "jobs.h"
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+//spheres
+struct SphereSet_t spheres;
+
+// our camera
+struct ThirdPersonCamera_t camera;
+
+int score = 0;
+
+//bike variables
+float bikeTireAngle = 0.0, bikeHandlAngle = 0.0, bikeAngle = 0.0;
+
+// simulated time in seconds and the not yet simulated remainder
+static double sim_clock = 0.0;
+static float sim_accumulator = 0.0f;
+
+// spheres with SPHERE_MOVING set, and where each sits in that list
+static int *moving = NULL;
+static int *moving_slot = NULL;
+static int moving_count = 0;
+
+//-----------------------------------------------------------------------------
+// Calculates the distance between two points.
+//-----------------------------------------------------------------------------
+float distance( const struct Vector3* v1, const struct Vector3* v2 ) {
+    float d = 0.0f;
+    float x = v2->x - v1->x;
+    float y = v2->y - v1->y;
+    float z = v2->z - v1->z;
+
+    x *= x;
+    y *= y;
+    z *= z;
+
+    // normalize vector
+    d = sqrt(x+y+z);
+
+    return d;
+}
+
+
+//-----------------------------------------------------------------------------
+// Allocates one aligned, zeroed sphere array
+//-----------------------------------------------------------------------------
+static void* spheres_alloc( size_t elem_size ) {
+    void *p = NULL;
+    size_t bytes = elem_size * spheres.capacity;
+
+    if( posix_memalign( &p, SPHERE_ALIGN, bytes ) != 0 ) {
+        printf( "tron: Sorry, not enough memory for %d spheres.\n", spheres.count );
+        exit( 1 );
+    }
+    memset( p, 0, bytes );
+    return p;
+}
+
+//-----------------------------------------------------------------------------
+// Releases the sphere arrays
+//-----------------------------------------------------------------------------
+static void spheres_free( void ) {
+    free( spheres.x );
+    free( spheres.y );
+    free( spheres.z );
+    free( spheres.size );
+    free( spheres.distance );
+    free( spheres.state );
+    free( spheres.lod );
+    free( spheres.death_time );
+    free( moving );
+    free( moving_slot );
+    memset( &spheres, 0, sizeof( struct SphereSet_t ) );
+    moving = moving_slot = NULL;
+    moving_count = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Desc: Gives each sphere a random position in 3D space.
+//-----------------------------------------------------------------------------
+static void spheres_init( int count ) {
+    int i;
+
+    spheres_free();
+    spheres.count = count;
+    spheres.capacity = ( count + SPHERE_BATCH - 1 ) / SPHERE_BATCH * SPHERE_BATCH;
+
+    spheres.x = spheres_alloc( sizeof( float ) );
+    spheres.y = spheres_alloc( sizeof( float ) );
+    spheres.z = spheres_alloc( sizeof( float ) );
+    spheres.size = spheres_alloc( sizeof( float ) );
+    spheres.distance = spheres_alloc( sizeof( float ) );
+    spheres.state = spheres_alloc( sizeof( unsigned char ) );
+    spheres.lod = spheres_alloc( sizeof( unsigned char ) );
+    spheres.death_time = spheres_alloc( sizeof( unsigned int ) );
+    moving = spheres_alloc( sizeof( int ) );
+    moving_slot = spheres_alloc( sizeof( int ) );
+
+    // Give each sphere a random position
+    for( i = 0; i < count; i++ ) {
+        spheres.x[i] = (float) ( ( rand() % 100 ) + 1 ) - 50;
+        spheres.y[i] = SPHERE_FLOOR_Y;
+        spheres.z[i] = (float) ( ( rand() % 100 ) + 1 ) - 50;
+        spheres.size[i] = SPHERE_SIZE;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Resets the simulation. The seed is applied before the spheres are placed so
+// the same seed always produces the same field.
+//-----------------------------------------------------------------------------
+void sim_init( int count, unsigned int seed ) {
+    srand( seed );
+
+    spheres_init( count );
+
+    // setup camera
+    memset( &camera, 0, sizeof( struct ThirdPersonCamera_t ) );
+    camera.fRadius = 10.0f;
+
+    score = 0;
+    bikeTireAngle = bikeHandlAngle = bikeAngle = 0.0f;
+
+    sim_clock = 0.0;
+    sim_accumulator = 0.0f;
+    events_clear();
+}
+
+//-----------------------------------------------------------------------------
+// Frees everything sim_init allocated
+//-----------------------------------------------------------------------------
+void sim_shutdown( void ) {
+    spheres_free();
+    events_free();
+}
+
+//-----------------------------------------------------------------------------
+// Current simulation time in milliseconds
+//-----------------------------------------------------------------------------
+unsigned int sim_time( void ) {
+    return (unsigned int) ( sim_clock * 1000.0 );
+}
+
+//-----------------------------------------------------------------------------
+// Moving list bookkeeping. A sphere is moving while it shrinks or falls.
+//-----------------------------------------------------------------------------
+static int sphere_in_motion( int i ) {
+    return ( ( spheres.state[i] & SPHERE_DEAD ) && spheres.size[i] > 0.0f ) ||
+           spheres.y[i] > SPHERE_FLOOR_Y;
+}
+
+static void moving_add( int i ) {
+    if( spheres.state[i] & SPHERE_MOVING )
+        return;
+    spheres.state[i] |= SPHERE_MOVING;
+    moving_slot[i] = moving_count;
+    moving[moving_count++] = i;
+}
+
+static void moving_remove( int i ) {
+    int last;
+
+    if( !( spheres.state[i] & SPHERE_MOVING ) )
+        return;
+    spheres.state[i] &= ~SPHERE_MOVING;
+
+    // fill the hole with the last entry
+    last = moving[--moving_count];
+    moving[moving_slot[i]] = last;
+    moving_slot[last] = moving_slot[i];
+}
+
+//-----------------------------------------------------------------------------
+// Applies a due event to its sphere
+//-----------------------------------------------------------------------------
+static void sphere_event( const struct SimEvent_t* event, unsigned int now ) {
+    int i = event->sphere;
+
+    switch( event->kind ) {
+    case EVENT_SHRUNK:
+        // Shooting a dying sphere again doesn't change when it's gone, so
+        // there's nothing to cancel here
+        if( spheres.state[i] & SPHERE_DEAD )
+            spheres.size[i] = 0.0f;
+        break;
+
+    case EVENT_RESPAWN:
+        // Killed again since this was queued; a later respawn is coming
+        if( !( spheres.state[i] & SPHERE_DEAD ) ||
+            now - spheres.death_time[i] <= respawn_time )
+            return;
+
+        // The sphere will fall from the sky after the respawn time expires.
+        spheres.y[i] = SPHERE_SPAWN_Y;
+        spheres.state[i] &= ~SPHERE_DEAD;
+        spheres.size[i] = SPHERE_SIZE;
+        moving_add( i );
+        events_push( now + (unsigned int) ceil( ( SPHERE_SPAWN_Y - SPHERE_FLOOR_Y ) *
+                                                1000.0f / SPHERE_FALL_SPEED ),
+                     i, EVENT_LANDED );
+        break;
+
+    case EVENT_LANDED:
+        spheres.y[i] = SPHERE_FLOOR_Y;
+        break;
+    }
+
+    if( !sphere_in_motion( i ) )
+        moving_remove( i );
+}
+
+//-----------------------------------------------------------------------------
+// Integrates moving spheres moving[begin] to moving[end - 1], a job for
+// sim_step()
+//-----------------------------------------------------------------------------
+static void moving_range( void* arg, int begin, int end, int worker ) {
+    float dt = *(const float*) arg;
+    int n, i;
+
+    for( n = begin; n < end; n++ ) {
+        i = moving[n];
+
+        // Slowly decrease the size of the sphere when it's dying
+        if( ( spheres.state[i] & SPHERE_DEAD ) && spheres.size[i] > 0.0f ) {
+            spheres.size[i] -= SPHERE_SHRINK_RATE * dt;
+            if( spheres.size[i] < 0.0f )
+                spheres.size[i] = 0.0f;
+        }
+
+        // If the sphere is in the sky, let it fall back down to the ground
+        if( spheres.y[i] > SPHERE_FLOOR_Y ) {
+            spheres.y[i] -= SPHERE_FALL_SPEED * dt;
+            if( spheres.y[i] < SPHERE_FLOOR_Y )
+                spheres.y[i] = SPHERE_FLOOR_Y;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Advances the game by dt seconds: dying spheres shrink, expired ones respawn
+// in the sky and falling ones drop back to the floor. Only moving spheres
+// are touched; the state changes arrive as events.
+//-----------------------------------------------------------------------------
+void sim_step( float dt ) {
+    struct SimEvent_t event;
+    unsigned int now;
+
+    // Inputs played back from a recording land before the step they
+    // were recorded at
+    replay_step();
+
+    sim_clock += dt;
+    now = sim_time();
+
+    // Each moving sphere only touches its own entries
+    jobs_parallel_for( moving_count, JOBS_SPHERE_GRAIN, moving_range, &dt );
+
+    while( events_pop_due( now, &event ) )
+        sphere_event( &event, now );
+}
+
+//-----------------------------------------------------------------------------
+// Returns TRUE (1) while the game changes on its own, i.e. some sphere is
+// dying, waiting to respawn or falling
+//-----------------------------------------------------------------------------
+int sim_active( void ) {
+    return moving_count > 0 || events_pending() > 0;
+}
+
+//-----------------------------------------------------------------------------
+// The spheres currently shrinking or falling: sets *list and returns how
+// many there are. The list changes with every sim_step().
+//-----------------------------------------------------------------------------
+int sim_moving( const int** list ) {
+    *list = moving;
+    return moving_count;
+}
+
+//-----------------------------------------------------------------------------
+// Feeds elapsed wall time into the simulation and runs as many fixed steps
+// as it covers. Returns the number of steps taken.
+//-----------------------------------------------------------------------------
+int sim_advance( unsigned int elapsed_ms ) {
+    int steps = 0;
+
+    sim_accumulator += elapsed_ms / 1000.0f;
+
+    while( sim_accumulator >= SIM_DT ) {
+        // Don't spiral trying to catch up after a long stall; drop the rest.
+        if( steps == SIM_MAX_STEPS ) {
+            sim_accumulator = 0.0f;
+            break;
+        }
+        sim_step( SIM_DT );
+        sim_accumulator -= SIM_DT;
+        steps++;
+    }
+
+    return steps;
+}
+
+//-----------------------------------------------------------------------------
+// Marks sphere i as dead and schedules the end of its shrinking and its
+// respawn
+//-----------------------------------------------------------------------------
+void kill_sphere( int i ) {
+    unsigned int now = sim_time();
+
+    score += 100;
+    spheres.state[i] |= SPHERE_DEAD;
+    spheres.death_time[i] = now;
+    moving_add( i );
+
+    events_push( now + (unsigned int) ceil( spheres.size[i] * 1000.0f / SPHERE_SHRINK_RATE ),
+                 i, EVENT_SHRUNK );
+    events_push( now + respawn_time + 1, i, EVENT_RESPAWN );
+}
+
+//-----------------------------------------------------------------------------
+// Applies a movement key to the camera and bike
+//-----------------------------------------------------------------------------
+void sim_key( unsigned char k ) {
+
+    static float fRotSpeed = 1.0f;
+
+    if (k=='q') {
+        camera.vecRot.x += fRotSpeed;
+        if (camera.vecRot.x > 360) camera.vecRot.x -= 360;
+    }
+    if (k=='z') {
+        camera.vecRot.x -= 1;
+        if (camera.vecRot.x < -360) camera.vecRot.x += 360;
+    }
+    if (k=='w') {
+        float xrotrad, yrotrad;
+        yrotrad = (camera.vecRot.y / 180.0f * 3.141592654f);
+        xrotrad = (camera.vecRot.x / 180.0f * 3.141592654f);
+        camera.vecPos.x += (float)(sin(yrotrad));
+        camera.vecPos.z -= (float)(cos(yrotrad));
+        camera.vecPos.y -= (float)(sin(xrotrad));
+        bikeTireAngle -= 10.0;
+        bikeHandlAngle = 0.0;
+    }
+    if (k=='s') {
+        float xrotrad, yrotrad;
+        yrotrad = (camera.vecRot.y / 180.0f * 3.141592654f);
+        xrotrad = (camera.vecRot.x / 180.0f * 3.141592654f);
+        camera.vecPos.x -= (float)(sin(yrotrad));
+        camera.vecPos.z += (float)(cos(yrotrad));
+        camera.vecPos.y += (float)(sin(xrotrad));
+        bikeTireAngle += 10.0;
+        bikeHandlAngle = 0.0;
+    }
+    if (k=='d') {
+        float yrotrad;
+        yrotrad = (camera.vecRot.y / 180.0f * 3.141592654f);
+        camera.vecPos.x += (float)(cos(yrotrad)) * 0.5f;
+        camera.vecPos.z += (float)(sin(yrotrad)) * 0.5f;
+        //bikeAngle -= 2.0;
+        bikeHandlAngle = 1;
+    }
+    if (k =='a') {
+        float yrotrad;
+        yrotrad = (camera.vecRot.y / 180.0f * 3.141592654f);
+        camera.vecPos.x -= (float)(cos(yrotrad)) * 0.5f;
+        camera.vecPos.z -= (float)(sin(yrotrad)) * 0.5f;
+        //  bikeAngle += 2.0;
+        bikeHandlAngle = -1;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Applies mouse movement to the camera
+//-----------------------------------------------------------------------------
+void sim_motion( int x, int y ) {
+    int diffx = x - camera.fLastX;
+    int diffy = y - camera.fLastY;
+
+    camera.fLastX = x;
+    camera.fLastY = y;
+
+    camera.vecRot.x += (float) diffy;
+    camera.vecRot.y += (float) diffx;
+
+    if( diffy > 0) {
+        bikeHandlAngle = 1;
+    } else if( diffy < 0 ) {
+        bikeHandlAngle = -1;
+    } else {
+        bikeHandlAngle = 0;
+    }
+
+    // reset camera if underneath floor or above it
+    if( camera.vecRot.x < -30.0f ) {
+        camera.vecRot.x = -30.0f;
+    }
+
+    if( camera.vecRot.x > 90.0f ) {
+        camera.vecRot.x = 90.0f;
+    }
+}
@@ -0,0 +1,98 @@
+// sim.h
+// Game simulation for lightballs. Owns the spheres, the camera, the player
+// bike state and the score, and advances them with a fixed timestep. Nothing
+// in here touches OpenGL or GLUT, so it also runs in the headless build.
+#ifndef SIM_H
+#define SIM_H
+
+// Default number of spheres in the game, see options.h to change it
+#define SPHERE_COUNT_DEFAULT 20
+#define respawn_time 5000
+
+// Sphere arrays are padded to a multiple of this and aligned to
+// SPHERE_ALIGN bytes so SIMD kernels can stream whole batches. Padding
+// entries have size 0 and never draw or pick.
+#define SPHERE_BATCH 8
+#define SPHERE_ALIGN 32
+
+// Fixed simulation rate. Rates below are expressed per second so that the
+// game plays the same regardless of how fast we render.
+#define SIM_HZ 60
+#define SIM_DT (1.0f / SIM_HZ)
+#define SIM_MAX_STEPS 8             // catch-up limit per sim_advance() call
+
+#define SPHERE_SIZE 2.0f
+#define SPHERE_FLOOR_Y 2.0f
+#define SPHERE_SPAWN_Y 50.0f
+#define SPHERE_SHRINK_RATE 6.0f     // size units per second while dying
+#define SPHERE_FALL_SPEED 30.0f     // units per second after respawning
+
+//-----------------------------------------------------------------------------
+// 3D vector
+//-----------------------------------------------------------------------------
+struct Vector3 {
+    float x, y, z;
+};
+
+//-----------------------------------------------------------------------------
+// Third Person Camera structure
+//-----------------------------------------------------------------------------
+struct ThirdPersonCamera_t {
+    struct Vector3 vecPos;
+    struct Vector3 vecRot;
+    float fRadius;          // Distance between the camera and the object.
+    float fLastX;
+    float fLastY;
+};
+
+//-----------------------------------------------------------------------------
+// Sphere storage. One array per field (structure of arrays) so the per-frame
+// passes only touch the data they need: positions and sizes are hot, the
+// death time is only read while a sphere is dead.
+//-----------------------------------------------------------------------------
+
+// state bits
+#define SPHERE_SELECTED 0x01        // Is this one under the crosshair?
+#define SPHERE_DEAD     0x02        // Is this sphere dead?
+#define SPHERE_MOVING   0x04        // Shrinking or falling, see sim_step()
+
+struct SphereSet_t {
+    int count;                  // Number of spheres in the game
+    int capacity;               // count rounded up to SPHERE_BATCH
+    float *x, *y, *z;           // Position in 3D space
+    float *size;                // The size of the sphere. Decreases during
+                                // death phase.
+    float *distance;            // Distance between you and the sphere.
+    unsigned char *state;       // SPHERE_* bits
+    unsigned char *lod;         // Mesh detail level, see lod.h
+    unsigned int *death_time;   // Simulation time (ms) the sphere died at.
+                                // Respawn after respawn_time milliseconds
+    int selected;               // The SPHERE_SELECTED sphere, or -1. Only
+                                // the view's copy uses it, see view_select()
+};
+
+//-----------------------------------------------------------------------------
+// Simulation state
+//-----------------------------------------------------------------------------
+extern struct SphereSet_t spheres;
+extern struct ThirdPersonCamera_t camera;
+extern int score;
+
+// bike animation state, driven by player input
+extern float bikeTireAngle, bikeHandlAngle, bikeAngle;
+
+void sim_init( int count, unsigned int seed );
+void sim_shutdown( void );
+void sim_step( float dt );
+int sim_advance( unsigned int elapsed_ms );
+unsigned int sim_time( void );
+int sim_active( void );
+int sim_moving( const int** list );
+
+void sim_key( unsigned char k );
+void sim_motion( int x, int y );
+
+float distance( const struct Vector3* v1, const struct Vector3* v2 );
+void kill_sphere( int i );
+
+#endif
@@ -0,0 +1,185 @@
+// simthread.c
+// The simulation thread and its input queue. See simthread.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "simthread.h"
+#include "sim.h"
+#include "view.h"
+#include "replay.h"
+#include "jobs.h"
+#include "frametime.h"
+
+struct Input_t {
+    int kind;               // REPLAY_KEY, REPLAY_MOTION or REPLAY_KILL
+    int a, b;
+};
+
+static struct Input_t queue[INPUT_QUEUE];
+static int head = 0, count = 0;
+static unsigned int queued = 0;         // inputs ever queued, atomic
+static unsigned int applied = 0;        // of those, applied by the thread
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t thread;
+static int running = 0;
+static int stopping = 0;                // atomic
+
+//-----------------------------------------------------------------------------
+// Hands one input to the simulation
+//-----------------------------------------------------------------------------
+static void input_apply( const struct Input_t* in ) {
+    switch( in->kind ) {
+    case REPLAY_KEY:
+        replay_key( (unsigned char) in->a );
+        break;
+    case REPLAY_MOTION:
+        replay_motion( in->a, in->b );
+        break;
+    case REPLAY_KILL:
+        replay_kill( in->a );
+        break;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Queues an input for the thread, or applies it now if there's no thread
+//-----------------------------------------------------------------------------
+static void input_push( int kind, int a, int b ) {
+    struct Input_t in;
+
+    in.kind = kind;
+    in.a = a;
+    in.b = b;
+    if( !running ) {
+        input_apply( &in );
+        return;
+    }
+
+    pthread_mutex_lock( &lock );
+    if( count < INPUT_QUEUE ) {
+        queue[( head + count ) % INPUT_QUEUE] = in;
+        count++;
+        __atomic_add_fetch( &queued, 1, __ATOMIC_RELEASE );
+    }
+    pthread_mutex_unlock( &lock );
+}
+
+void input_key( unsigned char k ) {
+    input_push( REPLAY_KEY, k, 0 );
+}
+
+void input_motion( int x, int y ) {
+    input_push( REPLAY_MOTION, x, y );
+}
+
+void input_kill( int sphere ) {
+    input_push( REPLAY_KILL, sphere, 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Number of inputs queued so far. Once a view's input_seq has caught up
+// with this, everything the player did is on screen.
+//-----------------------------------------------------------------------------
+unsigned int input_queued( void ) {
+    return __atomic_load_n( &queued, __ATOMIC_ACQUIRE );
+}
+
+//-----------------------------------------------------------------------------
+// Applies everything queued since the last step. Returns how many inputs
+// there were.
+//-----------------------------------------------------------------------------
+static int input_drain( void ) {
+    struct Input_t pending[INPUT_QUEUE];
+    int n, k;
+
+    pthread_mutex_lock( &lock );
+    n = count;
+    for( k = 0; k < n; k++ )
+        pending[k] = queue[( head + k ) % INPUT_QUEUE];
+    head = ( head + n ) % INPUT_QUEUE;
+    count = 0;
+    pthread_mutex_unlock( &lock );
+
+    for( k = 0; k < n; k++ )
+        input_apply( &pending[k] );
+    applied += n;
+    return n;
+}
+
+//-----------------------------------------------------------------------------
+// Sleeps for ms milliseconds
+//-----------------------------------------------------------------------------
+static void sleep_ms( double ms ) {
+    struct timespec ts;
+
+    ts.tv_sec = (time_t) ( ms / 1000.0 );
+    ts.tv_nsec = (long) ( ( ms - ts.tv_sec * 1000.0 ) * 1000000.0 );
+    nanosleep( &ts, NULL );
+}
+
+//-----------------------------------------------------------------------------
+// Simulation thread: one step every SIM_DT, each followed by a snapshot
+// unless nothing could have changed
+//-----------------------------------------------------------------------------
+static void* sim_main( void* arg ) {
+    double next = frametime_now(), now;
+    int inputs, was_active;
+
+    jobs_attach();
+    while( !__atomic_load_n( &stopping, __ATOMIC_ACQUIRE ) ) {
+        now = frametime_now();
+        if( now < next ) {
+            sleep_ms( next - now );
+            continue;
+        }
+
+        // Don't spiral trying to catch up after a long stall; drop the rest
+        if( now - next > SIM_MAX_STEPS * SIM_DT * 1000.0 )
+            next = now;
+
+        if( !replay_done() ) {
+            was_active = sim_active();
+            snapshot_begin();
+            inputs = input_drain();
+            sim_step( SIM_DT );
+            if( inputs || was_active || sim_active() || replay_playing() )
+                snapshot_publish( next, applied );
+        }
+        next += SIM_DT * 1000.0;
+    }
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Starts stepping on the thread. Call after sim_init() and view_init().
+//-----------------------------------------------------------------------------
+void sim_thread_start( void ) {
+    stopping = 0;
+    if( pthread_create( &thread, NULL, sim_main, NULL ) != 0 ) {
+        printf( "tron: can't start the simulation thread\n" );
+        exit( 1 );
+    }
+    running = 1;
+}
+
+//-----------------------------------------------------------------------------
+// Stops the thread after the step it's on. Input goes straight to the
+// simulation again afterwards.
+//-----------------------------------------------------------------------------
+void sim_thread_stop( void ) {
+    if( !running )
+        return;
+    __atomic_store_n( &stopping, 1, __ATOMIC_RELEASE );
+    pthread_join( thread, NULL );
+    running = 0;
+}
+
+//-----------------------------------------------------------------------------
+// TRUE (1) while the simulation runs on its own thread
+//-----------------------------------------------------------------------------
+int sim_thread_running( void ) {
+    return running;
+}
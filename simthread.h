@@ -0,0 +1,25 @@
+// simthread.h
+// Runs the simulation on its own thread at a steady SIM_HZ, so input is
+// sampled and the game advances on time however long frames take to draw.
+// Each step ends by publishing a snapshot for the renderer (see view.h).
+//
+// Player input from the GLUT callbacks goes through input_key(),
+// input_motion() and input_kill(). While the thread runs these only queue
+// the input, and the thread applies the queue at the start of its next
+// step through the replay_*() calls, so recording and replays see the same
+// step numbers as before. Without the thread they're applied right away.
+#ifndef SIMTHREAD_H
+#define SIMTHREAD_H
+
+#define INPUT_QUEUE 256     // inputs waiting for the next step; more are dropped
+
+void sim_thread_start( void );
+void sim_thread_stop( void );
+int sim_thread_running( void );
+
+void input_key( unsigned char k );
+void input_motion( int x, int y );
+void input_kill( int sphere );
+unsigned int input_queued( void );
+
+#endif
@@ -0,0 +1,647 @@
+// sphereinst.c
+// Instanced sphere rendering. See sphereinst.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sphereinst.h"
+#include "spheremesh.h"
+#include "shader.h"
+#include "lod.h"
+#include "cull.h"
+#include "renderqueue.h"
+#include "view.h"
+#include "shadowmap.h"
+#include "pipeline.h"
+#include "matrix.h"
+#include "glstate.h"
+
+int sphere_instancing = 0;
+int sphere_impostors = 0;
+
+//-----------------------------------------------------------------------------
+// Per instance data as it sits in the instance buffer
+//-----------------------------------------------------------------------------
+struct SphereInstance_t {
+    GLfloat x, y, z;        // centre, already mirrored the way spheres draw
+    GLfloat radius;
+    GLfloat selected;       // 1.0 if under the crosshair
+};
+
+static struct SphereInstance_t *instances = NULL;
+static int instance_capacity = 0;
+static GLsizei instance_count = 0;
+
+// instances are stored per visible list, then per render queue group (the
+// spheres, then the shells around the selected ones), and within that
+// grouped by level of detail
+static GLsizei lod_first[CULL_LISTS][RQ_GROUPS][LOD_LEVELS];
+static GLsizei lod_count[CULL_LISTS][RQ_GROUPS][LOD_LEVELS];
+
+static GLuint instance_vbo = 0;
+static GLuint program = 0;
+static GLint u_offset_y, u_shell_scale, u_pass;
+static GLint u_shadow_matrix, u_shadowed;
+
+// The same for the shader pipeline (pipeline.h)
+static GLuint core_program = 0;
+static GLuint core_vao = 0;
+static GLint core_offset_y, core_shell_scale, core_pass, core_modelview, core_color;
+static GLint core_shadow_matrix, core_shadowed;
+
+// Ray cast impostors, also for the shader pipeline
+static GLuint impostor_program = 0;
+static GLuint impostor_vao = 0;
+static GLuint corner_vbo = 0;
+static GLint imp_offset_y, imp_shell_scale, imp_pass, imp_modelview, imp_color;
+static GLint imp_eye_to_shadow, imp_shadowed;
+
+// attribute locations, in the order they're bound
+enum {
+    ATTR_POSITION, ATTR_INSTANCE, ATTR_SELECTED
+};
+
+static const char *attribs[] = { "a_position", "a_instance", "a_selected", NULL };
+
+// Fixed function lighting for GL_LIGHT0 (directional, local viewer) done
+// per vertex, so the instanced spheres look like the ones drawn one by one.
+// What the light adds directly is kept apart from the ambient part so the
+// fragment shader can take it away where the shadow map (shadowmap.h) says
+// the light is blocked. Shadows are looked up at the sphere's own position,
+// offset_y aside, so the reflection shows them too.
+static const char *vertex_src =
+    "#version 120\n"
+    "attribute vec3 a_position;\n"      // unit sphere, doubles as the normal
+    "attribute vec4 a_instance;\n"      // xyz centre, w radius
+    "attribute float a_selected;\n"
+    "uniform float u_offset_y;\n"
+    "uniform float u_shell_scale;\n"
+    "uniform int u_pass;\n"
+    "uniform mat4 u_shadow_matrix;\n"
+    "varying vec4 v_color;\n"           // ambient, or everything when unlit
+    "varying vec3 v_light;\n"           // diffuse and specular from the light
+    "varying vec4 v_shadow;\n"
+    "void main() {\n"
+    "    float r = a_instance.w;\n"
+    "    if( u_pass == 2 ) r *= u_shell_scale * a_selected;\n"
+    "    vec3 p = a_position * r + a_instance.xyz;\n"
+    "    vec4 eye = gl_ModelViewMatrix * vec4( p + vec3( 0.0, u_offset_y, 0.0 ), 1.0 );\n"
+    "    gl_Position = gl_ProjectionMatrix * eye;\n"
+    "    v_shadow = u_shadow_matrix * vec4( p, 1.0 );\n"
+    "    v_light = vec3( 0.0 );\n"
+    "    if( u_pass != 0 ) {\n"
+    "        v_color = gl_Color;\n"
+    "        return;\n"
+    "    }\n"
+    "    vec3 n = normalize( gl_NormalMatrix * a_position );\n"
+    "    vec3 l = normalize( gl_LightSource[0].position.xyz );\n"
+    "    vec3 h = normalize( l + normalize( -eye.xyz ) );\n"
+    "    float ndotl = max( dot( n, l ), 0.0 );\n"
+    "    vec4 c = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient;\n"
+    "    vec4 lit = ndotl * gl_FrontLightProduct[0].diffuse;\n"
+    "    if( ndotl > 0.0 )\n"
+    "        lit += pow( max( dot( n, h ), 0.0 ), gl_FrontMaterial.shininess ) *\n"
+    "               gl_FrontLightProduct[0].specular;\n"
+    "    v_color = vec4( c.rgb, gl_FrontMaterial.diffuse.a );\n"
+    "    v_light = lit.rgb;\n"
+    "}\n";
+
+static const char *fragment_src =
+    "#version 120\n"
+    "uniform int u_shadowed;\n"
+    "uniform sampler2DShadow u_shadow_map;\n"
+    "varying vec4 v_color;\n"
+    "varying vec3 v_light;\n"
+    "varying vec4 v_shadow;\n"
+    "void main() {\n"
+    "    float lit = 1.0;\n"
+    "    if( u_shadowed != 0 )\n"
+    "        lit = shadow2DProj( u_shadow_map, v_shadow ).r;\n"
+    "    gl_FragColor = vec4( v_color.rgb + v_light * lit, v_color.a );\n"
+    "}\n";
+
+// The same lighting for the shader pipeline, from its blocks instead of the
+// fixed function state. The light's position is in world space, so it
+// goes through the draw's model and view like the spheres do.
+static const char *core_vertex_src =
+    "#version 330 core\n"
+    PIPELINE_BLOCKS_GLSL
+    "in vec3 a_position;\n"
+    "in vec4 a_instance;\n"
+    "in float a_selected;\n"
+    "uniform float u_offset_y;\n"
+    "uniform float u_shell_scale;\n"
+    "uniform int u_pass;\n"
+    "uniform mat4 u_modelview;\n"
+    "uniform vec4 u_color;\n"
+    "uniform mat4 u_shadow_matrix;\n"
+    "out vec4 v_color;\n"
+    "out vec3 v_light;\n"
+    "out vec4 v_shadow;\n"
+    "void main() {\n"
+    "    float r = a_instance.w;\n"
+    "    if( u_pass == 2 ) r *= u_shell_scale * a_selected;\n"
+    "    vec3 p = a_position * r + a_instance.xyz;\n"
+    "    vec4 eye = u_modelview * vec4( p + vec3( 0.0, u_offset_y, 0.0 ), 1.0 );\n"
+    "    gl_Position = camera.projection * eye;\n"
+    "    v_shadow = u_shadow_matrix * vec4( p, 1.0 );\n"
+    "    v_light = vec3( 0.0 );\n"
+    "    if( u_pass != 0 ) {\n"
+    "        v_color = u_color;\n"
+    "        return;\n"
+    "    }\n"
+    "    mat3 m = mat3( u_modelview );\n"
+    "    vec3 n = normalize( m * a_position );\n"
+    "    vec3 l = normalize( m * light.position.xyz );\n"
+    "    vec3 h = normalize( l + normalize( -eye.xyz ) );\n"
+    "    float ndotl = max( dot( n, l ), 0.0 );\n"
+    "    vec4 c = material.emission + material.ambient * light.scene_ambient +\n"
+    "             material.ambient * light.ambient;\n"
+    "    vec4 lit = ndotl * material.diffuse * light.diffuse;\n"
+    "    if( ndotl > 0.0 )\n"
+    "        lit += pow( max( dot( n, h ), 0.0 ), material.shininess ) *\n"
+    "               material.specular * light.specular;\n"
+    "    v_color = vec4( c.rgb, material.diffuse.a );\n"
+    "    v_light = lit.rgb;\n"
+    "}\n";
+
+static const char *core_fragment_src =
+    "#version 330 core\n"
+    "uniform int u_shadowed;\n"
+    "uniform sampler2DShadow u_shadow_map;\n"
+    "in vec4 v_color;\n"
+    "in vec3 v_light;\n"
+    "in vec4 v_shadow;\n"
+    "out vec4 frag_color;\n"
+    "void main() {\n"
+    "    float lit = 1.0;\n"
+    "    if( u_shadowed != 0 )\n"
+    "        lit = textureProj( u_shadow_map, v_shadow );\n"
+    "    frag_color = vec4( v_color.rgb + v_light * lit, v_color.a );\n"
+    "}\n";
+
+// Impostors: each sphere is one quad facing the eye, big enough to cover
+// its outline, and the fragment shader finds where the view ray through
+// the pixel meets the sphere. That gives the depth written and the normal
+// lit, per pixel, with the same light and material as above. Projections
+// with w = 1 in their last row are orthographic (the shadow map's), where
+// every ray runs straight down -z.
+//
+// The quad sits where the sphere is nearest the eye, so the depth written
+// is never nearer than the quad's own; where the driver has conservative
+// depth that lets it keep testing depth before the fragment shader runs.
+static const char *impostor_vertex_src =
+    "#version 330 core\n"
+    PIPELINE_BLOCKS_GLSL
+    "in vec2 a_corner;\n"              // -1..1 across the quad
+    "in vec4 a_instance;\n"
+    "in float a_selected;\n"
+    "uniform float u_offset_y;\n"
+    "uniform float u_shell_scale;\n"
+    "uniform int u_pass;\n"
+    "uniform mat4 u_modelview;\n"
+    "out vec3 v_eye;\n"                // the quad's point, eye space
+    "flat out vec3 v_center;\n"
+    "flat out float v_radius;\n"
+    "void main() {\n"
+    "    float r = a_instance.w;\n"
+    "    if( u_pass == 2 ) r *= u_shell_scale * a_selected;\n"
+    "    vec3 c = ( u_modelview * vec4( a_instance.xyz + vec3( 0.0, u_offset_y, 0.0 ), 1.0 ) ).xyz;\n"
+    "    vec3 x = vec3( 1.0, 0.0, 0.0 ), y = vec3( 0.0, 1.0, 0.0 );\n"
+    "    vec3 front = c + vec3( 0.0, 0.0, r );\n"
+    "    float size = r;\n"
+    "    if( camera.projection[3][3] != 1.0 ) {\n"
+    "        // Seen from the eye the outline is where the cone touching the\n"
+    "        // sphere crosses the plane through its nearest point\n"
+    "        float d = length( c );\n"
+    "        vec3 w = c / d;\n"
+    "        x = normalize( cross( abs( w.y ) < 0.99 ? vec3( 0.0, 1.0, 0.0 ) : vec3( 1.0, 0.0, 0.0 ), w ) );\n"
+    "        y = cross( w, x );\n"
+    "        front = c - w * r;\n"
+    "        size = d > r ? r * ( d - r ) / sqrt( d * d - r * r ) : 0.0;\n"
+    "    }\n"
+    "    v_eye = front + ( a_corner.x * x + a_corner.y * y ) * size;\n"
+    "    v_center = c;\n"
+    "    v_radius = r;\n"
+    "    gl_Position = camera.projection * vec4( v_eye, 1.0 );\n"
+    "}\n";
+
+static const char *impostor_fragment_src =
+    "#version 330 core\n"
+    "#extension GL_ARB_conservative_depth : enable\n"
+    PIPELINE_BLOCKS_GLSL
+    "#ifdef GL_ARB_conservative_depth\n"
+    "layout(depth_greater) out float gl_FragDepth;\n"
+    "#endif\n"
+    "uniform int u_pass;\n"
+    "uniform mat4 u_modelview;\n"
+    "uniform vec4 u_color;\n"
+    "uniform int u_shadowed;\n"
+    "uniform mat4 u_eye_to_shadow;\n"
+    "uniform sampler2DShadow u_shadow_map;\n"
+    "in vec3 v_eye;\n"
+    "flat in vec3 v_center;\n"
+    "flat in float v_radius;\n"
+    "out vec4 frag_color;\n"
+    "void main() {\n"
+    "    bool ortho = camera.projection[3][3] == 1.0;\n"
+    "    vec3 o = ortho ? v_eye : vec3( 0.0 );\n"
+    "    vec3 d = ortho ? vec3( 0.0, 0.0, -1.0 ) : normalize( v_eye );\n"
+    "    vec3 oc = o - v_center;\n"
+    "    float b = dot( oc, d );\n"
+    "    float h = b * b - dot( oc, oc ) + v_radius * v_radius;\n"
+    "    if( h < 0.0 )\n"
+    "        discard;\n"
+    "    h = sqrt( h );\n"
+    "\n"
+    "    // The depth pass keeps the far side, like the meshes' back faces\n"
+    "    vec3 hit = o + d * ( u_pass == 3 ? -b + h : -b - h );\n"
+    "    vec4 clip = camera.projection * vec4( hit, 1.0 );\n"
+    "    gl_FragDepth = 0.5 * clip.z / clip.w + 0.5;\n"
+    "    if( u_pass != 0 ) {\n"
+    "        frag_color = u_color;\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    vec3 n = ( hit - v_center ) / v_radius;\n"
+    "    vec3 l = normalize( mat3( u_modelview ) * light.position.xyz );\n"
+    "    vec3 e = ortho ? vec3( 0.0, 0.0, 1.0 ) : normalize( -hit );\n"
+    "    vec3 half_way = normalize( l + e );\n"
+    "    float ndotl = max( dot( n, l ), 0.0 );\n"
+    "    vec4 c = material.emission + material.ambient * light.scene_ambient +\n"
+    "             material.ambient * light.ambient;\n"
+    "    vec4 lit = ndotl * material.diffuse * light.diffuse;\n"
+    "    if( ndotl > 0.0 )\n"
+    "        lit += pow( max( dot( n, half_way ), 0.0 ), material.shininess ) *\n"
+    "               material.specular * light.specular;\n"
+    "    float unshadowed = 1.0;\n"
+    "    if( u_shadowed != 0 )\n"
+    "        unshadowed = textureProj( u_shadow_map, u_eye_to_shadow * vec4( hit, 1.0 ) );\n"
+    "    frag_color = vec4( c.rgb + lit.rgb * unshadowed, material.diffuse.a );\n"
+    "}\n";
+
+static const char *impostor_attribs[] = { "a_corner", "a_instance", "a_selected", NULL };
+
+//-----------------------------------------------------------------------------
+// Sets up the instancing program and buffer. Returns FALSE (0) and leaves
+// sphere_instancing off if the driver can't do it.
+//-----------------------------------------------------------------------------
+int sphere_instancing_init( void ) {
+    sphere_instancing = 0;
+
+    if( !gl_version_at_least( 3, 3 ) ) {
+        printf( "tron: GL 3.3 not available, drawing spheres one at a time.\n" );
+        return 0;
+    }
+
+    program = shader_build( "sphere instancing", vertex_src, fragment_src, attribs );
+    if( !program )
+        return 0;
+
+    u_offset_y = glGetUniformLocation( program, "u_offset_y" );
+    u_shell_scale = glGetUniformLocation( program, "u_shell_scale" );
+    u_pass = glGetUniformLocation( program, "u_pass" );
+    u_shadow_matrix = glGetUniformLocation( program, "u_shadow_matrix" );
+    u_shadowed = glGetUniformLocation( program, "u_shadowed" );
+
+    // The shadow map always goes on texture unit SPHERE_SHADOW_UNIT
+    glUseProgram( program );
+    glUniform1i( glGetUniformLocation( program, "u_shadow_map" ), SPHERE_SHADOW_UNIT );
+    glUseProgram( 0 );
+
+    glGenBuffers( 1, &instance_vbo );
+
+    sphere_instancing = 1;
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Builds the shader pipeline's program, once sphere_instancing_init has
+// succeeded. Returns FALSE (0) if it won't build.
+//-----------------------------------------------------------------------------
+int sphere_instancing_core_init( void ) {
+    core_program = shader_build( "sphere pipeline", core_vertex_src, core_fragment_src, attribs );
+    if( !core_program )
+        return 0;
+
+    core_offset_y = glGetUniformLocation( core_program, "u_offset_y" );
+    core_shell_scale = glGetUniformLocation( core_program, "u_shell_scale" );
+    core_pass = glGetUniformLocation( core_program, "u_pass" );
+    core_modelview = glGetUniformLocation( core_program, "u_modelview" );
+    core_color = glGetUniformLocation( core_program, "u_color" );
+    core_shadow_matrix = glGetUniformLocation( core_program, "u_shadow_matrix" );
+    core_shadowed = glGetUniformLocation( core_program, "u_shadowed" );
+
+    pipeline_program( core_program );
+    glUseProgram( core_program );
+    glUniform1i( glGetUniformLocation( core_program, "u_shadow_map" ), SPHERE_SHADOW_UNIT );
+    glUseProgram( 0 );
+
+    // The attribute pointers change with every level drawn, so this only
+    // stands in for the default vertex array core profiles don't have
+    glGenVertexArrays( 1, &core_vao );
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Builds the impostor program, once the shader pipeline is up. Returns
+// FALSE (0) and leaves sphere_impostors off if it can't.
+//-----------------------------------------------------------------------------
+int sphere_impostors_init( void ) {
+    static const GLfloat corners[8] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+
+    sphere_impostors = 0;
+    if( !pipeline_core ) {
+        printf( "tron: sphere impostors need the core renderer, drawing meshes.\n" );
+        return 0;
+    }
+
+    impostor_program = shader_build( "sphere impostor", impostor_vertex_src,
+                                     impostor_fragment_src, impostor_attribs );
+    if( !impostor_program )
+        return 0;
+
+    imp_offset_y = glGetUniformLocation( impostor_program, "u_offset_y" );
+    imp_shell_scale = glGetUniformLocation( impostor_program, "u_shell_scale" );
+    imp_pass = glGetUniformLocation( impostor_program, "u_pass" );
+    imp_modelview = glGetUniformLocation( impostor_program, "u_modelview" );
+    imp_color = glGetUniformLocation( impostor_program, "u_color" );
+    imp_eye_to_shadow = glGetUniformLocation( impostor_program, "u_eye_to_shadow" );
+    imp_shadowed = glGetUniformLocation( impostor_program, "u_shadowed" );
+
+    pipeline_program( impostor_program );
+    glUseProgram( impostor_program );
+    glUniform1i( glGetUniformLocation( impostor_program, "u_shadow_map" ), SPHERE_SHADOW_UNIT );
+    glUseProgram( 0 );
+
+    glGenBuffers( 1, &corner_vbo );
+    glBindBuffer( GL_ARRAY_BUFFER, corner_vbo );
+    glBufferData( GL_ARRAY_BUFFER, sizeof( corners ), corners, GL_STATIC_DRAW );
+
+    // The corners stay put; the instance pointers move with the list drawn
+    glGenVertexArrays( 1, &impostor_vao );
+    glBindVertexArray( impostor_vao );
+    glEnableVertexAttribArray( ATTR_POSITION );
+    glVertexAttribPointer( ATTR_POSITION, 2, GL_FLOAT, GL_FALSE, 0, (const GLvoid*) 0 );
+    glEnableVertexAttribArray( ATTR_INSTANCE );
+    glEnableVertexAttribArray( ATTR_SELECTED );
+    glVertexAttribDivisor( ATTR_INSTANCE, 1 );
+    glVertexAttribDivisor( ATTR_SELECTED, 1 );
+    glBindVertexArray( 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+    sphere_impostors = 1;
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Draws a list's instances as impostors, all levels in one call; the
+// shell pass draws only the list's shells. Face
+// culling is off while they draw, since the quads face the eye whatever the
+// model does to them.
+//-----------------------------------------------------------------------------
+static void impostors_draw( int list, int pass, GLfloat offset_y, GLfloat shell_scale ) {
+    GLsizei stride = sizeof( struct SphereInstance_t );
+    int group = pass == SPHERE_PASS_SHELL ? RQ_SHELL : RQ_OPAQUE;
+    const GLubyte* base = (const GLubyte*) 0 + lod_first[list][group][0] * stride;
+    GLsizei count = 0;
+    int l;
+
+    for( l = 0; l < LOD_LEVELS; l++ )
+        count += lod_count[list][group][l];
+    if( count == 0 )
+        return;
+
+    glUseProgram( impostor_program );
+    glUniform1f( imp_offset_y, offset_y );
+    glUniform1f( imp_shell_scale, shell_scale );
+    glUniform1i( imp_pass, pass );
+    glUniformMatrix4fv( imp_modelview, 1, GL_FALSE, pipeline.modelview );
+    glUniform4fv( imp_color, 1, pipeline.color );
+
+    // Shadows are looked up where the hit is in the sphere's own space,
+    // so the reflection shows them where the spheres have them
+    if( pass == SPHERE_PASS_LIT && shadow_mapping ) {
+        float lifted[16], to_model[16], eye_to_shadow[16];
+
+        mat4_copy( lifted, pipeline.modelview );
+        mat4_translate( lifted, 0.0f, offset_y, 0.0f );
+        mat4_invert( to_model, lifted );
+        mat4_multiply( eye_to_shadow, shadow_map.texture_matrix, to_model );
+
+        glUniform1i( imp_shadowed, 1 );
+        glUniformMatrix4fv( imp_eye_to_shadow, 1, GL_FALSE, eye_to_shadow );
+        glActiveTexture( GL_TEXTURE0 + SPHERE_SHADOW_UNIT );
+        glBindTexture( GL_TEXTURE_2D, shadow_map.texture );
+        glActiveTexture( GL_TEXTURE0 );
+    } else {
+        glUniform1i( imp_shadowed, 0 );
+    }
+
+    glBindVertexArray( impostor_vao );
+    glBindBuffer( GL_ARRAY_BUFFER, instance_vbo );
+    glVertexAttribPointer( ATTR_INSTANCE, 4, GL_FLOAT, GL_FALSE, stride, base );
+    glVertexAttribPointer( ATTR_SELECTED, 1, GL_FLOAT, GL_FALSE, stride,
+                           base + 4 * sizeof( GLfloat ) );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+    glstate_disable( GL_CULL_FACE );
+    glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, count );
+    glstate_enable( GL_CULL_FACE );
+
+    glBindVertexArray( 0 );
+    glUseProgram( 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Packs the visible spheres of every pass into the instance buffer. Call
+// once per frame after picking, once the render queues are built.
+//-----------------------------------------------------------------------------
+void sphere_instances_update( void ) {
+    GLsizei next[LOD_LEVELS];
+    int list, g, i, l, needed;
+
+    if( !sphere_instancing )
+        return;
+
+    // Every list holds each sphere at most once, and the shells at most once
+    // more
+    needed = view.spheres.capacity * ( CULL_LISTS + 1 );
+    if( instance_capacity < needed ) {
+        free( instances );
+        instance_capacity = needed;
+        instances = malloc( sizeof( struct SphereInstance_t ) * instance_capacity );
+        if( !instances ) {
+            printf( "tron: Sorry, out of memory for sphere instances.\n" );
+            exit( 1 );
+        }
+    }
+
+    instance_count = 0;
+    for( list = 0; list < CULL_LISTS; list++ ) {
+        const struct RenderQueue_t* q = &render_queues[list];
+
+        for( g = 0; g < RQ_GROUPS; g++ ) {
+            GLsizei *first = lod_first[list][g], *count = lod_count[list][g];
+
+            // Count each level first so the instances can be laid out
+            // grouped by level in one more pass, in queue order (front to
+            // back, or back to front for shells) within each level
+            memset( count, 0, sizeof( lod_count[list][g] ) );
+            for( i = q->first[g]; i < q->first[g + 1]; i++ )
+                count[view.spheres.lod[q->items[i].sphere]]++;
+
+            for( l = 0; l < LOD_LEVELS; l++ ) {
+                first[l] = instance_count;
+                instance_count += count[l];
+                next[l] = first[l];
+            }
+
+            for( i = q->first[g]; i < q->first[g + 1]; i++ ) {
+                int s = q->items[i].sphere;
+                struct SphereInstance_t* inst = &instances[next[view.spheres.lod[s]]++];
+
+                inst->x = -view.spheres.x[s];
+                inst->y = view.spheres.y[s];
+                inst->z = -view.spheres.z[s];
+                inst->radius = view.spheres.size[s];
+                inst->selected = ( view.spheres.state[s] & SPHERE_SELECTED ) ? 1.0f : 0.0f;
+            }
+        }
+    }
+
+    // Respecify the whole buffer so the driver can hand us fresh storage
+    // rather than wait for last frame's draws.
+    glBindBuffer( GL_ARRAY_BUFFER, instance_vbo );
+    glBufferData( GL_ARRAY_BUFFER, sizeof( struct SphereInstance_t ) * instance_count,
+                  instances, GL_STREAM_DRAW );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Draws one visible list's instances under the current modelview matrix,
+// one call per level of detail, or under the shader pipeline's camera and
+// model when it's on. The shell pass draws only the list's shells, the
+// others only its spheres. offset_y lifts the whole set and lod_bias draws
+// every group that many levels coarser.
+//-----------------------------------------------------------------------------
+void sphere_instances_draw( int list, int pass, GLfloat offset_y, GLfloat shell_scale,
+                            int lod_bias ) {
+    GLsizei stride = sizeof( struct SphereInstance_t );
+    GLint shadowed, shadow_matrix;
+    int group = pass == SPHERE_PASS_SHELL ? RQ_SHELL : RQ_OPAQUE;
+    int l;
+
+    if( !sphere_instancing || instance_count == 0 )
+        return;
+
+    // Impostors can't follow the planar shadows' flattening projection
+    if( sphere_impostors && pass != SPHERE_PASS_FLAT ) {
+        impostors_draw( list, pass, offset_y, shell_scale );
+        return;
+    }
+
+    if( pipeline_core ) {
+        glUseProgram( core_program );
+        glBindVertexArray( core_vao );
+        glUniform1f( core_offset_y, offset_y );
+        glUniform1f( core_shell_scale, shell_scale );
+        glUniform1i( core_pass, pass );
+        glUniformMatrix4fv( core_modelview, 1, GL_FALSE, pipeline.modelview );
+        glUniform4fv( core_color, 1, pipeline.color );
+        shadowed = core_shadowed;
+        shadow_matrix = core_shadow_matrix;
+    } else {
+        glUseProgram( program );
+        glUniform1f( u_offset_y, offset_y );
+        glUniform1f( u_shell_scale, shell_scale );
+        glUniform1i( u_pass, pass );
+        shadowed = u_shadowed;
+        shadow_matrix = u_shadow_matrix;
+    }
+
+    // Lit passes take shadows from this frame's map
+    if( pass == SPHERE_PASS_LIT && shadow_mapping ) {
+        glUniform1i( shadowed, 1 );
+        glUniformMatrix4fv( shadow_matrix, 1, GL_FALSE, shadow_map.texture_matrix );
+        glActiveTexture( GL_TEXTURE0 + SPHERE_SHADOW_UNIT );
+        glBindTexture( GL_TEXTURE_2D, shadow_map.texture );
+        glActiveTexture( GL_TEXTURE0 );
+    } else {
+        glUniform1i( shadowed, 0 );
+    }
+
+    glEnableVertexAttribArray( ATTR_POSITION );
+    glEnableVertexAttribArray( ATTR_INSTANCE );
+    glEnableVertexAttribArray( ATTR_SELECTED );
+    glVertexAttribDivisor( ATTR_INSTANCE, 1 );
+    glVertexAttribDivisor( ATTR_SELECTED, 1 );
+
+    for( l = 0; l < LOD_LEVELS; l++ ) {
+        struct SphereMesh_t* mesh;
+        const GLubyte* base = (const GLubyte*) 0 + lod_first[list][group][l] * stride;
+
+        if( lod_count[list][group][l] == 0 )
+            continue;
+        mesh = sphere_mesh_lod( lod_biased( l, lod_bias ) );
+
+        glBindBuffer( GL_ARRAY_BUFFER, mesh->vbo );
+        glVertexAttribPointer( ATTR_POSITION, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid*) 0 );
+
+        glBindBuffer( GL_ARRAY_BUFFER, instance_vbo );
+        glVertexAttribPointer( ATTR_INSTANCE, 4, GL_FLOAT, GL_FALSE, stride, base );
+        glVertexAttribPointer( ATTR_SELECTED, 1, GL_FLOAT, GL_FALSE, stride,
+                               base + 4 * sizeof( GLfloat ) );
+
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mesh->ibo );
+        glDrawElementsInstanced( GL_TRIANGLES, mesh->index_count, GL_UNSIGNED_SHORT,
+                                 (const GLvoid*) 0, lod_count[list][group][l] );
+    }
+
+    glVertexAttribDivisor( ATTR_INSTANCE, 0 );
+    glVertexAttribDivisor( ATTR_SELECTED, 0 );
+    glDisableVertexAttribArray( ATTR_SELECTED );
+    glDisableVertexAttribArray( ATTR_INSTANCE );
+    glDisableVertexAttribArray( ATTR_POSITION );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    if( pipeline_core )
+        glBindVertexArray( 0 );
+    glUseProgram( 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Releases the shader pipeline's programs
+//-----------------------------------------------------------------------------
+void sphere_instancing_core_shutdown( void ) {
+    if( core_program )
+        glDeleteProgram( core_program );
+    if( core_vao )
+        glDeleteVertexArrays( 1, &core_vao );
+    if( impostor_program )
+        glDeleteProgram( impostor_program );
+    if( impostor_vao )
+        glDeleteVertexArrays( 1, &impostor_vao );
+    if( corner_vbo )
+        glDeleteBuffers( 1, &corner_vbo );
+    core_program = core_vao = 0;
+    impostor_program = impostor_vao = corner_vbo = 0;
+    sphere_impostors = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Releases the program and buffers
+//-----------------------------------------------------------------------------
+void sphere_instancing_shutdown( void ) {
+    if( program )
+        glDeleteProgram( program );
+    if( instance_vbo )
+        glDeleteBuffers( 1, &instance_vbo );
+    free( instances );
+
+    instances = NULL;
+    instance_capacity = 0;
+    instance_count = 0;
+    program = instance_vbo = 0;
+    sphere_instancing = 0;
+}
@@ -0,0 +1,44 @@
+// sphereinst.h
+// Instanced sphere rendering. Every frame the visible spheres of each pass
+// (see cull.h) are packed into one per-instance buffer (centre, radius,
+// selection), grouped by level of detail and in render queue order
+// (renderqueue.h) within each level. Each pass then draws its spheres
+// with one glDrawElementsInstanced per level, so the draw call count stays
+// flat as the sphere count grows.
+//
+// Needs GL 3.3 for instanced arrays; when that's missing the renderer keeps
+// drawing one sphere at a time. There are two programs: one lit by the fixed
+// function state and one for the shader pipeline (pipeline.h).
+//
+// With the shader pipeline the spheres can also be drawn as impostors: one
+// quad per sphere, ray cast per pixel into an exact sphere with the right
+// depth and lighting, whatever the level of detail. They take every pass
+// but SPHERE_PASS_FLAT, whose projection onto the floor they can't follow,
+// so the planar shadows keep the meshes.
+#ifndef SPHEREINST_H
+#define SPHEREINST_H
+
+#include <GL/glut.h>
+
+// What a pass does with the instances
+#define SPHERE_PASS_LIT   0     // lit with GL_LIGHT0 and the current material
+#define SPHERE_PASS_FLAT  1     // current color, no lighting (shadows)
+#define SPHERE_PASS_SHELL 2     // selected spheres only, scaled by shell_scale
+#define SPHERE_PASS_DEPTH 3     // current color, far side kept (shadow map casters)
+
+// Texture unit the lit pass reads the shadow map from
+#define SPHERE_SHADOW_UNIT 1
+
+extern int sphere_instancing;   // TRUE once sphere_instancing_init succeeded
+extern int sphere_impostors;    // TRUE once sphere_impostors_init succeeded
+
+int sphere_instancing_init( void );
+int sphere_instancing_core_init( void );
+int sphere_impostors_init( void );
+void sphere_instances_update( void );
+void sphere_instances_draw( int list, int pass, GLfloat offset_y, GLfloat shell_scale,
+                            int lod_bias );
+void sphere_instancing_core_shutdown( void );
+void sphere_instancing_shutdown( void );
+
+#endif
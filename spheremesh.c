@@ -0,0 +1,159 @@
+// spheremesh.c
+// Cached VBO sphere meshes. See spheremesh.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "spheremesh.h"
+#include "lod.h"
+
+// Some <math.h> files do not define M_PI...
+#ifndef M_PI
+#define M_PI 3.14159265
+#endif
+
+static struct SphereMesh_t mesh_cache[SPHERE_MESH_CACHE_SIZE];
+static int mesh_cache_used = 0;
+
+//-----------------------------------------------------------------------------
+// Tessellates a unit sphere into the mesh's buffers. Same orientation as
+// glutSolidSphere: the poles are on the z axis.
+//-----------------------------------------------------------------------------
+static void sphere_mesh_build( struct SphereMesh_t* mesh ) {
+    int slices = mesh->slices, stacks = mesh->stacks;
+    int vertex_count = (slices + 1) * (stacks + 1);
+    GLfloat *vertices, *v;
+    GLushort *indices, *idx;
+    int i, j;
+
+    vertices = malloc( sizeof( GLfloat ) * 3 * vertex_count );
+    indices = malloc( sizeof( GLushort ) * 6 * slices * stacks );
+    if( !vertices || !indices ) {
+        printf( "tron: Sorry, out of memory building sphere meshes.\n" );
+        exit( 1 );
+    }
+
+    // One ring of vertices per stack, pole to pole. The seam vertex is
+    // repeated so every quad indexes its own corners.
+    v = vertices;
+    for( i = 0; i <= stacks; i++ ) {
+        float theta = M_PI * i / stacks;
+        for( j = 0; j <= slices; j++ ) {
+            float phi = 2.0 * M_PI * j / slices;
+            *v++ = sin( theta ) * cos( phi );
+            *v++ = sin( theta ) * sin( phi );
+            *v++ = cos( theta );
+        }
+    }
+
+    // Two counter-clockwise triangles per quad
+    idx = indices;
+    for( i = 0; i < stacks; i++ ) {
+        for( j = 0; j < slices; j++ ) {
+            GLushort a = i * (slices + 1) + j;
+            GLushort b = a + (slices + 1);
+
+            *idx++ = a;
+            *idx++ = b;
+            *idx++ = b + 1;
+            *idx++ = a;
+            *idx++ = b + 1;
+            *idx++ = a + 1;
+        }
+    }
+    mesh->index_count = idx - indices;
+
+    glGenBuffers( 1, &mesh->vbo );
+    glBindBuffer( GL_ARRAY_BUFFER, mesh->vbo );
+    glBufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * 3 * vertex_count, vertices, GL_STATIC_DRAW );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+    glGenBuffers( 1, &mesh->ibo );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mesh->ibo );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( GLushort ) * mesh->index_count, indices, GL_STATIC_DRAW );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+
+    free( vertices );
+    free( indices );
+}
+
+//-----------------------------------------------------------------------------
+// Returns the cached mesh for this tessellation, building it on first use
+//-----------------------------------------------------------------------------
+struct SphereMesh_t* sphere_mesh_get( int slices, int stacks ) {
+    struct SphereMesh_t* mesh;
+    int i;
+
+    for( i = 0; i < mesh_cache_used; i++ ) {
+        if( mesh_cache[i].slices == slices && mesh_cache[i].stacks == stacks )
+            return &mesh_cache[i];
+    }
+
+    // 16 bit indices
+    if( mesh_cache_used == SPHERE_MESH_CACHE_SIZE ||
+        slices < 3 || stacks < 2 || (slices + 1) * (stacks + 1) > 65535 ) {
+        printf( "tron: can't cache a %dx%d sphere mesh\n", slices, stacks );
+        exit( 1 );
+    }
+
+    mesh = &mesh_cache[mesh_cache_used++];
+    mesh->slices = slices;
+    mesh->stacks = stacks;
+    sphere_mesh_build( mesh );
+
+    return mesh;
+}
+
+//-----------------------------------------------------------------------------
+// The mesh for a level of detail, see lod.h
+//-----------------------------------------------------------------------------
+struct SphereMesh_t* sphere_mesh_lod( int level ) {
+    const struct LodLevel_t* l = &lod_config.levels[level];
+
+    return sphere_mesh_get( l->slices, l->stacks );
+}
+
+//-----------------------------------------------------------------------------
+// Sets up the vertex arrays for a run of sphere_mesh_draw calls
+//-----------------------------------------------------------------------------
+void sphere_mesh_bind( const struct SphereMesh_t* mesh ) {
+    glBindBuffer( GL_ARRAY_BUFFER, mesh->vbo );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mesh->ibo );
+
+    // A unit sphere's positions are its normals
+    glEnableClientState( GL_VERTEX_ARRAY );
+    glEnableClientState( GL_NORMAL_ARRAY );
+    glVertexPointer( 3, GL_FLOAT, 0, (const GLvoid*) 0 );
+    glNormalPointer( GL_FLOAT, 0, (const GLvoid*) 0 );
+}
+
+void sphere_mesh_unbind( void ) {
+    glDisableClientState( GL_NORMAL_ARRAY );
+    glDisableClientState( GL_VERTEX_ARRAY );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Draws the bound mesh at the given radius around the current origin. Needs
+// GL_RESCALE_NORMAL (or GL_NORMALIZE) to keep the lighting right.
+//-----------------------------------------------------------------------------
+void sphere_mesh_draw( const struct SphereMesh_t* mesh, GLfloat radius ) {
+    glPushMatrix();
+    glScalef( radius, radius, radius );
+    glDrawElements( GL_TRIANGLES, mesh->index_count, GL_UNSIGNED_SHORT, (const GLvoid*) 0 );
+    glPopMatrix();
+}
+
+//-----------------------------------------------------------------------------
+// Frees every cached mesh
+//-----------------------------------------------------------------------------
+void sphere_mesh_shutdown( void ) {
+    int i;
+
+    for( i = 0; i < mesh_cache_used; i++ ) {
+        glDeleteBuffers( 1, &mesh_cache[i].vbo );
+        glDeleteBuffers( 1, &mesh_cache[i].ibo );
+    }
+    mesh_cache_used = 0;
+}
@@ -0,0 +1,31 @@
+// spheremesh.h
+// Cache of unit sphere meshes kept in vertex buffer objects. Each
+// (slices, stacks) pair is tessellated once; spheres of any size are then
+// drawn from it with a scale transform instead of rebuilding the geometry
+// through glutSolidSphere every time.
+#ifndef SPHEREMESH_H
+#define SPHEREMESH_H
+
+#include <GL/glut.h>
+
+#define SPHERE_MESH_CACHE_SIZE 8
+
+// Tessellation the game has always drawn its spheres with
+#define SPHERE_SLICES 20
+#define SPHERE_STACKS 20
+
+struct SphereMesh_t {
+    int slices, stacks;
+    GLuint vbo;             // unit sphere positions, which double as normals
+    GLuint ibo;             // triangle list
+    GLsizei index_count;
+};
+
+struct SphereMesh_t* sphere_mesh_get( int slices, int stacks );
+struct SphereMesh_t* sphere_mesh_lod( int level );
+void sphere_mesh_bind( const struct SphereMesh_t* mesh );
+void sphere_mesh_unbind( void );
+void sphere_mesh_draw( const struct SphereMesh_t* mesh, GLfloat radius );
+void sphere_mesh_shutdown( void );
+
+#endif
@@ -0,0 +1,328 @@
+// view.c
+// Simulation snapshots and the render view. See view.h.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "view.h"
+#include "replay.h"
+#include "jobs.h"
+
+// set on the ready index while the renderer hasn't taken it
+#define SNAPSHOT_FRESH 4
+
+struct View_t view;
+
+static struct Snapshot_t snapshots[VIEW_SNAPSHOTS];
+static int back = 0;                    // simulation thread's
+static int front = 1;                   // renderer's
+static int ready = 2;                   // latest finished, atomic
+static int threaded = 0;
+
+//-----------------------------------------------------------------------------
+// Allocates one aligned view or snapshot array of spheres.capacity entries
+//-----------------------------------------------------------------------------
+static void* view_alloc( size_t elem_size ) {
+    void *p = NULL;
+    size_t bytes = elem_size * spheres.capacity;
+
+    if( posix_memalign( &p, SPHERE_ALIGN, bytes ) != 0 ) {
+        printf( "tron: Sorry, not enough memory for %d spheres.\n", spheres.count );
+        exit( 1 );
+    }
+    memset( p, 0, bytes );
+    return p;
+}
+
+//-----------------------------------------------------------------------------
+// Copies the simulation's current state into a snapshot, as the "after"
+// half of it
+//-----------------------------------------------------------------------------
+static void snapshot_fill( struct Snapshot_t* s ) {
+    int k, i;
+
+    memcpy( s->y, spheres.y, sizeof( float ) * spheres.capacity );
+    memcpy( s->size, spheres.size, sizeof( float ) * spheres.capacity );
+    memcpy( s->state, spheres.state, spheres.capacity );
+
+    for( k = 0; k < s->moved_count; k++ ) {
+        i = s->moved[k];
+        s->moved_y[1][k] = spheres.y[i];
+        s->moved_size[1][k] = spheres.size[i];
+    }
+
+    s->camera[1] = camera;
+    s->bikeTireAngle = bikeTireAngle;
+    s->bikeHandlAngle = bikeHandlAngle;
+    s->bikeAngle = bikeAngle;
+    s->score = score;
+    s->time = sim_time();
+    s->active = sim_active();
+    s->done = replay_done();
+}
+
+//-----------------------------------------------------------------------------
+// Sets the view up. threaded is TRUE when a simulation thread will feed it
+// snapshots, FALSE to alias the simulation. Call after sim_init().
+//-----------------------------------------------------------------------------
+void view_init( int is_threaded ) {
+    int n;
+
+    threaded = is_threaded;
+    view.spheres.selected = -1;
+    if( !threaded ) {
+        view_alias();
+        return;
+    }
+
+    for( n = 0; n < VIEW_SNAPSHOTS; n++ ) {
+        struct Snapshot_t* s = &snapshots[n];
+
+        s->y = view_alloc( sizeof( float ) );
+        s->size = view_alloc( sizeof( float ) );
+        s->state = view_alloc( sizeof( unsigned char ) );
+        s->moved = view_alloc( sizeof( int ) );
+        s->moved_y[0] = view_alloc( sizeof( float ) );
+        s->moved_y[1] = view_alloc( sizeof( float ) );
+        s->moved_size[0] = view_alloc( sizeof( float ) );
+        s->moved_size[1] = view_alloc( sizeof( float ) );
+        s->moved_count = 0;
+        s->camera[0] = camera;
+        s->wall_ms = 0.0;
+        s->input_seq = 0;
+        snapshot_fill( s );
+    }
+    back = 0;
+    front = 1;
+    ready = 2;
+
+    view.spheres.count = spheres.count;
+    view.spheres.capacity = spheres.capacity;
+    view.spheres.x = spheres.x;
+    view.spheres.z = spheres.z;
+    view.spheres.distance = view_alloc( sizeof( float ) );
+    view.spheres.lod = view_alloc( sizeof( unsigned char ) );
+    view.spheres.death_time = NULL;
+    view_update( 0.0 );
+}
+
+//-----------------------------------------------------------------------------
+// Points the view at the simulation's own state. The renderer's selection
+// is kept.
+//-----------------------------------------------------------------------------
+void view_alias( void ) {
+    int selected = view.spheres.selected;
+
+    view.spheres = spheres;
+    view.spheres.selected = selected;
+    view.camera = camera;
+    view.bikeTireAngle = bikeTireAngle;
+    view.bikeHandlAngle = bikeHandlAngle;
+    view.bikeAngle = bikeAngle;
+    view.score = score;
+    view.time = sim_time();
+    view.active = sim_active();
+    view.done = replay_done();
+}
+
+//-----------------------------------------------------------------------------
+// Blends a before and after value
+//-----------------------------------------------------------------------------
+static float lerp( float a, float b, float t ) {
+    return a + ( b - a ) * t;
+}
+
+static void camera_lerp( struct ThirdPersonCamera_t* out, const struct ThirdPersonCamera_t* a,
+                         const struct ThirdPersonCamera_t* b, float t ) {
+    *out = *b;
+    out->vecPos.x = lerp( a->vecPos.x, b->vecPos.x, t );
+    out->vecPos.y = lerp( a->vecPos.y, b->vecPos.y, t );
+    out->vecPos.z = lerp( a->vecPos.z, b->vecPos.z, t );
+
+    // Don't swing the long way round when the angle wraps at 360
+    if( fabsf( b->vecRot.x - a->vecRot.x ) < 180.0f )
+        out->vecRot.x = lerp( a->vecRot.x, b->vecRot.x, t );
+    if( fabsf( b->vecRot.y - a->vecRot.y ) < 180.0f )
+        out->vecRot.y = lerp( a->vecRot.y, b->vecRot.y, t );
+}
+
+//-----------------------------------------------------------------------------
+// Brings the view up to date for a frame starting at now_ms (frametime_now()).
+// Takes the latest snapshot if there's a new one and blends it to now.
+//-----------------------------------------------------------------------------
+void view_update( double now_ms ) {
+    struct Snapshot_t* s;
+    float t;
+    int k, i;
+
+    if( !threaded ) {
+        view_alias();
+        return;
+    }
+
+    if( __atomic_load_n( &ready, __ATOMIC_ACQUIRE ) & SNAPSHOT_FRESH ) {
+        front = __atomic_exchange_n( &ready, front, __ATOMIC_ACQ_REL ) & ~SNAPSHOT_FRESH;
+
+        // The selection isn't part of the simulation; carry it over
+        if( view.spheres.selected >= 0 )
+            snapshots[front].state[view.spheres.selected] |= SPHERE_SELECTED;
+    }
+    s = &snapshots[front];
+
+    t = ( now_ms - s->wall_ms ) / ( SIM_DT * 1000.0f );
+    if( t < 0.0f )
+        t = 0.0f;
+    if( t > 1.0f )
+        t = 1.0f;
+
+    // The snapshot is ours until we let go of it, so blend in place. Only
+    // spheres that moved differ from the after state, and blending from the
+    // saved values gives the same answer however often we do it.
+    view.spheres.y = s->y;
+    view.spheres.size = s->size;
+    view.spheres.state = s->state;
+    for( k = 0; k < s->moved_count; k++ ) {
+        i = s->moved[k];
+        s->y[i] = lerp( s->moved_y[0][k], s->moved_y[1][k], t );
+        s->size[i] = lerp( s->moved_size[0][k], s->moved_size[1][k], t );
+    }
+
+    camera_lerp( &view.camera, &s->camera[0], &s->camera[1], t );
+    view.bikeTireAngle = s->bikeTireAngle;
+    view.bikeHandlAngle = s->bikeHandlAngle;
+    view.bikeAngle = s->bikeAngle;
+    view.score = s->score;
+    view.time = s->time;
+    view.input_seq = s->input_seq;
+    view.done = s->done;
+    view.active = s->active || ( t < 1.0f &&
+        ( s->moved_count > 0 || memcmp( &s->camera[0], &s->camera[1], sizeof( s->camera[0] ) ) ) );
+}
+
+//-----------------------------------------------------------------------------
+// Makes sphere i the selected one, or clears the selection for -1. The
+// selection only exists in the view.
+//-----------------------------------------------------------------------------
+void view_select( int i ) {
+    if( view.spheres.selected >= 0 )
+        view.spheres.state[view.spheres.selected] &= ~SPHERE_SELECTED;
+    view.spheres.selected = i;
+    if( i >= 0 )
+        view.spheres.state[i] |= SPHERE_SELECTED;
+}
+
+//-----------------------------------------------------------------------------
+// Distances for spheres [begin, end), a job for calculate_distances()
+//-----------------------------------------------------------------------------
+static void distances_range( void* arg, int begin, int end, int worker ) {
+    const struct Vector3 neg_camera = *(const struct Vector3*) arg;
+    int i = begin;
+
+#ifdef __SSE__
+    {
+        __m128 cx = _mm_set1_ps( neg_camera.x );
+        __m128 cz = _mm_set1_ps( neg_camera.z );
+
+        // The arrays are padded and aligned and ranges split on batches,
+        // so run straight to the end of the range
+        for( ; i < end; i += 4 ) {
+            __m128 dx = _mm_sub_ps( _mm_load_ps( view.spheres.x + i ), cx );
+            __m128 dy = _mm_load_ps( view.spheres.y + i );
+            __m128 dz = _mm_sub_ps( _mm_load_ps( view.spheres.z + i ), cz );
+            __m128 d2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ),
+                                    _mm_mul_ps( dz, dz ) );
+            _mm_store_ps( view.spheres.distance + i, _mm_sqrt_ps( d2 ) );
+        }
+    }
+#endif
+
+    for( ; i < end && i < view.spheres.count; i++ ) {
+        struct Vector3 p;
+
+        p.x = view.spheres.x[i];
+        p.y = view.spheres.y[i];
+        p.z = view.spheres.z[i];
+        view.spheres.distance[i] = distance( &neg_camera, &p );
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Desc: Calulates the distance between each sphere and the camera.
+//-----------------------------------------------------------------------------
+void calculate_distances( void ) {
+    struct Vector3 neg_camera;
+
+    // In order to accurately calculate the distance between the spheres and
+    // the camera, the x and z values should be converted to negatives, and
+    // the y coordinate should be ignored.  The camera updates the y value
+    // still, but in a 3rd person shooter/adventure style game, the is calc-
+    // lations are done seperately from the camera to compensate for jumping
+    // and gravity, etc.
+    neg_camera.x = view.camera.vecPos.x * -1.0f;
+    neg_camera.y = 0.0f;
+    neg_camera.z = view.camera.vecPos.z * -1.0f;
+
+    jobs_parallel_for( view.spheres.capacity, JOBS_SPHERE_GRAIN, distances_range, &neg_camera );
+}
+
+//-----------------------------------------------------------------------------
+// Records the "before" half of the next snapshot: the spheres about to move
+// and the camera. Simulation thread, right before sim_step().
+//-----------------------------------------------------------------------------
+void snapshot_begin( void ) {
+    struct Snapshot_t* s = &snapshots[back];
+    const int *moving;
+    int k;
+
+    s->moved_count = sim_moving( &moving );
+    memcpy( s->moved, moving, sizeof( int ) * s->moved_count );
+    for( k = 0; k < s->moved_count; k++ ) {
+        s->moved_y[0][k] = spheres.y[moving[k]];
+        s->moved_size[0][k] = spheres.size[moving[k]];
+    }
+    s->camera[0] = camera;
+}
+
+//-----------------------------------------------------------------------------
+// Finishes the snapshot with the state after the step and makes it the
+// latest. wall_ms is when the step was due.
+//-----------------------------------------------------------------------------
+void snapshot_publish( double wall_ms, unsigned int input_seq ) {
+    struct Snapshot_t* s = &snapshots[back];
+
+    snapshot_fill( s );
+    s->wall_ms = wall_ms;
+    s->input_seq = input_seq;
+    back = __atomic_exchange_n( &ready, back | SNAPSHOT_FRESH, __ATOMIC_ACQ_REL ) & ~SNAPSHOT_FRESH;
+}
+
+//-----------------------------------------------------------------------------
+// Frees the snapshots and the view's own arrays
+//-----------------------------------------------------------------------------
+void view_shutdown( void ) {
+    int n;
+
+    if( threaded ) {
+        for( n = 0; n < VIEW_SNAPSHOTS; n++ ) {
+            struct Snapshot_t* s = &snapshots[n];
+
+            free( s->y );
+            free( s->size );
+            free( s->state );
+            free( s->moved );
+            free( s->moved_y[0] );
+            free( s->moved_y[1] );
+            free( s->moved_size[0] );
+            free( s->moved_size[1] );
+        }
+        free( view.spheres.distance );
+        free( view.spheres.lod );
+    }
+    memset( &view, 0, sizeof( view ) );
+    view.spheres.selected = -1;
+    threaded = 0;
+}
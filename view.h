@@ -0,0 +1,76 @@
+// view.h
+// The game as the renderer sees it, and how it gets there from the
+// simulation.
+//
+// With the simulation on its own thread (simthread.h) the two never share
+// state. After every step the simulation thread copies what the renderer
+// needs into a snapshot, and snapshots go through a triple buffer: one
+// being written, the latest finished one, and the one being drawn. Neither
+// side ever waits for the other; the renderer picks up the latest finished
+// snapshot when it starts a frame, and snapshots it never got to are simply
+// overwritten.
+//
+// Snapshots also keep where the spheres that moved during the step, and
+// the camera, were before it. view_update() blends between the two by how
+// far the wall clock has got into the next step, so motion stays smooth
+// when the frame rate and the 60 Hz simulation don't line up. This draws
+// the game one step (about 17 ms) behind.
+//
+// Sphere x and z never change after sim_init(), so they're shared rather
+// than copied. Distances, levels of detail and the selection belong to the
+// renderer.
+//
+// Without a simulation thread (headless, --bench, fast replays)
+// view_alias() points the view straight at the simulation's state instead.
+#ifndef VIEW_H
+#define VIEW_H
+
+#include "sim.h"
+
+#define VIEW_SNAPSHOTS 3
+
+struct Snapshot_t {
+    double wall_ms;             // frametime_now() the step was due at
+    unsigned int time;          // simulation time (ms) after the step
+    unsigned int input_seq;     // inputs applied so far, see input_queued()
+    int active;                 // sim_active() after the step
+    int done;                   // replay_done() after the step
+
+    // sphere state after the step, capacity long
+    float *y, *size;
+    unsigned char *state;
+
+    // spheres that moved during the step, with before and after values
+    int *moved;
+    float *moved_y[2], *moved_size[2];
+    int moved_count;
+
+    struct ThirdPersonCamera_t camera[2];   // before and after
+    float bikeTireAngle, bikeHandlAngle, bikeAngle;
+    int score;
+};
+
+struct View_t {
+    struct SphereSet_t spheres;
+    struct ThirdPersonCamera_t camera;
+    float bikeTireAngle, bikeHandlAngle, bikeAngle;
+    int score;
+    unsigned int time;          // simulation time (ms)
+    unsigned int input_seq;
+    int active;                 // still changing without new input
+    int done;                   // the replay being played has ended
+};
+
+extern struct View_t view;
+
+void view_init( int threaded );
+void view_alias( void );
+void view_update( double now_ms );
+void view_select( int i );
+void calculate_distances( void );
+void view_shutdown( void );
+
+void snapshot_begin( void );
+void snapshot_publish( double wall_ms, unsigned int input_seq );
+
+#endif